@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/encryption.h"
+#include "../include/error.h"
+#include "../include/kernels.h"
+#include "../include/model.h"
+#include "../include/pipeline.h"
+#include "../include/utils.h"
+
+#define BENCH_MODEL_FILE "bench_model.bin"
+#define BENCH_SCHEMA_VERSION 1
+
+// Each sample times enough back-to-back operations to last this long, so
+// clock overhead stays negligible for the fastest operations
+#define SAMPLE_TARGET_NS 20000.0
+#define MIN_SAMPLES 5
+#define MAX_SAMPLES 100000
+
+#define GiB ((size_t)1 << 30)
+
+typedef int (*BenchOp)(void* arg);
+
+typedef struct {
+    char name[64];
+    size_t bytes_per_op;        // 0 when throughput is meaningless
+    size_t iterations;
+    size_t samples;
+    double mean_ns;
+    double min_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double max_ns;
+    double gb_per_s;
+    double allocs_per_op;       // heap allocations, -1 when not counted
+    double secure_allocs_per_op;
+} BenchResult;
+
+typedef struct {
+    const char* filter;
+    const char* json_path;
+    size_t max_size;
+    double min_time_s;
+    BenchResult* results;
+    size_t num_results;
+    size_t results_capacity;
+    int failures;
+} BenchConfig;
+
+#ifdef BENCH_COUNT_MALLOC
+// The harness is linked with --wrap for these, so every heap allocation
+// made by the library (though not inside OpenSSL or liboqs) is counted
+static size_t heap_allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+int __real_posix_memalign(void** ptr, size_t alignment, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    __atomic_fetch_add(&heap_allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&heap_allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    __atomic_fetch_add(&heap_allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void** ptr, size_t alignment, size_t size) {
+    __atomic_fetch_add(&heap_allocations, 1, __ATOMIC_RELAXED);
+    return __real_posix_memalign(ptr, alignment, size);
+}
+
+static size_t count_heap_allocations(void) {
+    return __atomic_load_n(&heap_allocations, __ATOMIC_RELAXED);
+}
+
+static const int heap_allocations_counted = 1;
+#else
+static size_t count_heap_allocations(void) {
+    return 0;
+}
+
+static const int heap_allocations_counted = 0;
+#endif
+
+static size_t count_secure_allocations(void) {
+    SecureAllocStats stats;
+    get_secure_alloc_stats(&stats);
+    return stats.allocations;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double* sorted, size_t n, double p) {
+    size_t rank = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1];
+}
+
+static void format_size(size_t bytes, char* out, size_t out_len) {
+    if (bytes >= GiB && bytes % GiB == 0) {
+        snprintf(out, out_len, "%zuGiB", bytes / GiB);
+    } else if (bytes >= ((size_t)1 << 20) && bytes % ((size_t)1 << 20) == 0) {
+        snprintf(out, out_len, "%zuMiB", bytes >> 20);
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        snprintf(out, out_len, "%zuKiB", bytes >> 10);
+    } else {
+        snprintf(out, out_len, "%zuB", bytes);
+    }
+}
+
+static int selected(const BenchConfig* config, const char* name) {
+    return !config->filter || strstr(name, config->filter) != NULL;
+}
+
+static BenchResult* add_result(BenchConfig* config) {
+    if (config->num_results == config->results_capacity) {
+        size_t capacity = config->results_capacity ? 2 * config->results_capacity : 32;
+        BenchResult* results = realloc(config->results, capacity * sizeof(BenchResult));
+        if (!results) {
+            return NULL;
+        }
+        config->results = results;
+        config->results_capacity = capacity;
+    }
+    BenchResult* result = &config->results[config->num_results++];
+    memset(result, 0, sizeof(*result));
+    return result;
+}
+
+/**
+ * Time an operation until it has run for at least min_time_s and
+ * MIN_SAMPLES samples, then record its statistics
+ *
+ * @param config The run configuration
+ * @param name The benchmark name
+ * @param bytes_per_op Bytes processed by one operation (0 for none)
+ * @param op The operation, returning 0 on success
+ * @param arg The argument passed to op
+ */
+static void run_bench(BenchConfig* config, const char* name, size_t bytes_per_op,
+                      BenchOp op, void* arg) {
+    if (!selected(config, name)) {
+        return;
+    }
+
+    // One untimed run warms caches and pools and sizes the samples
+    double start = now_ns();
+    if (op(arg) != 0) {
+        fprintf(stderr, "%s: failed: %s\n", name, qrme_last_error_message());
+        config->failures++;
+        return;
+    }
+    double single_ns = now_ns() - start;
+    size_t batch = single_ns >= SAMPLE_TARGET_NS ? 1 : (size_t)(SAMPLE_TARGET_NS / (single_ns + 1.0)) + 1;
+
+    // Allocated up front so the harness adds nothing to the counts
+    double* samples = malloc(MAX_SAMPLES * sizeof(double));
+    if (!samples) {
+        config->failures++;
+        return;
+    }
+
+    size_t num_samples = 0;
+    size_t heap_before = count_heap_allocations();
+    size_t secure_before = count_secure_allocations();
+    double total_ns = 0.0;
+    while ((total_ns < config->min_time_s * 1e9 || num_samples < MIN_SAMPLES) &&
+           num_samples < MAX_SAMPLES) {
+        start = now_ns();
+        for (size_t i = 0; i < batch; i++) {
+            if (op(arg) != 0) {
+                fprintf(stderr, "%s: failed: %s\n", name, qrme_last_error_message());
+                config->failures++;
+                free(samples);
+                return;
+            }
+        }
+        double elapsed = now_ns() - start;
+        total_ns += elapsed;
+        samples[num_samples++] = elapsed / (double)batch;
+    }
+    size_t heap_allocs = count_heap_allocations() - heap_before;
+    size_t secure_allocs = count_secure_allocations() - secure_before;
+
+    BenchResult* result = add_result(config);
+    if (!result) {
+        config->failures++;
+        free(samples);
+        return;
+    }
+    qsort(samples, num_samples, sizeof(double), compare_doubles);
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->bytes_per_op = bytes_per_op;
+    result->samples = num_samples;
+    result->iterations = num_samples * batch;
+    result->mean_ns = total_ns / (double)result->iterations;
+    result->min_ns = samples[0];
+    result->p50_ns = percentile(samples, num_samples, 50.0);
+    result->p90_ns = percentile(samples, num_samples, 90.0);
+    result->p99_ns = percentile(samples, num_samples, 99.0);
+    result->max_ns = samples[num_samples - 1];
+    result->gb_per_s = bytes_per_op ? (double)bytes_per_op / result->mean_ns : 0.0;
+    result->allocs_per_op = heap_allocations_counted ?
+                            (double)heap_allocs / (double)result->iterations : -1.0;
+    result->secure_allocs_per_op = (double)secure_allocs / (double)result->iterations;
+    free(samples);
+
+    printf("%-36s %10zu %14.0f %12.0f %12.0f %12.0f %9.3f %9.2f %9.2f\n",
+           result->name, result->iterations, result->mean_ns, result->p50_ns,
+           result->p90_ns, result->p99_ns, result->gb_per_s,
+           result->allocs_per_op, result->secure_allocs_per_op);
+    fflush(stdout);
+}
+
+/* Key generation */
+
+static int op_generate_keypair(void* arg) {
+    (void)arg;
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    int ret = generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    return ret;
+}
+
+/* Encryption and decryption */
+
+typedef struct {
+    const uint8_t* public_key;
+    size_t public_key_len;
+    const uint8_t* secret_key;
+    size_t secret_key_len;
+    const uint8_t* plaintext;
+    size_t plaintext_len;
+    uint8_t* ciphertext;
+    size_t ciphertext_len;
+} CryptoBench;
+
+static int op_encrypt(void* arg) {
+    CryptoBench* bench = arg;
+    uint8_t* ciphertext = NULL;
+    size_t ciphertext_len;
+    int ret = encrypt(bench->public_key, bench->public_key_len, bench->plaintext,
+                      bench->plaintext_len, &ciphertext, &ciphertext_len);
+    cleanup((void**)&ciphertext);
+    return ret;
+}
+
+static int op_decrypt(void* arg) {
+    CryptoBench* bench = arg;
+    uint8_t* plaintext = NULL;
+    size_t plaintext_len;
+    int ret = decrypt(bench->secret_key, bench->secret_key_len, bench->ciphertext,
+                      bench->ciphertext_len, &plaintext, &plaintext_len);
+    cleanup((void**)&plaintext);
+    return ret;
+}
+
+static void bench_crypto(BenchConfig* config, const uint8_t* public_key, size_t public_key_len,
+                         const uint8_t* secret_key, size_t secret_key_len) {
+    // 64 B to 1 GiB in steps of 16x
+    for (size_t size = 64; size <= config->max_size && size <= GiB; size *= 16) {
+        char size_name[16], encrypt_name[64], decrypt_name[64];
+        format_size(size, size_name, sizeof(size_name));
+        snprintf(encrypt_name, sizeof(encrypt_name), "encrypt/%s", size_name);
+        snprintf(decrypt_name, sizeof(decrypt_name), "decrypt/%s", size_name);
+        if (!selected(config, encrypt_name) && !selected(config, decrypt_name)) {
+            continue;
+        }
+
+        uint8_t* plaintext = malloc(size);
+        if (!plaintext) {
+            fprintf(stderr, "%s: skipped, not enough memory\n", size_name);
+            continue;
+        }
+        for (size_t i = 0; i < size; i++) {
+            plaintext[i] = (uint8_t)(i * 131 + (i >> 8));
+        }
+
+        CryptoBench bench = {public_key, public_key_len, secret_key, secret_key_len,
+                             plaintext, size, NULL, 0};
+        run_bench(config, encrypt_name, size, op_encrypt, &bench);
+        if (selected(config, decrypt_name)) {
+            if (encrypt(public_key, public_key_len, plaintext, size,
+                        &bench.ciphertext, &bench.ciphertext_len) != 0) {
+                fprintf(stderr, "%s: setup failed: %s\n", decrypt_name, get_error());
+                config->failures++;
+            } else {
+                run_bench(config, decrypt_name, size, op_decrypt, &bench);
+            }
+            cleanup((void**)&bench.ciphertext);
+        }
+        free(plaintext);
+    }
+}
+
+/* Model save, load and inference */
+
+typedef struct {
+    const char* name;
+    size_t widths[5];           // input width, then each layer's output width
+    size_t num_layers;
+} ModelShape;
+
+static const ModelShape model_shapes[] = {
+    {"mlp-64", {64, 128, 128, 10}, 3},
+    {"mlp-512", {512, 1024, 1024, 256}, 3},
+    {"mlp-2048", {2048, 4096, 4096, 1024}, 3},
+    {"deep-256", {256, 256, 256, 256, 256}, 4}
+};
+
+#define INFERENCE_BATCH 32
+
+typedef struct {
+    Model* model;
+    const uint8_t* public_key;
+    size_t public_key_len;
+    const uint8_t* secret_key;
+    size_t secret_key_len;
+    InferenceWorkspace* ws;
+    float* inputs;
+    float* outputs;
+    size_t input_size;
+    size_t output_size;
+} ModelBench;
+
+static Model* build_model(const ModelShape* shape) {
+    Model* model = create_model();
+    if (!model) {
+        return NULL;
+    }
+    for (size_t l = 0; l < shape->num_layers; l++) {
+        size_t cols = shape->widths[l], rows = shape->widths[l + 1];
+        float* weights = generate_random_float_array(rows * cols, -0.1f, 0.1f);
+        float* bias = generate_random_float_array(rows, -0.1f, 0.1f);
+        int ret = weights && bias ? add_layer_ex(model, weights, bias, rows, cols,
+                                                 l + 1 < shape->num_layers ? ACTIVATION_RELU :
+                                                 ACTIVATION_NONE) : -1;
+        secure_free((void**)&weights);
+        secure_free((void**)&bias);
+        if (ret != 0) {
+            free_model(model);
+            return NULL;
+        }
+    }
+    return model;
+}
+
+static size_t model_weight_bytes(const ModelShape* shape) {
+    size_t bytes = 0;
+    for (size_t l = 0; l < shape->num_layers; l++) {
+        bytes += (shape->widths[l] + 1) * shape->widths[l + 1] * sizeof(float);
+    }
+    return bytes;
+}
+
+static int op_save_model(void* arg) {
+    ModelBench* bench = arg;
+    return save_model(bench->model, BENCH_MODEL_FILE, bench->public_key, bench->public_key_len);
+}
+
+static int op_load_model(void* arg) {
+    ModelBench* bench = arg;
+    Model* model = load_model(BENCH_MODEL_FILE, bench->secret_key, bench->secret_key_len);
+    if (!model) {
+        return -1;
+    }
+    free_model(model);
+    return 0;
+}
+
+static int op_inference(void* arg) {
+    ModelBench* bench = arg;
+    return inference_ws(bench->model, bench->ws, bench->inputs, bench->input_size,
+                        bench->outputs, bench->output_size);
+}
+
+static int op_inference_batch(void* arg) {
+    ModelBench* bench = arg;
+    return inference_batch(bench->model, bench->inputs, INFERENCE_BATCH, bench->input_size,
+                           bench->outputs, bench->output_size);
+}
+
+static void bench_models(BenchConfig* config, const uint8_t* public_key, size_t public_key_len,
+                         const uint8_t* secret_key, size_t secret_key_len) {
+    for (size_t s = 0; s < sizeof(model_shapes) / sizeof(model_shapes[0]); s++) {
+        const ModelShape* shape = &model_shapes[s];
+        char save_name[64], load_name[64], single_name[64], batch_name[64];
+        snprintf(save_name, sizeof(save_name), "save_model/%s", shape->name);
+        snprintf(load_name, sizeof(load_name), "load_model/%s", shape->name);
+        snprintf(single_name, sizeof(single_name), "inference/%s", shape->name);
+        snprintf(batch_name, sizeof(batch_name), "inference_batch/%s/b%d", shape->name, INFERENCE_BATCH);
+        if (!selected(config, save_name) && !selected(config, load_name) &&
+            !selected(config, single_name) && !selected(config, batch_name)) {
+            continue;
+        }
+
+        ModelBench bench = {0};
+        bench.model = build_model(shape);
+        bench.public_key = public_key;
+        bench.public_key_len = public_key_len;
+        bench.secret_key = secret_key;
+        bench.secret_key_len = secret_key_len;
+        bench.input_size = shape->widths[0];
+        bench.output_size = shape->widths[shape->num_layers];
+        bench.inputs = generate_random_float_array(INFERENCE_BATCH * bench.input_size, -1.0f, 1.0f);
+        bench.outputs = calloc(INFERENCE_BATCH * bench.output_size, sizeof(float));
+        bench.ws = bench.model ? create_inference_workspace(bench.model) : NULL;
+        if (!bench.model || !bench.inputs || !bench.outputs || !bench.ws) {
+            fprintf(stderr, "%s: setup failed: %s\n", shape->name, qrme_last_error_message());
+            config->failures++;
+            goto next;
+        }
+
+        // Throughput counts the file for save and load, and the weights
+        // streamed through the kernels for inference
+        size_t weight_bytes = model_weight_bytes(shape);
+        if (op_save_model(&bench) != 0) {
+            fprintf(stderr, "%s: setup failed: %s\n", save_name, get_model_error());
+            config->failures++;
+            goto next;
+        }
+        struct stat st;
+        size_t file_bytes = stat(BENCH_MODEL_FILE, &st) == 0 ? (size_t)st.st_size : 0;
+
+        run_bench(config, save_name, file_bytes, op_save_model, &bench);
+        run_bench(config, load_name, file_bytes, op_load_model, &bench);
+        run_bench(config, single_name, weight_bytes, op_inference, &bench);
+        run_bench(config, batch_name, weight_bytes, op_inference_batch, &bench);
+
+    next:
+        remove(BENCH_MODEL_FILE);
+        secure_free((void**)&bench.inputs);
+        free(bench.outputs);
+        free_inference_workspace(bench.ws);
+        free_model(bench.model);
+    }
+}
+
+/* Encrypted request handling: one thread against the staged pipeline */
+
+#define REQUEST_BURST 32
+
+typedef struct {
+    const Model* model;
+    InferenceWorkspace* ws;
+    QrmePipeline* pipeline;
+    const uint8_t* public_key;
+    size_t public_key_len;
+    const uint8_t* secret_key;
+    size_t secret_key_len;
+    uint8_t* requests[REQUEST_BURST];
+    size_t request_lens[REQUEST_BURST];
+    float* input;
+    float* output;
+    size_t input_size;
+    size_t output_size;
+} RequestBench;
+
+static int op_requests_sequential(void* arg) {
+    RequestBench* bench = arg;
+    for (size_t r = 0; r < REQUEST_BURST; r++) {
+        size_t count;
+        uint8_t* response;
+        size_t response_len;
+        if (decrypt_floats_into(bench->secret_key, bench->secret_key_len, bench->requests[r],
+                                bench->request_lens[r], bench->input, bench->input_size, &count) != 0 ||
+            inference_ws(bench->model, bench->ws, bench->input, bench->input_size,
+                         bench->output, bench->output_size) != 0 ||
+            encrypt_floats(bench->public_key, bench->public_key_len, bench->output,
+                           bench->output_size, &response, &response_len) != 0) {
+            return -1;
+        }
+        secure_free((void**)&response);
+    }
+    return 0;
+}
+
+static int op_requests_pipeline(void* arg) {
+    RequestBench* bench = arg;
+    for (size_t r = 0; r < REQUEST_BURST; r++) {
+        if (pipeline_submit(bench->pipeline, bench->requests[r], bench->request_lens[r], NULL, NULL) != 0) {
+            return -1;
+        }
+    }
+    int ret = 0;
+    for (size_t r = 0; r < REQUEST_BURST; r++) {
+        PipelineResult result = {0};
+        if (pipeline_receive(bench->pipeline, &result) != 0) {
+            return -1;
+        }
+        if (result.status != QRME_OK) {
+            ret = -1;
+        }
+        if (result.response) {
+            secure_free((void**)&result.response);
+        }
+    }
+    return ret;
+}
+
+static void bench_requests(BenchConfig* config, const uint8_t* public_key, size_t public_key_len,
+                           const uint8_t* secret_key, size_t secret_key_len) {
+    for (size_t s = 0; s < sizeof(model_shapes) / sizeof(model_shapes[0]); s++) {
+        const ModelShape* shape = &model_shapes[s];
+        char sequential_name[64], pipeline_name[64];
+        snprintf(sequential_name, sizeof(sequential_name), "requests/sequential/%s/b%d",
+                 shape->name, REQUEST_BURST);
+        snprintf(pipeline_name, sizeof(pipeline_name), "requests/pipeline/%s/b%d",
+                 shape->name, REQUEST_BURST);
+        if (!selected(config, sequential_name) && !selected(config, pipeline_name)) {
+            continue;
+        }
+
+        RequestBench bench = {0};
+        Model* model = build_model(shape);
+        bench.model = model;
+        bench.public_key = public_key;
+        bench.public_key_len = public_key_len;
+        bench.secret_key = secret_key;
+        bench.secret_key_len = secret_key_len;
+        bench.input_size = shape->widths[0];
+        bench.output_size = shape->widths[shape->num_layers];
+        bench.input = secure_alloc(bench.input_size * sizeof(float));
+        bench.output = secure_alloc(bench.output_size * sizeof(float));
+        float* inputs = generate_random_float_array(REQUEST_BURST * bench.input_size, -1.0f, 1.0f);
+        PipelineConfig pipeline_config;
+        pipeline_default_config(&pipeline_config);
+        if (model) {
+            bench.ws = create_inference_workspace(model);
+            bench.pipeline = create_pipeline(&pipeline_config, model, secret_key, secret_key_len,
+                                             public_key, public_key_len);
+        }
+        int ok = model && bench.ws && bench.input && bench.output && inputs && bench.pipeline;
+        for (size_t r = 0; ok && r < REQUEST_BURST; r++) {
+            ok = encrypt_floats(public_key, public_key_len, inputs + r * bench.input_size,
+                                bench.input_size, &bench.requests[r], &bench.request_lens[r]) == 0;
+        }
+        if (ok) {
+            // Throughput counts the ciphertext taken in
+            size_t request_bytes = REQUEST_BURST * bench.request_lens[0];
+            run_bench(config, sequential_name, request_bytes, op_requests_sequential, &bench);
+            run_bench(config, pipeline_name, request_bytes, op_requests_pipeline, &bench);
+        } else {
+            fprintf(stderr, "%s: setup failed: %s\n", shape->name, qrme_last_error_message());
+            config->failures++;
+        }
+
+        free_pipeline(bench.pipeline);
+        for (size_t r = 0; r < REQUEST_BURST; r++) {
+            if (bench.requests[r]) {
+                secure_free((void**)&bench.requests[r]);
+            }
+        }
+        if (inputs) secure_free((void**)&inputs);
+        if (bench.input) secure_free((void**)&bench.input);
+        if (bench.output) secure_free((void**)&bench.output);
+        free_inference_workspace(bench.ws);
+        free_model(model);
+    }
+}
+
+/* Output */
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static int write_json(const BenchConfig* config) {
+    FILE* out = strcmp(config->json_path, "-") == 0 ? stdout : fopen(config->json_path, "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s for writing\n", config->json_path);
+        return -1;
+    }
+
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n  \"schema_version\": %d,\n", BENCH_SCHEMA_VERSION);
+    fprintf(out, "  \"timestamp\": \"%s\",\n", timestamp);
+    fprintf(out, "  \"kernel_isa\": \"%s\",\n", kernel_isa_name(get_kernel_isa()));
+    fprintf(out, "  \"online_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(out, "  \"min_time_s\": %.3f,\n", config->min_time_s);
+    fprintf(out, "  \"heap_allocations_counted\": %s,\n",
+            heap_allocations_counted ? "true" : "false");
+    fprintf(out, "  \"results\": [");
+    for (size_t i = 0; i < config->num_results; i++) {
+        const BenchResult* r = &config->results[i];
+        fprintf(out, "%s\n    {\"name\": ", i ? "," : "");
+        write_json_string(out, r->name);
+        fprintf(out, ", \"bytes_per_op\": %zu, \"iterations\": %zu, \"samples\": %zu,"
+                " \"ns_per_op\": %.1f, \"min_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f,"
+                " \"p99_ns\": %.1f, \"max_ns\": %.1f, \"gb_per_s\": %.4f,"
+                " \"allocs_per_op\": %.3f, \"secure_allocs_per_op\": %.3f}",
+                r->bytes_per_op, r->iterations, r->samples, r->mean_ns, r->min_ns,
+                r->p50_ns, r->p90_ns, r->p99_ns, r->max_ns, r->gb_per_s,
+                r->allocs_per_op, r->secure_allocs_per_op);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "Failed to write %s\n", config->json_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_usage(const char* program_name) {
+    fprintf(stderr, "Usage: %s [options]\n", program_name);
+    fprintf(stderr, "  --json FILE        Write results as JSON to FILE (- for stdout)\n");
+    fprintf(stderr, "  --filter TEXT      Only run benchmarks whose name contains TEXT\n");
+    fprintf(stderr, "  --max-size BYTES   Largest encrypt/decrypt payload (default 1 GiB)\n");
+    fprintf(stderr, "  --min-time SECS    Minimum measuring time per benchmark (default 0.5)\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config = {0};
+    config.max_size = GiB;
+    config.min_time_s = 0.5;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--json") == 0 && value) {
+            config.json_path = value;
+        } else if (strcmp(argv[i], "--filter") == 0 && value) {
+            config.filter = value;
+        } else if (strcmp(argv[i], "--max-size") == 0 && value) {
+            config.max_size = (size_t)strtoull(value, NULL, 0);
+        } else if (strcmp(argv[i], "--min-time") == 0 && value) {
+            config.min_time_s = strtod(value, NULL);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    init_encryption();
+    // Fixed seed so every run benchmarks the same weights
+    srand(22);
+
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    if (generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) != 0) {
+        fprintf(stderr, "Failed to generate key pair: %s\n", get_error());
+        return 1;
+    }
+
+    printf("%-36s %10s %14s %12s %12s %12s %9s %9s %9s\n", "benchmark", "ops", "ns/op",
+           "p50 ns", "p90 ns", "p99 ns", "GB/s", "allocs", "secure");
+    run_bench(&config, "generate_keypair", 0, op_generate_keypair, NULL);
+    bench_crypto(&config, public_key, public_key_len, secret_key, secret_key_len);
+    bench_models(&config, public_key, public_key_len, secret_key, secret_key_len);
+    bench_requests(&config, public_key, public_key_len, secret_key, secret_key_len);
+
+    int ret = config.failures ? 1 : 0;
+    if (config.json_path && write_json(&config) != 0) {
+        ret = 1;
+    }
+
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    free(config.results);
+    cleanup_encryption();
+    return ret;
+}
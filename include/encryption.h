@@ -8,6 +8,21 @@
 extern "C" {
 #endif
 
+/**
+ * Reusable KEM/cipher state for encryption and decryption.
+ * A context caches the Kyber-768 KEM instance, the AES-256-GCM cipher
+ * context and the KEM scratch buffers, so repeated calls avoid the
+ * per-call setup and teardown. A context must not be shared between
+ * threads; use get_thread_crypto_ctx() for a per-thread instance.
+ */
+typedef struct QrmeCryptoCtx QrmeCryptoCtx;
+
+/*
+ * Functions that take no context (encrypt(), decrypt(), decrypt_into() and
+ * the rest) use the calling thread's context and may be called from any
+ * number of threads at once.
+ */
+
 /**
  * Generate a quantum-resistant key pair
  *
@@ -22,6 +37,7 @@ int generate_keypair(uint8_t **public_key, size_t *public_key_len,
 
 /**
  * Encrypt data using CRYSTALS-Kyber and AES-256-GCM
+ * Uses the calling thread's crypto context.
  *
  * @param public_key The public key
  * @param public_key_len Length of the public key
@@ -37,6 +53,7 @@ int encrypt(const uint8_t *public_key, size_t public_key_len,
 
 /**
  * Decrypt data using CRYSTALS-Kyber and AES-256-GCM
+ * Uses the calling thread's crypto context.
  *
  * @param secret_key The secret key
  * @param secret_key_len Length of the secret key
@@ -50,6 +67,162 @@ int decrypt(const uint8_t *secret_key, size_t secret_key_len,
             const uint8_t *ciphertext, size_t ciphertext_len,
             uint8_t **plaintext, size_t *plaintext_len);
 
+/**
+ * Create a reusable crypto context
+ *
+ * @return A pointer to the new context, or NULL on failure
+ */
+QrmeCryptoCtx* create_crypto_ctx(void);
+
+/**
+ * Free a crypto context created with create_crypto_ctx()
+ *
+ * @param ctx The context to free (may be NULL)
+ */
+void free_crypto_ctx(QrmeCryptoCtx *ctx);
+
+/**
+ * Get the crypto context owned by the calling thread, creating it on
+ * first use. It is released automatically when the thread exits and
+ * must not be passed to free_crypto_ctx().
+ *
+ * @return The per-thread context, or NULL on failure
+ */
+QrmeCryptoCtx* get_thread_crypto_ctx(void);
+
+/**
+ * Encrypt data using a reusable crypto context
+ *
+ * @param ctx The crypto context
+ * @param public_key The public key
+ * @param public_key_len Length of the public key
+ * @param plaintext The data to encrypt
+ * @param plaintext_len Length of the plaintext
+ * @param ciphertext Pointer to store the encrypted data
+ * @param ciphertext_len Pointer to store the length of the ciphertext
+ * @return 0 on success, -1 on failure
+ */
+int encrypt_ctx(QrmeCryptoCtx *ctx,
+                const uint8_t *public_key, size_t public_key_len,
+                const uint8_t *plaintext, size_t plaintext_len,
+                uint8_t **ciphertext, size_t *ciphertext_len);
+
+/**
+ * Decrypt data using a reusable crypto context
+ *
+ * @param ctx The crypto context
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param ciphertext The data to decrypt
+ * @param ciphertext_len Length of the ciphertext
+ * @param plaintext Pointer to store the decrypted data
+ * @param plaintext_len Pointer to store the length of the plaintext
+ * @return 0 on success, -1 on failure
+ */
+int decrypt_ctx(QrmeCryptoCtx *ctx,
+                const uint8_t *secret_key, size_t secret_key_len,
+                const uint8_t *ciphertext, size_t ciphertext_len,
+                uint8_t **plaintext, size_t *plaintext_len);
+
+/**
+ * Get the plaintext size of a ciphertext produced by encrypt()
+ *
+ * @param ciphertext_len Length of the ciphertext
+ * @return The plaintext length, or 0 if the ciphertext is too short
+ */
+size_t decrypted_size(size_t ciphertext_len);
+
+/**
+ * Decrypt data into a caller-provided buffer using a reusable crypto context.
+ * On failure the buffer is wiped, so no unauthenticated plaintext is exposed.
+ *
+ * @param ctx The crypto context
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param ciphertext The data to decrypt
+ * @param ciphertext_len Length of the ciphertext
+ * @param plaintext Buffer to store the decrypted data
+ * @param plaintext_capacity Size of the buffer (at least decrypted_size(ciphertext_len))
+ * @param plaintext_len Pointer to store the length of the plaintext
+ * @return 0 on success, -1 on failure
+ */
+int decrypt_ctx_into(QrmeCryptoCtx *ctx,
+                     const uint8_t *secret_key, size_t secret_key_len,
+                     const uint8_t *ciphertext, size_t ciphertext_len,
+                     uint8_t *plaintext, size_t plaintext_capacity,
+                     size_t *plaintext_len);
+
+/**
+ * Decrypt data into a caller-provided buffer
+ * Uses the calling thread's crypto context.
+ *
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param ciphertext The data to decrypt
+ * @param ciphertext_len Length of the ciphertext
+ * @param plaintext Buffer to store the decrypted data
+ * @param plaintext_capacity Size of the buffer (at least decrypted_size(ciphertext_len))
+ * @param plaintext_len Pointer to store the length of the plaintext
+ * @return 0 on success, -1 on failure
+ */
+int decrypt_into(const uint8_t *secret_key, size_t secret_key_len,
+                 const uint8_t *ciphertext, size_t ciphertext_len,
+                 uint8_t *plaintext, size_t plaintext_capacity,
+                 size_t *plaintext_len);
+
+/**
+ * Encrypt a float vector in its little-endian encoding (see utils.h).
+ * On little-endian hosts the vector is encrypted where it lies, with no
+ * intermediate byte copy.
+ * Uses the calling thread's crypto context.
+ *
+ * @param public_key The public key
+ * @param public_key_len Length of the public key
+ * @param values The vector to encrypt
+ * @param count The number of floats in the vector
+ * @param ciphertext Pointer to store the encrypted data
+ * @param ciphertext_len Pointer to store the length of the ciphertext
+ * @return 0 on success, -1 on failure
+ */
+int encrypt_floats(const uint8_t *public_key, size_t public_key_len,
+                   const float *values, size_t count,
+                   uint8_t **ciphertext, size_t *ciphertext_len);
+
+/**
+ * Decrypt a float vector produced by encrypt_floats() straight into a
+ * caller-provided float buffer, converting it to host order in place.
+ * On failure the buffer is wiped.
+ * Uses the calling thread's crypto context.
+ *
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param ciphertext The data to decrypt
+ * @param ciphertext_len Length of the ciphertext
+ * @param values Buffer to store the vector
+ * @param capacity Number of floats the buffer holds
+ * @param count Pointer to store the number of floats decrypted
+ * @return 0 on success, -1 on failure
+ */
+int decrypt_floats_into(const uint8_t *secret_key, size_t secret_key_len,
+                        const uint8_t *ciphertext, size_t ciphertext_len,
+                        float *values, size_t capacity, size_t *count);
+
+/**
+ * Derive key material with HKDF-SHA256
+ *
+ * @param key The input keying material (e.g. a KEM shared secret)
+ * @param key_len Length of the input keying material
+ * @param salt The salt
+ * @param salt_len Length of the salt
+ * @param info NUL-terminated context string
+ * @param out Buffer to store the derived key material
+ * @param out_len Number of bytes to derive
+ * @return 0 on success, -1 on failure
+ */
+int hkdf_sha256(const uint8_t *key, size_t key_len,
+                const uint8_t *salt, size_t salt_len,
+                const char *info, uint8_t *out, size_t out_len);
+
 /**
  * Clean up and free memory
  *
@@ -59,18 +232,21 @@ void cleanup(void **ptr);
 
 /**
  * Initialize the encryption module
- * This function should be called once at the start of the program
+ * This function should be called once at the start of the program,
+ * before any other thread uses the library
  */
 void init_encryption(void);
 
 /**
  * Cleanup the encryption module
- * This function should be called once at the end of the program
+ * This function should be called once at the end of the program,
+ * after every other thread has stopped using the library
  */
 void cleanup_encryption(void);
 
 /**
  * Get the last error message from the encryption module
+ * on the calling thread (see error.h)
  *
  * @return The last error message
  */
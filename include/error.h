@@ -0,0 +1,111 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Error reporting.
+ *
+ * Every function that can fail records why in state private to the calling
+ * thread: a numeric code, the module that failed and a message. Threads
+ * never see each other's errors, so concurrent callers need no locking to
+ * report or read them. A successful call leaves the state unchanged, so it
+ * must only be read after a call has reported failure.
+ *
+ * The get_*_error() functions of each module return the message of the
+ * last error that module recorded on the calling thread.
+ *
+ * Thread safety, throughout the library: functions are safe to call
+ * concurrently on different objects, and functions taking a const object
+ * are safe to call concurrently on the same one. Anything that modifies an
+ * object (adding or converting layers, freeing it) must not race with any
+ * other use of that object. Headers note the exceptions.
+ */
+
+typedef enum {
+    QRME_OK = 0,
+    QRME_ERR_INVALID_ARGUMENT,  // a parameter is NULL, out of range or inconsistent
+    QRME_ERR_OUT_OF_MEMORY,     // an allocation or mapping failed
+    QRME_ERR_IO,                // a file could not be opened, read or written
+    QRME_ERR_FORMAT,            // input data is truncated, corrupt or of an unknown version
+    QRME_ERR_CRYPTO,            // a KEM, cipher or key derivation operation failed
+    QRME_ERR_AUTH,              // a tag, replay or ordering check failed
+    QRME_ERR_UNSUPPORTED,       // the operation does not apply to this object
+    QRME_ERR_STATE,             // the object is in the wrong state for the call
+    QRME_ERR_RESOURCE,          // a thread or other system resource was unavailable
+    QRME_ERR_COUNT
+} QrmeErrorCode;
+
+typedef enum {
+    QRME_MODULE_NONE = 0,
+    QRME_MODULE_ENCRYPTION,
+    QRME_MODULE_FORMAT,
+    QRME_MODULE_MODEL,
+    QRME_MODULE_SESSION,
+    QRME_MODULE_STREAM,
+    QRME_MODULE_UTILS,
+    QRME_MODULE_SECURE_ALLOC,
+    QRME_MODULE_SECURE_ARENA,
+    QRME_MODULE_SERVER,
+    QRME_MODULE_PIPELINE,
+    QRME_MODULE_COUNT
+} QrmeErrorModule;
+
+/**
+ * Record an error for the calling thread
+ *
+ * @param module The module reporting the error
+ * @param code The error code
+ * @param message The message (truncated to 255 bytes)
+ */
+void qrme_set_error(QrmeErrorModule module, QrmeErrorCode code, const char* message);
+
+/**
+ * Get the code of the last error recorded on the calling thread
+ *
+ * @return The error code, or QRME_OK if none has been recorded
+ */
+QrmeErrorCode qrme_last_error(void);
+
+/**
+ * Get the module of the last error recorded on the calling thread
+ *
+ * @return The module, or QRME_MODULE_NONE if none has been recorded
+ */
+QrmeErrorModule qrme_last_error_module(void);
+
+/**
+ * Get the message of the last error recorded on the calling thread
+ *
+ * @return The message, valid until the thread records another error
+ */
+const char* qrme_last_error_message(void);
+
+/**
+ * Get the message of the last error a module recorded on the calling thread
+ *
+ * @param module The module
+ * @return The message, or an empty string if there is none
+ */
+const char* qrme_module_error(QrmeErrorModule module);
+
+/**
+ * Forget every error recorded on the calling thread
+ */
+void qrme_clear_error(void);
+
+/**
+ * Get the name of an error code
+ *
+ * @param code The error code
+ * @return A static string such as "invalid argument"
+ */
+const char* qrme_error_name(QrmeErrorCode code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ERROR_H */
@@ -0,0 +1,157 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Model container format.
+ *
+ * Version 2 files are portable: every integer is fixed-width little-endian.
+ *
+ *   offset 0   header (MODEL_HEADER_SIZE bytes)
+ *                magic "QRME", version, header size, TOC entry size,
+ *                layer count, TOC offset, public key offset and length,
+ *                flags, TOC CRC-32, header CRC-32
+ *   TOC        one MODEL_TOC_ENTRY_SIZE entry per layer: blob offset and
+ *              length, rows, cols, dtype, flags, CRC-32 of the blob,
+ *              activation
+ *   public key
+ *   layer blobs, each as produced by encrypt(); for MODEL_DTYPE_F32 the
+ *              plaintext is the weights followed by rows bias values when
+ *              the layer has MODEL_LAYER_FLAG_HAS_BIAS. The other dtypes
+ *              use the layouts described for LayerDType in model.h
+ *
+ * Version 1 files (written before the container was versioned) are a raw
+ * sequence of host-endian size_t fields and blobs with the public key at
+ * the end. They are still readable; their index is built by scanning.
+ */
+
+#define MODEL_FORMAT_MAGIC "QRME"
+#define MODEL_FORMAT_VERSION 2
+#define MODEL_HEADER_SIZE 64
+#define MODEL_TOC_ENTRY_SIZE 48
+
+#define MODEL_DTYPE_F32 0
+#define MODEL_DTYPE_INT8 1
+#define MODEL_DTYPE_F16 2
+#define MODEL_DTYPE_BF16 3
+
+#define MODEL_LAYER_FLAG_HAS_BIAS 0x1
+
+typedef struct {
+    uint64_t offset;            // file offset of the encrypted layer blob
+    uint64_t length;            // length of the encrypted layer blob
+    uint64_t rows;
+    uint64_t cols;
+    uint32_t dtype;
+    uint32_t flags;
+    uint32_t checksum;          // CRC-32 of the encrypted blob (version 2 only)
+    uint32_t activation;        // activation applied after the layer (0 = ReLU)
+} LayerEntry;
+
+typedef struct {
+    uint32_t version;
+    size_t num_layers;
+    LayerEntry* layers;
+    uint64_t public_key_offset;
+    uint64_t public_key_len;
+} ModelIndex;
+
+/**
+ * Writes a version 2 model file: layers are appended in order and the
+ * header and table of contents are filled in by finish_model_file().
+ * A writer must not be used from several threads at once.
+ */
+typedef struct ModelWriter ModelWriter;
+
+/**
+ * Read the layer index of a model file without decrypting anything.
+ * Version 2 headers and tables of contents are checked against their CRCs.
+ *
+ * @param file The open model file (its position is left unspecified)
+ * @param index Pointer to the index to fill in
+ * @return 0 on success, -1 on failure
+ */
+int read_model_index(FILE* file, ModelIndex* index);
+
+/**
+ * Free the memory held by a model index
+ *
+ * @param index The index to free
+ */
+void free_model_index(ModelIndex* index);
+
+/**
+ * Check a model file's structure and every layer checksum without
+ * decrypting. Version 1 files carry no checksums and are only checked
+ * structurally.
+ *
+ * @param filename The name of the model file
+ * @return 0 if the file is intact, -1 otherwise
+ */
+int verify_model_file(const char* filename);
+
+/**
+ * Start writing a version 2 model file
+ *
+ * @param filename The name of the file to create
+ * @param num_layers The number of layers that will be written
+ * @param public_key The public key stored in the file
+ * @param public_key_len Length of the public key
+ * @return A pointer to the new writer, or NULL on failure
+ */
+ModelWriter* begin_model_file(const char* filename, size_t num_layers,
+                              const uint8_t* public_key, size_t public_key_len);
+
+/**
+ * Append the next encrypted layer to a model file
+ *
+ * @param writer The writer
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param dtype The weight storage type
+ * @param flags Layer flags
+ * @param activation The activation applied after the layer
+ * @param blob The encrypted layer
+ * @param blob_len Length of the encrypted layer
+ * @return 0 on success, -1 on failure
+ */
+int write_model_layer(ModelWriter* writer, size_t rows, size_t cols,
+                      uint32_t dtype, uint32_t flags, uint32_t activation,
+                      const uint8_t* blob, size_t blob_len);
+
+/**
+ * Write the header and table of contents, close the file and free the
+ * writer. The writer is freed even on failure.
+ *
+ * @param writer The writer
+ * @return 0 on success, -1 on failure
+ */
+int finish_model_file(ModelWriter* writer);
+
+/**
+ * Abandon a model file, closing it and freeing the writer
+ *
+ * @param writer The writer (may be NULL)
+ */
+void abort_model_file(ModelWriter* writer);
+
+/**
+ * Get the last error message from the format module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_format_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FORMAT_H */
@@ -0,0 +1,311 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Instruction sets the matrix kernels can be built for. The best one the
+ * CPU supports is selected at runtime on first use.
+ */
+typedef enum {
+    KERNEL_ISA_SCALAR = 0,
+    KERNEL_ISA_AVX2,            // AVX2 + FMA
+    KERNEL_ISA_AVX512,          // AVX-512F
+    KERNEL_ISA_NEON
+} KernelIsa;
+
+/**
+ * Activation applied to each layer output. ReLU is zero so that layers
+ * stored before activations were configurable keep their behaviour.
+ */
+typedef enum {
+    ACTIVATION_RELU = 0,
+    ACTIVATION_NONE,
+    ACTIVATION_SIGMOID,
+    ACTIVATION_TANH,
+    ACTIVATION_LEAKY_RELU,      // slope 0.01 for negative inputs
+    ACTIVATION_SOFTMAX,
+    ACTIVATION_COUNT
+} Activation;
+
+/**
+ * Get the instruction set the kernels currently dispatch to
+ *
+ * @return The active instruction set
+ */
+KernelIsa get_kernel_isa(void);
+
+/**
+ * Check whether the CPU and build support an instruction set
+ *
+ * @param isa The instruction set
+ * @return 1 if supported, 0 otherwise
+ */
+int kernel_isa_supported(KernelIsa isa);
+
+/**
+ * Force the kernels onto a particular instruction set (mainly for testing).
+ * Must not be called while other threads are running kernels.
+ *
+ * @param isa The instruction set
+ * @return 0 on success, -1 if the instruction set is not supported
+ */
+int set_kernel_isa(KernelIsa isa);
+
+/**
+ * Get a printable name for an instruction set
+ *
+ * @param isa The instruction set
+ * @return The name of the instruction set
+ */
+const char* kernel_isa_name(KernelIsa isa);
+
+/**
+ * Matrix-vector product y = W x for a row-major rows x cols matrix
+ *
+ * @param weights The weight matrix
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param x The input vector (cols elements)
+ * @param y The output vector (rows elements, must not alias x)
+ */
+void gemv_f32(const float* weights, size_t rows, size_t cols, const float* x, float* y);
+
+/**
+ * Matrix-vector product with a fused epilogue, y = act(W x + bias). The
+ * bias add and element-wise activations are applied as each output is
+ * stored; softmax, which needs the whole vector, runs as a final pass.
+ *
+ * @param weights The weight matrix
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param x The input vector (cols elements)
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The output vector (rows elements, must not alias x)
+ */
+void gemv_f32_fused(const float* weights, size_t rows, size_t cols, const float* x,
+                    const float* bias, Activation activation, float* y);
+
+/**
+ * Matrix-matrix product Y = X W^T for a batch of input vectors. Weights are
+ * processed in panels that stay cache-resident while the whole batch is
+ * applied to them.
+ *
+ * @param weights The row-major rows x cols weight matrix
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param x The inputs, batch rows of cols elements
+ * @param batch The number of input vectors
+ * @param y The outputs, batch rows of rows elements (must not alias x)
+ */
+void gemm_f32(const float* weights, size_t rows, size_t cols,
+              const float* x, size_t batch, float* y);
+
+/**
+ * Batched matrix-matrix product with a fused epilogue, applying the bias
+ * and activation to every output row as in gemv_f32_fused()
+ *
+ * @param weights The row-major rows x cols weight matrix
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param x The inputs, batch rows of cols elements
+ * @param batch The number of input vectors
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The outputs, batch rows of rows elements (must not alias x)
+ */
+void gemm_f32_fused(const float* weights, size_t rows, size_t cols,
+                    const float* x, size_t batch, const float* bias,
+                    Activation activation, float* y);
+
+/**
+ * Quantize each row of a float matrix to int8 with its own scale and zero
+ * point, so that w ~= scale * (q - zero_point). Also records the sum of
+ * each row's quantized values, which the int8 kernel needs.
+ *
+ * @param weights The row-major rows x cols float matrix
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param q The quantized matrix (rows x cols)
+ * @param scales The per-row scales (rows values)
+ * @param zero_points The per-row zero points (rows values)
+ * @param row_sums The per-row sums of q (rows values)
+ */
+void quantize_rows_q8(const float* weights, size_t rows, size_t cols, int8_t* q,
+                      float* scales, int32_t* zero_points, int32_t* row_sums);
+
+/**
+ * Quantize an activation vector for gemv_q8_fused(). Values are scaled
+ * symmetrically to [-63, 63] and offset by 64 to fit an unsigned byte;
+ * the 7-bit range keeps pairwise u8 x s8 products within int16.
+ *
+ * @param x The input vector
+ * @param n The number of elements
+ * @param xu The quantized vector (n bytes)
+ * @param scale The activation scale
+ * @param sum The sum of the signed quantized values
+ */
+void quantize_activations_q7(const float* x, size_t n, uint8_t* xu, float* scale, int32_t* sum);
+
+/**
+ * Int8 matrix-vector product with a fused epilogue,
+ * y = act(dequantize(q) dequantize(xu) + bias). Uses AVX-512 VNNI or AVX2
+ * pmaddubsw when available.
+ *
+ * @param q The quantized row-major rows x cols matrix
+ * @param scales The per-row scales
+ * @param zero_points The per-row zero points
+ * @param row_sums The per-row sums of q
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param xu The input quantized with quantize_activations_q7()
+ * @param x_scale The input scale
+ * @param x_sum The input sum
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The output vector (rows elements)
+ */
+void gemv_q8_fused(const int8_t* q, const float* scales, const int32_t* zero_points,
+                   const int32_t* row_sums, size_t rows, size_t cols,
+                   const uint8_t* xu, float x_scale, int32_t x_sum,
+                   const float* bias, Activation activation, float* y);
+
+/**
+ * Batched int8 matrix-matrix product with a fused epilogue, applying the
+ * dequantization, bias and activation to every output row as in
+ * gemv_q8_fused(). Weights are processed in panels that stay cache-resident
+ * while the whole batch is applied to them.
+ *
+ * @param q The quantized row-major rows x cols matrix
+ * @param scales The per-row scales
+ * @param zero_points The per-row zero points
+ * @param row_sums The per-row sums of q
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param xu The inputs quantized with quantize_activations_q7(), batch rows
+ *           of cols bytes
+ * @param x_scales The input scales (batch values)
+ * @param x_sums The input sums (batch values)
+ * @param batch The number of input vectors
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The outputs, batch rows of rows elements
+ */
+void gemm_q8_fused(const int8_t* q, const float* scales, const int32_t* zero_points,
+                   const int32_t* row_sums, size_t rows, size_t cols,
+                   const uint8_t* xu, const float* x_scales, const int32_t* x_sums,
+                   size_t batch, const float* bias, Activation activation, float* y);
+
+/**
+ * Convert float32 values to IEEE half precision, rounding to nearest even
+ *
+ * @param in The float32 values
+ * @param out The half-precision values
+ * @param n The number of values
+ */
+void f32_to_f16(const float* in, uint16_t* out, size_t n);
+
+/**
+ * Convert IEEE half-precision values to float32
+ *
+ * @param in The half-precision values
+ * @param out The float32 values
+ * @param n The number of values
+ */
+void f16_to_f32(const uint16_t* in, float* out, size_t n);
+
+/**
+ * Convert float32 values to bfloat16, rounding to nearest even
+ *
+ * @param in The float32 values
+ * @param out The bfloat16 values
+ * @param n The number of values
+ */
+void f32_to_bf16(const float* in, uint16_t* out, size_t n);
+
+/**
+ * Convert bfloat16 values to float32
+ *
+ * @param in The bfloat16 values
+ * @param out The float32 values
+ * @param n The number of values
+ */
+void bf16_to_f32(const uint16_t* in, float* out, size_t n);
+
+/**
+ * Matrix-vector product with IEEE half-precision weights and a fused
+ * epilogue, as gemv_f32_fused(). Weights are widened to float32 in
+ * registers (F16C or AVX-512 where available).
+ *
+ * @param weights The row-major rows x cols half-precision matrix
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param x The input vector (cols elements)
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The output vector (rows elements)
+ */
+void gemv_f16_fused(const uint16_t* weights, size_t rows, size_t cols, const float* x,
+                    const float* bias, Activation activation, float* y);
+
+/**
+ * Matrix-vector product with bfloat16 weights and a fused epilogue, as
+ * gemv_f32_fused(). Weights are widened to float32 in registers.
+ *
+ * @param weights The row-major rows x cols bfloat16 matrix
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param x The input vector (cols elements)
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The output vector (rows elements)
+ */
+void gemv_bf16_fused(const uint16_t* weights, size_t rows, size_t cols, const float* x,
+                     const float* bias, Activation activation, float* y);
+
+/**
+ * Batched matrix-matrix product with IEEE half-precision weights and a fused
+ * epilogue, as gemm_f32_fused(). Each weight panel is widened to float32 once
+ * and reused for the whole batch.
+ *
+ * @param weights The row-major rows x cols half-precision matrix
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param x The inputs, batch rows of cols elements
+ * @param batch The number of input vectors
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The outputs, batch rows of rows elements (must not alias x)
+ */
+void gemm_f16_fused(const uint16_t* weights, size_t rows, size_t cols,
+                    const float* x, size_t batch, const float* bias,
+                    Activation activation, float* y);
+
+/**
+ * Batched matrix-matrix product with bfloat16 weights and a fused epilogue,
+ * as gemm_f16_fused()
+ *
+ * @param weights The row-major rows x cols bfloat16 matrix
+ * @param rows The number of rows
+ * @param cols The number of columns
+ * @param x The inputs, batch rows of cols elements
+ * @param batch The number of input vectors
+ * @param bias The bias vector (rows elements, may be NULL)
+ * @param activation The activation to apply
+ * @param y The outputs, batch rows of rows elements (must not alias x)
+ */
+void gemm_bf16_fused(const uint16_t* weights, size_t rows, size_t cols,
+                     const float* x, size_t batch, const float* bias,
+                     Activation activation, float* y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNELS_H */
@@ -3,25 +3,89 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "kernels.h"
+#include "secure_arena.h"
+#include "threadpool.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define MAX_LAYERS 10
+/**
+ * How a layer's weights are stored. The values match the MODEL_DTYPE_*
+ * codes of the model file format.
+ *
+ * F32 layers hold rows x cols floats followed by the optional bias. INT8
+ * layers hold per-row float scales, int32 zero points and int32 sums of
+ * the quantized row, then the optional float bias, then rows x cols int8
+ * weights, with w ~= scale * (q - zero_point). F16 and BF16 layers hold the
+ * optional float bias first, then rows x cols 16-bit IEEE half or bfloat16
+ * weights.
+ */
+typedef enum {
+    LAYER_DTYPE_F32 = 0,
+    LAYER_DTYPE_INT8 = 1,
+    LAYER_DTYPE_F16 = 2,
+    LAYER_DTYPE_BF16 = 3
+} LayerDType;
 
 typedef struct {
-    float* weights;
+    void* data;                 // layer plaintext, NULL for lazy layers
+    float* weights;             // float view of data for F32 layers, otherwise NULL
+    float* bias;                // rows values inside data, or NULL
     size_t rows;
     size_t cols;
     int is_secure_allocated;
+    int in_slab;                // data lies in the model's weight slab and is not owned
+    int has_bias;               // also set for lazily loaded layers, whose bias is not resident
+    Activation activation;
+    LayerDType dtype;
 } Layer;
 
+typedef struct LazyLayerStore LazyLayerStore;
+
+/**
+ * Scratch buffers for inference, sized once from a model's execution plan.
+ * A workspace may be reused for any number of calls but must not be shared
+ * between threads running concurrently.
+ */
+typedef struct InferenceWorkspace InferenceWorkspace;
+
+/**
+ * Buffer and shape plan compiled from a model's layer chain whenever its
+ * layers change. valid is set only when the model has layers and every
+ * layer's rows match the next layer's cols.
+ */
+typedef struct {
+    size_t input_size;          // cols of the first layer
+    size_t output_size;         // rows of the last layer
+    size_t max_hidden_width;    // widest activation between two layers
+    int valid;
+} ExecutionPlan;
+
+/**
+ * A model is a contiguous, growable table of layers. Loaded models keep all
+ * resident layer weights in one slab, each layer starting on a cache line
+ * boundary and in file order; layers added or converted later own their
+ * own buffers. The slab is carved from a locked SecureArena when one can be
+ * mapped, so decrypted weights stay out of swap and core dumps.
+ *
+ * Functions taking a const Model, including every inference entry point,
+ * may run concurrently on the same model from any number of threads, each
+ * with its own workspace. add_layer(), add_layer_ex(), convert_layer() and
+ * free_model() modify the model and must not overlap any other use of it.
+ */
 typedef struct Model {
-    Layer layers[MAX_LAYERS];
+    Layer* layers;
     size_t num_layers;
+    size_t layer_capacity;
+    void* slab;                 // weight slab of a loaded model, or NULL
+    size_t slab_bytes;
+    SecureArena* arena;         // backs slab, or NULL if it came from the heap
     uint8_t* public_key;
     size_t public_key_len;
+    LazyLayerStore* lazy;       // non-NULL for models loaded with load_model_lazy()
+    ExecutionPlan plan;
 } Model;
 
 /**
@@ -33,6 +97,19 @@ typedef struct Model {
  */
 void* secure_realloc(void* ptr, size_t size);
 
+/**
+ * Per-stage timings reported by load_model_parallel().
+ * A load is I/O bound when io_seconds approaches total_seconds, and
+ * crypto bound when decrypt_seconds / num_threads does.
+ */
+typedef struct {
+    double io_seconds;          // time the reader spent in file I/O
+    double decrypt_seconds;     // decryption time summed over all workers
+    double total_seconds;       // wall-clock time of the whole load
+    size_t bytes_read;
+    size_t num_threads;
+} LoadStats;
+
 /**
  * Create a new empty model
  *
@@ -41,7 +118,7 @@ void* secure_realloc(void* ptr, size_t size);
 Model* create_model(void);
 
 /**
- * Add a layer to the model
+ * Add a layer to the model, followed by a ReLU activation and no bias
  *
  * @param model The model to add the layer to
  * @param weights The weights of the layer
@@ -52,7 +129,21 @@ Model* create_model(void);
 int add_layer(Model* model, const float* weights, size_t rows, size_t cols);
 
 /**
- * Save a model to a file
+ * Add a layer with an optional bias and a chosen activation to the model
+ *
+ * @param model The model to add the layer to
+ * @param weights The weights of the layer
+ * @param bias The bias vector (rows values, may be NULL for no bias)
+ * @param rows The number of rows in the weight matrix
+ * @param cols The number of columns in the weight matrix
+ * @param activation The activation applied to the layer output
+ * @return 0 on success, -1 on failure
+ */
+int add_layer_ex(Model* model, const float* weights, const float* bias,
+                 size_t rows, size_t cols, Activation activation);
+
+/**
+ * Save a model to a file in the version 2 container format (see format.h)
  *
  * @param model The model to save
  * @param filename The name of the file to save the model to
@@ -62,8 +153,25 @@ int add_layer(Model* model, const float* weights, size_t rows, size_t cols);
  */
 int save_model(const Model* model, const char* filename, const uint8_t* public_key, size_t public_key_len);
 
+/**
+ * Save a model to a file, encrypting layers on a thread pool.
+ * Layers are written in order, so the file has the same layout as one
+ * produced by save_model() and is read back by load_model().
+ *
+ * @param model The model to save
+ * @param filename The name of the file to save the model to
+ * @param public_key The public key to encrypt the model
+ * @param public_key_len The length of the public key
+ * @param num_threads Number of encryption threads (0 selects the number of online CPUs)
+ * @return 0 on success, -1 on failure
+ */
+int save_model_parallel(const Model* model, const char* filename,
+                        const uint8_t* public_key, size_t public_key_len,
+                        size_t num_threads);
+
 /**
  * Load an encrypted model from a file
+ * Both version 1 and version 2 model files are accepted.
  *
  * @param filename The name of the file containing the encrypted model
  * @param secret_key The secret key to decrypt the model
@@ -72,6 +180,107 @@ int save_model(const Model* model, const char* filename, const uint8_t* public_k
  */
 Model* load_model(const char* filename, const uint8_t* secret_key, size_t secret_key_len);
 
+/**
+ * Load an encrypted model using a pipelined loader: the calling thread
+ * reads encrypted layers while a thread pool decrypts them concurrently.
+ *
+ * @param filename The name of the file containing the encrypted model
+ * @param secret_key The secret key to decrypt the model
+ * @param secret_key_len The length of the secret key
+ * @param num_threads Number of decryption threads (0 selects the number of online CPUs)
+ * @param stats Optional pointer to store per-stage timings (may be NULL)
+ * @return A pointer to the loaded Model, or NULL on failure
+ */
+Model* load_model_parallel(const char* filename, const uint8_t* secret_key, size_t secret_key_len,
+                           size_t num_threads, LoadStats* stats);
+
+/**
+ * Load an encrypted model by memory-mapping the file.
+ * Each layer is decrypted directly from the mapping into its final
+ * 64-byte aligned weight buffer, without an intermediate ciphertext copy.
+ *
+ * @param filename The name of the file containing the encrypted model
+ * @param secret_key The secret key to decrypt the model
+ * @param secret_key_len The length of the secret key
+ * @return A pointer to the loaded Model, or NULL on failure
+ */
+Model* load_model_mmap(const char* filename, const uint8_t* secret_key, size_t secret_key_len);
+
+/**
+ * Load a model lazily: only the layer index and public key are read up
+ * front, and each layer is decrypted on first use. Plaintext layers that
+ * are not in use are evicted, least recently used first, once the
+ * resident total exceeds memory_budget. Layers are decrypted into a
+ * locked secure arena of about memory_budget bytes (the whole model's size
+ * when there is no budget). The model keeps the model file open and holds
+ * a copy of the secret key until it is freed.
+ *
+ * Layers of a lazy model are reached through acquire_layer_weights();
+ * their Layer.weights pointer stays NULL.
+ *
+ * @param filename The name of the file containing the encrypted model
+ * @param secret_key The secret key to decrypt the model
+ * @param secret_key_len The length of the secret key
+ * @param memory_budget Soft limit on resident plaintext bytes (0 for no limit)
+ * @return A pointer to the loaded Model, or NULL on failure
+ */
+Model* load_model_lazy(const char* filename, const uint8_t* secret_key, size_t secret_key_len,
+                       size_t memory_budget);
+
+/**
+ * Get a layer's plaintext in its storage layout (see LayerDType),
+ * decrypting the layer first if the model is lazy. The layer stays
+ * resident until the matching release_layer_weights(). Safe to call
+ * concurrently from several threads.
+ *
+ * @param model The model
+ * @param index The layer index
+ * @return The layer plaintext, or NULL on failure
+ */
+const void* acquire_layer_data(const Model* model, size_t index);
+
+/**
+ * Get the weights of a float32 layer, decrypting the layer first if the
+ * model is lazy. The layer stays resident until the matching
+ * release_layer_weights(). When the layer has a bias, its rows values
+ * follow the weights. Safe to call concurrently from several threads.
+ *
+ * @param model The model
+ * @param index The layer index
+ * @return The layer weights, or NULL on failure or if the layer is not float32
+ */
+const float* acquire_layer_weights(const Model* model, size_t index);
+
+/**
+ * Release a layer acquired with acquire_layer_data() or acquire_layer_weights()
+ *
+ * @param model The model
+ * @param index The layer index
+ */
+void release_layer_weights(const Model* model, size_t index);
+
+/**
+ * Convert a layer to another storage type in place. Converting a float32
+ * layer to INT8 quantizes each row with its own scale and zero point;
+ * converting to F16 or BF16 rounds each weight to nearest even. Any stored
+ * type can be converted to any other by way of float32. Not available for
+ * lazily loaded models.
+ *
+ * @param model The model
+ * @param index The layer index
+ * @param dtype The new storage type
+ * @return 0 on success, -1 on failure
+ */
+int convert_layer(Model* model, size_t index, LayerDType dtype);
+
+/**
+ * Get the number of plaintext weight bytes currently resident
+ *
+ * @param model The model
+ * @return The resident weight bytes
+ */
+size_t get_model_resident_bytes(const Model* model);
+
 /**
  * Perform inference using the model
  *
@@ -85,6 +294,88 @@ Model* load_model(const char* filename, const uint8_t* secret_key, size_t secret
 int inference(const Model* model, const float* input, size_t input_size,
               float* output, size_t output_size);
 
+/**
+ * Create a reusable inference workspace for a model
+ *
+ * @param model The model the workspace will be used with
+ * @return A pointer to the new workspace, or NULL on failure
+ */
+InferenceWorkspace* create_inference_workspace(const Model* model);
+
+/**
+ * Free an inference workspace, zeroing its buffers
+ *
+ * @param ws The workspace to free (may be NULL)
+ */
+void free_inference_workspace(InferenceWorkspace* ws);
+
+/**
+ * Perform inference using a preallocated workspace. Performs no heap
+ * allocation, and is reentrant as long as each thread uses its own
+ * workspace.
+ *
+ * @param model The model to use for inference
+ * @param ws A workspace created for this model
+ * @param input The input data
+ * @param input_size The size of the input data
+ * @param output The output data (must be pre-allocated and not overlap input)
+ * @param output_size The size of the output data
+ * @return 0 on success, -1 on failure
+ */
+int inference_ws(const Model* model, InferenceWorkspace* ws, const float* input,
+                 size_t input_size, float* output, size_t output_size);
+
+/**
+ * Perform inference on a batch of inputs. Each layer runs as one
+ * matrix-matrix product so its weights are streamed once per batch
+ * rather than once per input.
+ *
+ * @param model The model to use for inference
+ * @param inputs The input vectors, batch_size rows of input_size floats
+ * @param batch_size The number of input vectors
+ * @param input_size The size of each input vector
+ * @param outputs The output vectors, batch_size rows of output_size floats (must be pre-allocated)
+ * @param output_size The size of each output vector
+ * @return 0 on success, -1 on failure
+ */
+int inference_batch(const Model* model, const float* inputs, size_t batch_size,
+                    size_t input_size, float* outputs, size_t output_size);
+
+/**
+ * Perform inference with the rows of each layer split across a thread
+ * pool. The pool is reused across calls, so no threads are created here;
+ * the calling thread works alongside the pool and each layer finishes
+ * before the next starts. Small layers run on the calling thread alone.
+ *
+ * @param model The model to use for inference
+ * @param pool The worker pool (may be NULL to run single-threaded)
+ * @param input The input data
+ * @param input_size The size of the input data
+ * @param output The output data (must be pre-allocated)
+ * @param output_size The size of the output data
+ * @return 0 on success, -1 on failure
+ */
+int inference_parallel(const Model* model, ThreadPool* pool, const float* input,
+                       size_t input_size, float* output, size_t output_size);
+
+/**
+ * Perform inference as inference_parallel(), using a preallocated
+ * workspace. Performs no heap allocation; each concurrent caller needs its
+ * own workspace.
+ *
+ * @param model The model to use for inference
+ * @param pool The worker pool (may be NULL to run single-threaded)
+ * @param ws A workspace created for this model
+ * @param input The input data
+ * @param input_size The size of the input data
+ * @param output The output data (must be pre-allocated and not overlap input)
+ * @param output_size The size of the output data
+ * @return 0 on success, -1 on failure
+ */
+int inference_parallel_ws(const Model* model, ThreadPool* pool, InferenceWorkspace* ws,
+                          const float* input, size_t input_size,
+                          float* output, size_t output_size);
+
 /**
  * Free the memory used by a model
  *
@@ -104,6 +395,7 @@ int get_model_public_key(const Model* model, const uint8_t** public_key, size_t*
 
 /**
  * Get the last error message from the model module
+ * on the calling thread (see error.h)
  *
  * @return The last error message
  */
@@ -0,0 +1,168 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Staged request pipeline.
+ *
+ * A request is an input vector encrypted with encrypt_floats() for the
+ * model's public key. It passes through three stages, each served by its
+ * own pool of worker threads:
+ *
+ *   decrypt  decrypt_floats_into() straight into the request's input buffer
+ *   infer    inference_ws() with a workspace owned by the worker
+ *   encrypt  encrypt_floats() of the output for the response public key
+ *
+ * Stages are connected by bounded lock-free queues, so while one request
+ * is being decrypted the one before it can be in inference and the one
+ * before that in encryption. Requests may complete out of order when a
+ * stage has more than one worker; each result carries the sequence number
+ * and user data of its request.
+ *
+ * At most max_in_flight requests are submitted and not yet received at
+ * once; pipeline_submit() blocks until one is received. A thread that both
+ * submits and receives must therefore not have more than max_in_flight
+ * requests outstanding.
+ *
+ * pipeline_submit(), pipeline_receive() and get_pipeline_stats() may be
+ * called from any number of threads at once.
+ */
+
+typedef enum {
+    PIPELINE_STAGE_DECRYPT = 0,
+    PIPELINE_STAGE_INFER,
+    PIPELINE_STAGE_ENCRYPT,
+    PIPELINE_STAGE_COUNT
+} PipelineStage;
+
+typedef struct {
+    size_t decrypt_threads;     // workers in the decrypt stage (default 2)
+    size_t infer_threads;       // workers in the infer stage (default 1)
+    size_t encrypt_threads;     // workers in the encrypt stage (default 2)
+    size_t max_in_flight;       // requests submitted and not yet received (default 64)
+} PipelineConfig;
+
+typedef struct {
+    size_t queue_depth;         // requests waiting for the stage now
+    size_t peak_queue_depth;
+    size_t processed;           // requests the stage handled successfully
+    size_t failed;              // requests the stage failed
+    uint64_t total_wait_ns;     // time requests spent queued for the stage
+    uint64_t total_service_ns;  // time the stage spent on requests
+    uint64_t max_wait_ns;
+    uint64_t max_service_ns;
+} PipelineStageStats;
+
+typedef struct {
+    PipelineStageStats stages[PIPELINE_STAGE_COUNT];
+    size_t submitted;
+    size_t received;
+    size_t completed_depth;     // results waiting for pipeline_receive()
+} PipelineStats;
+
+typedef struct {
+    uint64_t sequence;          // as returned by pipeline_submit()
+    void* user_data;            // as passed to pipeline_submit()
+    int status;                 // QRME_OK, or the QrmeErrorCode of the failure
+    uint8_t* response;          // the encrypted output; free with secure_free()
+    size_t response_len;
+} PipelineResult;
+
+typedef struct QrmePipeline QrmePipeline;
+
+/**
+ * Fill a pipeline configuration with the defaults
+ *
+ * @param config The configuration
+ */
+void pipeline_default_config(PipelineConfig* config);
+
+/**
+ * Create a pipeline and start its workers
+ *
+ * @param config The configuration
+ * @param model The model to run; it must outlive the pipeline and must not
+ *              be modified while the pipeline exists
+ * @param secret_key The secret key matching the model's public key
+ * @param secret_key_len The length of the secret key
+ * @param response_public_key The public key responses are encrypted for
+ * @param response_public_key_len The length of the response public key
+ * @return A pointer to the pipeline, or NULL on failure
+ */
+QrmePipeline* create_pipeline(const PipelineConfig* config, const Model* model,
+                              const uint8_t* secret_key, size_t secret_key_len,
+                              const uint8_t* response_public_key, size_t response_public_key_len);
+
+/**
+ * Submit an encrypted request, blocking while max_in_flight requests are
+ * outstanding. The request is borrowed, not copied, and must stay valid
+ * until its result has been received.
+ *
+ * @param pipeline The pipeline
+ * @param request The encrypted input vector
+ * @param request_len The length of the request
+ * @param user_data Returned with the result
+ * @param sequence Receives the request's sequence number (may be NULL)
+ * @return 0 on success, -1 on failure
+ */
+int pipeline_submit(QrmePipeline* pipeline, const uint8_t* request, size_t request_len,
+                    void* user_data, uint64_t* sequence);
+
+/**
+ * Wait for the next completed request. A request that failed in any stage
+ * still produces a result; its status is the error code, and the error is
+ * also recorded on the calling thread (see error.h).
+ *
+ * @param pipeline The pipeline
+ * @param result Receives the result
+ * @return 0 when a result was received, 1 once the pipeline has been
+ *         closed and every result received, -1 on failure
+ */
+int pipeline_receive(QrmePipeline* pipeline, PipelineResult* result);
+
+/**
+ * Stop accepting requests. Requests already submitted still complete, and
+ * pipeline_receive() returns 1 once they have all been received. Must not
+ * race with pipeline_submit().
+ *
+ * @param pipeline The pipeline
+ */
+void pipeline_close(QrmePipeline* pipeline);
+
+/**
+ * Get a snapshot of a pipeline's counters
+ *
+ * @param pipeline The pipeline
+ * @param stats Receives the counters
+ */
+void get_pipeline_stats(const QrmePipeline* pipeline, PipelineStats* stats);
+
+/**
+ * Stop the workers, discard any results not yet received and free a
+ * pipeline. Requests still queued are abandoned rather than processed.
+ * No other call on the pipeline may be in progress.
+ *
+ * @param pipeline The pipeline (may be NULL)
+ */
+void free_pipeline(QrmePipeline* pipeline);
+
+/**
+ * Get the last error message from the pipeline module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_pipeline_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPELINE_H */
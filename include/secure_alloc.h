@@ -0,0 +1,100 @@
+#ifndef SECURE_ALLOC_H
+#define SECURE_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocator for key material, plaintext weights and other sensitive
+ * buffers.
+ *
+ * Every block is SECURE_ALLOC_ALIGNMENT-byte aligned, zero-filled when
+ * handed out and wiped when freed. Blocks of up to SECURE_ALLOC_MAX_POOLED
+ * bytes come from power-of-two size classes: freed blocks are kept, already
+ * wiped, in a small per-thread cache (no locking) and then in a shared pool,
+ * so the keys, IVs and scratch vectors allocated on every call do not go
+ * back to malloc. Larger blocks are allocated and released directly.
+ *
+ * All functions are thread-safe. A block may be freed by a different
+ * thread from the one that allocated it.
+ */
+
+#define SECURE_ALLOC_ALIGNMENT 64
+#define SECURE_ALLOC_MAX_POOLED 4096
+
+typedef struct {
+    size_t bytes_in_use;        // bytes requested by live blocks
+    size_t peak_bytes_in_use;
+    size_t allocations;         // successful allocations, reallocations excluded
+    size_t frees;
+    size_t pool_hits;           // small allocations served from a cache or the pool
+    size_t pool_misses;         // small allocations that needed a new block
+    size_t large_allocations;   // allocations above SECURE_ALLOC_MAX_POOLED
+} SecureAllocStats;
+
+/**
+ * Allocate a zero-filled, aligned secure block
+ *
+ * @param size The number of bytes (0 gives a valid empty block)
+ * @return A pointer to the block, or NULL on failure
+ */
+void* secure_alloc(size_t size);
+
+/**
+ * Securely reallocate memory. Bytes added by growing the block are zero;
+ * bytes cut off by shrinking it are wiped.
+ *
+ * @param ptr Pointer to the memory block to be reallocated (may be NULL)
+ * @param size The new size of the memory block
+ * @return A pointer to the reallocated memory, or NULL on failure
+ */
+void* secure_realloc(void* ptr, size_t size);
+
+/**
+ * Securely free memory and set pointer to NULL. The block is wiped before
+ * it is pooled or released. Misaligned pointers and second frees of pooled
+ * blocks are detected from the block header, left alone and reported
+ * through get_secure_alloc_error().
+ *
+ * @param ptr Pointer to the memory to free
+ */
+void secure_free(void** ptr);
+
+/**
+ * Wipe memory in a way the compiler cannot optimise away
+ *
+ * @param ptr Pointer to the memory to wipe
+ * @param size Number of bytes to wipe
+ */
+void secure_zero(void* ptr, size_t size);
+
+/**
+ * Get a snapshot of the allocator statistics
+ *
+ * @param stats Receives the statistics
+ */
+void get_secure_alloc_stats(SecureAllocStats* stats);
+
+/**
+ * Release the calling thread's cached blocks and the shared pool to the
+ * system. Other threads' caches are released when those threads exit.
+ */
+void secure_alloc_trim(void);
+
+/**
+ * Get the last error message from the secure allocator
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_secure_alloc_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SECURE_ALLOC_H */
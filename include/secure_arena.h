@@ -0,0 +1,118 @@
+#ifndef SECURE_ARENA_H
+#define SECURE_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A fixed-size region for secrets that must stay out of swap and core
+ * dumps: key material and decrypted layer weights.
+ *
+ * The whole region is mapped, locked and excluded from core dumps once, at
+ * creation, between two inaccessible guard pages. Allocations are then
+ * carved off the front with an atomic bump pointer, without system calls
+ * or locking, and are only released all at once. If the region cannot be
+ * locked (for example because RLIMIT_MEMLOCK is too low) the arena still
+ * works, unlocked; secure_arena_is_locked() reports which.
+ */
+typedef struct SecureArena SecureArena;
+
+#define SECURE_KEY_MAX_BLOCK 4096
+
+/**
+ * Create a secure arena
+ *
+ * @param capacity The number of usable bytes (rounded up to whole pages)
+ * @return A pointer to the arena, or NULL on failure
+ */
+SecureArena* create_secure_arena(size_t capacity);
+
+/**
+ * Allocate zero-filled memory from a secure arena. Safe to call from
+ * several threads at once.
+ *
+ * @param arena The arena
+ * @param size The number of bytes
+ * @return A 64-byte aligned pointer, or NULL if the arena is exhausted
+ */
+void* secure_arena_alloc(SecureArena* arena, size_t size);
+
+/**
+ * Wipe everything allocated from an arena and make its space available
+ * again. No allocation may be in use, and no other thread may be using
+ * the arena.
+ *
+ * @param arena The arena
+ */
+void secure_arena_reset(SecureArena* arena);
+
+/**
+ * Wipe, unlock and unmap a secure arena
+ *
+ * @param arena The arena (may be NULL)
+ */
+void free_secure_arena(SecureArena* arena);
+
+/**
+ * Check whether an arena's memory is locked in RAM
+ *
+ * @param arena The arena
+ * @return 1 if locked, 0 otherwise
+ */
+int secure_arena_is_locked(const SecureArena* arena);
+
+/**
+ * Get the number of bytes allocated from an arena, including alignment
+ *
+ * @param arena The arena
+ * @return The number of bytes in use
+ */
+size_t secure_arena_used(const SecureArena* arena);
+
+/**
+ * Get the usable size of an arena
+ *
+ * @param arena The arena
+ * @return The capacity in bytes
+ */
+size_t secure_arena_capacity(const SecureArena* arena);
+
+/**
+ * Allocate key material from the shared key arena. Secret keys, KEM
+ * buffers and other small secrets held by crypto contexts, lazily loaded
+ * models, servers and pipelines are all carved from the same locked
+ * chunks, rather than each owner mapping an arena of its own. Blocks come
+ * in power-of-two size classes of up to SECURE_KEY_MAX_BLOCK bytes; freed
+ * blocks are wiped and reused. Larger requests, or any made when no chunk
+ * can be mapped, fall back to secure_alloc(). Thread-safe.
+ *
+ * @param size The number of bytes
+ * @return A zero-filled, 64-byte aligned pointer, or NULL on failure
+ */
+void* secure_key_alloc(size_t size);
+
+/**
+ * Wipe a block from secure_key_alloc(), return it for reuse and set the
+ * pointer to NULL
+ *
+ * @param ptr Pointer to the block (may point to NULL)
+ * @param size The size the block was allocated with
+ */
+void secure_key_free(void** ptr, size_t size);
+
+/**
+ * Get the last error message from the secure arena module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_secure_arena_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SECURE_ARENA_H */
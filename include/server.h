@@ -0,0 +1,196 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Inference server over a Unix domain socket.
+ *
+ * The server holds one loaded model and serves any number of clients from
+ * a single epoll event loop. Requests that arrive close together are
+ * grouped into micro-batches and run through inference_batch(), so the
+ * model's weights are streamed once per batch rather than once per input.
+ * A batch runs as soon as it holds max_batch_size requests, or once its
+ * oldest request has waited max_wait_us microseconds.
+ *
+ * Every connection is an encrypted session (see session.h). Frames are a
+ * 4-byte little-endian payload length, a 1-byte type and the payload:
+ *
+ *   SERVER_FRAME_HELLO     client -> server: the session KEM ciphertext
+ *   SERVER_FRAME_READY     server -> client: input and output sizes, as
+ *                          4-byte little-endian integers
+ *   SERVER_FRAME_REQUEST   client -> server: session_encrypt() of one input
+ *                          vector of floats
+ *   SERVER_FRAME_RESPONSE  server -> client: session_encrypt() of the output
+ *   SERVER_FRAME_ERROR     server -> client: a 4-byte QrmeErrorCode and a
+ *                          message, in clear; sent instead of a response
+ *
+ * Responses on a connection come back in request order. Floats are
+ * encoded little-endian, as for every encrypted float vector (see utils.h).
+ *
+ * The server is Linux only; elsewhere create_server() fails with
+ * QRME_ERR_UNSUPPORTED. The client functions are portable.
+ */
+
+#define SERVER_FRAME_HELLO 1
+#define SERVER_FRAME_READY 2
+#define SERVER_FRAME_REQUEST 3
+#define SERVER_FRAME_RESPONSE 4
+#define SERVER_FRAME_ERROR 5
+
+#define SERVER_FRAME_HEADER_SIZE 5
+
+typedef struct {
+    const char* socket_path;
+    size_t max_batch_size;      // requests per batch (default 32)
+    unsigned max_wait_us;       // longest a request waits for a batch to fill (default 1000)
+    size_t max_connections;     // further clients are refused (default 256)
+    size_t max_frame_bytes;     // larger frames close the connection (default 16 MiB)
+} ServerConfig;
+
+typedef struct {
+    size_t connections;         // currently open
+    size_t requests;            // answered with a response
+    size_t errors;              // answered with an error frame
+    size_t batches;
+    size_t largest_batch;
+} ServerStats;
+
+typedef struct QrmeServer QrmeServer;
+
+typedef struct QrmeClient QrmeClient;
+
+/**
+ * Fill a server configuration with the defaults
+ *
+ * @param config The configuration
+ * @param socket_path The path to listen on
+ */
+void server_default_config(ServerConfig* config, const char* socket_path);
+
+/**
+ * Create a server and start listening. Any stale socket file at the path
+ * is replaced.
+ *
+ * @param config The configuration
+ * @param model The model to serve; it must outlive the server and must not
+ *              be modified while the server runs
+ * @param secret_key The secret key matching the model's public key
+ * @param secret_key_len The length of the secret key
+ * @return A pointer to the server, or NULL on failure
+ */
+QrmeServer* create_server(const ServerConfig* config, const Model* model,
+                          const uint8_t* secret_key, size_t secret_key_len);
+
+/**
+ * Serve clients on the calling thread until server_stop() is called
+ *
+ * @param server The server
+ * @return 0 on a clean stop, -1 on failure
+ */
+int server_run(QrmeServer* server);
+
+/**
+ * Ask a running server to stop. Safe to call from any thread and from a
+ * signal handler.
+ *
+ * @param server The server
+ */
+void server_stop(QrmeServer* server);
+
+/**
+ * Get a snapshot of a server's counters. Safe to call from any thread
+ * while the server runs.
+ *
+ * @param server The server
+ * @param stats Receives the counters
+ */
+void get_server_stats(const QrmeServer* server, ServerStats* stats);
+
+/**
+ * Close every connection, remove the socket file and free a server. The
+ * server must not be running.
+ *
+ * @param server The server (may be NULL)
+ */
+void free_server(QrmeServer* server);
+
+/**
+ * Connect to a server and set up an encrypted session
+ *
+ * @param socket_path The server's socket path
+ * @param public_key The model's public key
+ * @param public_key_len The length of the public key
+ * @return A pointer to the client, or NULL on failure
+ */
+QrmeClient* client_connect(const char* socket_path, const uint8_t* public_key, size_t public_key_len);
+
+/**
+ * Get the input and output sizes of the model a client is connected to
+ *
+ * @param client The client
+ * @param input_size Receives the input size
+ * @param output_size Receives the output size
+ */
+void client_model_sizes(const QrmeClient* client, size_t* input_size, size_t* output_size);
+
+/**
+ * Send an inference request without waiting for the response, so that
+ * several requests can be in flight on one connection
+ *
+ * @param client The client
+ * @param input The input vector
+ * @param input_size The size of the input vector
+ * @return 0 on success, -1 on failure
+ */
+int client_submit(QrmeClient* client, const float* input, size_t input_size);
+
+/**
+ * Wait for the response to the oldest outstanding request
+ *
+ * @param client The client
+ * @param output The output vector (must be pre-allocated)
+ * @param output_size The size of the output vector
+ * @return 0 on success, -1 on failure (including an error frame from the server)
+ */
+int client_receive(QrmeClient* client, float* output, size_t output_size);
+
+/**
+ * Run one inference request and wait for its response
+ *
+ * @param client The client
+ * @param input The input vector
+ * @param input_size The size of the input vector
+ * @param output The output vector (must be pre-allocated)
+ * @param output_size The size of the output vector
+ * @return 0 on success, -1 on failure
+ */
+int client_infer(QrmeClient* client, const float* input, size_t input_size,
+                 float* output, size_t output_size);
+
+/**
+ * Close a client connection and wipe its session
+ *
+ * @param client The client (may be NULL)
+ */
+void client_close(QrmeClient* client);
+
+/**
+ * Get the last error message from the server module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_server_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVER_H */
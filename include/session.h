@@ -0,0 +1,102 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A symmetric session between a client and a model server.
+ * The client performs a single Kyber-768 encapsulation against the
+ * server's public key; both ends derive directional AES-256-GCM keys
+ * with HKDF-SHA256, and every subsequent message costs only one AEAD
+ * operation. Each message carries a 64-bit sequence number that forms
+ * the GCM nonce and must strictly increase, so replays are rejected.
+ * A session must not be used from several threads at once.
+ */
+typedef struct QrmeSession QrmeSession;
+
+/**
+ * Size in bytes added to each message by session_encrypt()
+ */
+#define SESSION_MESSAGE_OVERHEAD (8 + 16)
+
+/**
+ * Start a session as the client
+ *
+ * @param public_key The server's public key
+ * @param public_key_len Length of the public key
+ * @param session Pointer to store the new session
+ * @param kem_ciphertext Pointer to store the KEM ciphertext to send to the server
+ * @param kem_ciphertext_len Pointer to store the length of the KEM ciphertext
+ * @return 0 on success, -1 on failure
+ */
+int session_initiate(const uint8_t* public_key, size_t public_key_len,
+                     QrmeSession** session,
+                     uint8_t** kem_ciphertext, size_t* kem_ciphertext_len);
+
+/**
+ * Accept a session as the server
+ *
+ * @param secret_key The server's secret key
+ * @param secret_key_len Length of the secret key
+ * @param kem_ciphertext The KEM ciphertext received from the client
+ * @param kem_ciphertext_len Length of the KEM ciphertext
+ * @param session Pointer to store the new session
+ * @return 0 on success, -1 on failure
+ */
+int session_accept(const uint8_t* secret_key, size_t secret_key_len,
+                   const uint8_t* kem_ciphertext, size_t kem_ciphertext_len,
+                   QrmeSession** session);
+
+/**
+ * Encrypt a message for the peer
+ *
+ * @param session The session
+ * @param plaintext The data to encrypt
+ * @param plaintext_len Length of the plaintext
+ * @param ciphertext Pointer to store the encrypted message
+ * @param ciphertext_len Pointer to store the length of the encrypted message
+ * @return 0 on success, -1 on failure
+ */
+int session_encrypt(QrmeSession* session,
+                    const uint8_t* plaintext, size_t plaintext_len,
+                    uint8_t** ciphertext, size_t* ciphertext_len);
+
+/**
+ * Decrypt a message from the peer
+ *
+ * @param session The session
+ * @param ciphertext The encrypted message
+ * @param ciphertext_len Length of the encrypted message
+ * @param plaintext Pointer to store the decrypted data
+ * @param plaintext_len Pointer to store the length of the plaintext
+ * @return 0 on success, -1 on failure (including replayed messages)
+ */
+int session_decrypt(QrmeSession* session,
+                    const uint8_t* ciphertext, size_t ciphertext_len,
+                    uint8_t** plaintext, size_t* plaintext_len);
+
+/**
+ * Free a session and wipe its keys
+ *
+ * @param session The session to free (may be NULL)
+ */
+void free_session(QrmeSession* session);
+
+/**
+ * Get the last error message from the session module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_session_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SESSION_H */
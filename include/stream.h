@@ -0,0 +1,149 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Chunked, streaming AEAD for payloads too large to hold in memory.
+ *
+ * A stream starts with a header (magic, chunk size and a Kyber-768 KEM
+ * ciphertext) followed by a sequence of records. Each record is one
+ * AES-256-GCM encrypted chunk followed by its own tag. The chunk index and
+ * a final-chunk flag are bound into each record's AAD, so chunks cannot
+ * be reordered, dropped or truncated without detection. Every chunk except
+ * the last holds exactly chunk_size bytes; the last is shorter (and may be
+ * empty), which is how a reader recognises it.
+ *
+ * A stream object must not be used from several threads at once.
+ */
+typedef struct QrmeStream QrmeStream;
+
+#define STREAM_DEFAULT_CHUNK_SIZE ((size_t)1 << 20)
+// The chunk size in a header is read before anything is authenticated, so
+// readers refuse to size their buffers beyond this
+#define STREAM_MAX_CHUNK_SIZE ((size_t)64 << 20)
+#define STREAM_TAG_SIZE 16
+
+/**
+ * Get the size of a stream header
+ *
+ * @return The header size in bytes
+ */
+size_t stream_header_size(void);
+
+/**
+ * Start encrypting a stream
+ *
+ * @param public_key The public key
+ * @param public_key_len Length of the public key
+ * @param chunk_size Plaintext bytes per chunk (0 selects STREAM_DEFAULT_CHUNK_SIZE,
+ *                   at most STREAM_MAX_CHUNK_SIZE)
+ * @param stream Pointer to store the new stream
+ * @param header Buffer of stream_header_size() bytes to store the stream header
+ * @return 0 on success, -1 on failure
+ */
+int stream_encrypt_init(const uint8_t* public_key, size_t public_key_len,
+                        size_t chunk_size, QrmeStream** stream, uint8_t* header);
+
+/**
+ * Encrypt the next chunk of a stream
+ *
+ * @param stream The stream
+ * @param chunk The plaintext chunk (exactly chunk_size bytes unless final)
+ * @param chunk_len Length of the chunk
+ * @param is_final Non-zero if this is the last chunk (must be shorter than chunk_size)
+ * @param record Buffer of at least chunk_len + STREAM_TAG_SIZE bytes to store the record
+ * @param record_len Pointer to store the length of the record
+ * @return 0 on success, -1 on failure
+ */
+int stream_encrypt_chunk(QrmeStream* stream, const uint8_t* chunk, size_t chunk_len,
+                         int is_final, uint8_t* record, size_t* record_len);
+
+/**
+ * Start decrypting a stream
+ *
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param header The stream header (stream_header_size() bytes)
+ * @param stream Pointer to store the new stream
+ * @return 0 on success, -1 on failure
+ */
+int stream_decrypt_init(const uint8_t* secret_key, size_t secret_key_len,
+                        const uint8_t* header, QrmeStream** stream);
+
+/**
+ * Decrypt and authenticate the next record of a stream
+ *
+ * @param stream The stream
+ * @param record The record (at most chunk_size + STREAM_TAG_SIZE bytes)
+ * @param record_len Length of the record
+ * @param chunk Buffer of at least record_len - STREAM_TAG_SIZE bytes to store the plaintext
+ * @param chunk_len Pointer to store the length of the plaintext
+ * @param is_final Pointer to store whether this was the last chunk
+ * @return 0 on success, -1 on failure
+ */
+int stream_decrypt_chunk(QrmeStream* stream, const uint8_t* record, size_t record_len,
+                         uint8_t* chunk, size_t* chunk_len, int* is_final);
+
+/**
+ * Get the chunk size of a stream
+ *
+ * @param stream The stream
+ * @return The number of plaintext bytes per full chunk
+ */
+size_t stream_chunk_size(const QrmeStream* stream);
+
+/**
+ * Free a stream and wipe its key
+ *
+ * @param stream The stream to free (may be NULL)
+ */
+void free_stream(QrmeStream* stream);
+
+/**
+ * Encrypt everything from one file into another using constant memory
+ *
+ * @param public_key The public key
+ * @param public_key_len Length of the public key
+ * @param in The plaintext input
+ * @param out The encrypted output
+ * @param chunk_size Plaintext bytes per chunk (0 selects STREAM_DEFAULT_CHUNK_SIZE,
+ *                   at most STREAM_MAX_CHUNK_SIZE)
+ * @return 0 on success, -1 on failure
+ */
+int encrypt_stream_file(const uint8_t* public_key, size_t public_key_len,
+                        FILE* in, FILE* out, size_t chunk_size);
+
+/**
+ * Decrypt a stream from one file into another using constant memory.
+ * Plaintext is written as each chunk authenticates; on failure the output
+ * may hold a prefix of the data and must be discarded.
+ *
+ * @param secret_key The secret key
+ * @param secret_key_len Length of the secret key
+ * @param in The encrypted input
+ * @param out The plaintext output
+ * @return 0 on success, -1 on failure
+ */
+int decrypt_stream_file(const uint8_t* secret_key, size_t secret_key_len,
+                        FILE* in, FILE* out);
+
+/**
+ * Get the last error message from the stream module
+ * on the calling thread (see error.h)
+ *
+ * @return The last error message
+ */
+const char* get_stream_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_H */
@@ -0,0 +1,101 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A fixed-size pool of worker threads consuming a FIFO task queue.
+ * All functions may be called from any thread, except free_thread_pool(),
+ * which must not race with other calls on the same pool.
+ */
+typedef struct ThreadPool ThreadPool;
+
+typedef void (*ThreadPoolTask)(void* arg);
+
+typedef void (*ThreadPoolRangeTask)(void* arg, size_t begin, size_t end);
+
+/**
+ * Create a thread pool
+ *
+ * @param num_threads Number of worker threads (0 selects the number of online CPUs)
+ * @return A pointer to the new pool, or NULL on failure
+ */
+ThreadPool* create_thread_pool(size_t num_threads);
+
+/**
+ * Create a thread pool with workers pinned to specific CPUs. Worker i is
+ * pinned to cpus[i % num_cpus]. Pinning is best effort and silently
+ * skipped on platforms without thread affinity.
+ *
+ * @param num_threads Number of worker threads (0 selects the number of online CPUs)
+ * @param cpus The CPU indices to pin workers to (may be NULL for no pinning)
+ * @param num_cpus The number of entries in cpus
+ * @return A pointer to the new pool, or NULL on failure
+ */
+ThreadPool* create_thread_pool_ex(size_t num_threads, const int* cpus, size_t num_cpus);
+
+/**
+ * Queue a task for execution on the pool
+ *
+ * @param pool The pool
+ * @param task The function to run
+ * @param arg The argument passed to the function
+ * @return 0 on success, -1 on failure
+ */
+int thread_pool_submit(ThreadPool* pool, ThreadPoolTask task, void* arg);
+
+/**
+ * Wait until every queued task has finished
+ *
+ * @param pool The pool
+ */
+void thread_pool_wait(ThreadPool* pool);
+
+/**
+ * Split the range [0, n) into contiguous chunks of at least grain items,
+ * one per worker plus one for the caller, and run them in parallel. The
+ * caller takes part in the work and the call returns only once every chunk
+ * has finished, so consecutive calls are separated by a barrier. Must not
+ * be called from a task running on the same pool.
+ *
+ * @param pool The pool (may be NULL to run the whole range on the caller)
+ * @param n The number of items
+ * @param grain The minimum number of items per chunk (0 is treated as 1)
+ * @param task The function to run on each chunk
+ * @param arg The argument passed to the function
+ */
+void thread_pool_parallel_for(ThreadPool* pool, size_t n, size_t grain,
+                              ThreadPoolRangeTask task, void* arg);
+
+/**
+ * Get the number of worker threads in a pool
+ *
+ * @param pool The pool
+ * @return The number of worker threads
+ */
+size_t thread_pool_size(const ThreadPool* pool);
+
+/**
+ * Finish all queued tasks, stop the workers and free the pool
+ *
+ * @param pool The pool to free (may be NULL)
+ */
+void free_thread_pool(ThreadPool* pool);
+
+/**
+ * Resolve a requested thread count, mapping 0 to the number of online CPUs
+ *
+ * @param num_threads The requested thread count
+ * @return The thread count to use (at least 1)
+ */
+size_t resolve_thread_count(size_t num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREADPOOL_H */
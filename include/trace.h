@@ -0,0 +1,151 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Diagnostic tracing.
+ *
+ * Trace points name a level and a category. QRME_TRACE_LEVEL sets, at
+ * compile time, the most verbose level that is compiled in at all; trace
+ * points above it, and their arguments, vanish from the build. The rest
+ * are filtered at run time by trace_set_level() and trace_set_categories()
+ * with two relaxed loads, and only formatted when they pass.
+ *
+ * Records go to stderr or to a fixed in-memory ring that writers fill
+ * without locking, so diagnostics can stay on in production and be read
+ * back with trace_ring_read() when needed.
+ */
+
+typedef enum {
+    TRACE_LEVEL_OFF = 0,
+    TRACE_LEVEL_ERROR = 1,
+    TRACE_LEVEL_WARN = 2,
+    TRACE_LEVEL_INFO = 3,
+    TRACE_LEVEL_DEBUG = 4
+} TraceLevel;
+
+typedef enum {
+    TRACE_CAT_CRYPTO = 1 << 0,
+    TRACE_CAT_MODEL = 1 << 1,
+    TRACE_CAT_ALLOC = 1 << 2,
+    TRACE_CAT_KERNEL = 1 << 3,
+    TRACE_CAT_POOL = 1 << 4,
+    TRACE_CAT_FORMAT = 1 << 5,
+    TRACE_CAT_SERVER = 1 << 6,
+    TRACE_CAT_PIPELINE = 1 << 7,
+    TRACE_CAT_ALL = 0xffff
+} TraceCategory;
+
+typedef enum {
+    TRACE_SINK_STDERR = 0,
+    TRACE_SINK_RING = 1
+} TraceSink;
+
+// A plain number so it can be tested with #if; 4 is TRACE_LEVEL_DEBUG
+#ifndef QRME_TRACE_LEVEL
+#define QRME_TRACE_LEVEL 4
+#endif
+
+#define TRACE_RING_CAPACITY 1024
+#define TRACE_MESSAGE_SIZE 112
+
+typedef struct {
+    uint64_t sequence;          // position in emission order
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC
+    TraceLevel level;
+    TraceCategory category;
+    char message[TRACE_MESSAGE_SIZE];
+} TraceRecord;
+
+// Run-time filter, read by the TRACE macros; change it with the setters
+extern int trace_runtime_level;
+extern unsigned trace_runtime_categories;
+
+#define TRACE(level, category, ...)                                                     \
+    do {                                                                                \
+        if ((level) <= QRME_TRACE_LEVEL &&                                              \
+            (level) <= __atomic_load_n(&trace_runtime_level, __ATOMIC_RELAXED) &&       \
+            ((category) & __atomic_load_n(&trace_runtime_categories, __ATOMIC_RELAXED))) { \
+            trace_emit((level), (category), __VA_ARGS__);                               \
+        }                                                                               \
+    } while (0)
+
+#define TRACE_ERROR(category, ...) TRACE(TRACE_LEVEL_ERROR, category, __VA_ARGS__)
+#define TRACE_WARN(category, ...) TRACE(TRACE_LEVEL_WARN, category, __VA_ARGS__)
+#define TRACE_INFO(category, ...) TRACE(TRACE_LEVEL_INFO, category, __VA_ARGS__)
+#define TRACE_DEBUG(category, ...) TRACE(TRACE_LEVEL_DEBUG, category, __VA_ARGS__)
+
+/**
+ * Format and record a trace message. Use the TRACE macros instead, which
+ * skip disabled levels and categories without formatting anything.
+ *
+ * @param level The message level
+ * @param category The message category
+ * @param format A printf format string
+ */
+void trace_emit(TraceLevel level, TraceCategory category, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Set the most verbose level recorded at run time (default TRACE_LEVEL_WARN)
+ *
+ * @param level The level
+ */
+void trace_set_level(TraceLevel level);
+
+/**
+ * Set the categories recorded at run time (default TRACE_CAT_ALL)
+ *
+ * @param categories A mask of TraceCategory values
+ */
+void trace_set_categories(unsigned categories);
+
+/**
+ * Choose where records go (default TRACE_SINK_STDERR)
+ *
+ * @param sink The sink
+ */
+void trace_set_sink(TraceSink sink);
+
+/**
+ * Copy the newest records out of the ring, oldest first. Records being
+ * written or overwritten during the call are skipped.
+ *
+ * @param records Receives the records
+ * @param max The number of records that fit in records
+ * @return The number of records copied
+ */
+size_t trace_ring_read(TraceRecord* records, size_t max);
+
+/**
+ * Discard every record in the ring. Must not race with writers.
+ */
+void trace_ring_clear(void);
+
+/**
+ * Get the name of a trace level
+ *
+ * @param level The level
+ * @return A static string such as "debug"
+ */
+const char* trace_level_name(TraceLevel level);
+
+/**
+ * Get the name of a single trace category
+ *
+ * @param category The category
+ * @return A static string such as "model"
+ */
+const char* trace_category_name(TraceCategory category);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
@@ -3,29 +3,64 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "secure_alloc.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * Securely reallocate memory
+ * Numerically stable softmax
  *
- * @param ptr Pointer to the memory block to be reallocated
- * @param size The new size of the memory block
- * @return A pointer to the reallocated memory, or NULL on failure
+ * @param a The input values
+ * @param result The output values (may be the same as a)
+ * @param len The number of values (at least 1)
  */
-void* secure_realloc(void* ptr, size_t size);
+void softmax(const float* a, float* result, size_t len);
 
 /**
- * Securely free memory and set pointer to NULL
+ * Update a CRC-32 (IEEE 802.3) checksum
  *
- * @param ptr Pointer to the memory to free
+ * @param crc The checksum so far (0 for a new checksum)
+ * @param data The data to add
+ * @param len The length of the data
+ * @return The updated checksum
  */
-void secure_free(void** ptr);
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len);
+
+/*
+ * Float vectors inside encrypted requests and responses are encoded as
+ * little-endian IEEE-754 binary32. On little-endian hosts that is the
+ * in-memory layout, so a float array can be encrypted from, or decrypted
+ * into, directly (see encrypt_floats() and decrypt_floats_into()).
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define QRME_HOST_BIG_ENDIAN 1
+#else
+#define QRME_HOST_BIG_ENDIAN 0
+#endif
+
+/**
+ * Convert floats from host order to their little-endian encoding in place.
+ * Does nothing on little-endian hosts.
+ *
+ * @param values The values
+ * @param len The number of values
+ */
+void float_array_to_le(float* values, size_t len);
+
+/**
+ * Convert floats from their little-endian encoding to host order in place.
+ * Does nothing on little-endian hosts.
+ *
+ * @param values The values
+ * @param len The number of values
+ */
+void float_array_from_le(float* values, size_t len);
 
 /**
- * Convert a float array to a byte array
+ * Copy a float array into a new byte array in the little-endian encoding.
+ * Prefer encrypt_floats(), which needs no copy.
  *
  * @param float_array The input float array
  * @param float_array_len The length of the float array
@@ -37,7 +72,8 @@ int float_to_byte_array(const float* float_array, size_t float_array_len,
                         uint8_t** byte_array, size_t* byte_array_len);
 
 /**
- * Convert a byte array to a float array
+ * Copy a little-endian encoded byte array into a new float array.
+ * Prefer decrypt_floats_into(), which needs no copy.
  *
  * @param byte_array The input byte array
  * @param byte_array_len The length of the byte array
@@ -49,7 +85,8 @@ int byte_to_float_array(const uint8_t* byte_array, size_t byte_array_len,
                         float** float_array, size_t* float_array_len);
 
 /**
- * Generate a random float array
+ * Generate a random float array. Draws from the shared rand() sequence,
+ * so results are not reproducible when several threads call it at once.
  *
  * @param len The length of the array to generate
  * @param min The minimum value (inclusive)
@@ -75,6 +112,7 @@ void init_random(void);
 
 /**
  * Get the last error message from the utils module
+ * on the calling thread (see error.h)
  *
  * @return The last error message
  */
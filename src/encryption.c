@@ -1,30 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include <oqs/oqs.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <openssl/kdf.h>
 #include <openssl/err.h>
 #include "../include/encryption.h"
+#include "../include/error.h"
+#include "../include/secure_arena.h"
+#include "../include/trace.h"
 #include "../include/utils.h"
 
-#define MAX_ERROR_LENGTH 256
 #define AES_256_KEY_SIZE 32
 #define GCM_IV_SIZE 12
 #define GCM_TAG_SIZE 16
+#define KYBER_768_CIPHERTEXT_SIZE 1088  // Kyber-768 KEM ciphertext length
 
-// Global error state
-static char error_message[MAX_ERROR_LENGTH] = {0};
-
-// Function to set error message
-static void set_error(const char* message) {
-    strncpy(error_message, message, MAX_ERROR_LENGTH - 1);
-    error_message[MAX_ERROR_LENGTH - 1] = '\0';
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_ENCRYPTION, code, message);
 }
 
-// Function to get error message
-const char* get_error() {
-    return error_message;
+const char* get_error(void) {
+    return qrme_module_error(QRME_MODULE_ENCRYPTION);
 }
 
 int generate_keypair(uint8_t **public_key, size_t *public_key_len,
@@ -34,7 +34,7 @@ int generate_keypair(uint8_t **public_key, size_t *public_key_len,
 
     kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
     if (kem == NULL) {
-        set_error("Error creating KEM instance");
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
         return ret;
     }
 
@@ -42,12 +42,12 @@ int generate_keypair(uint8_t **public_key, size_t *public_key_len,
     *secret_key = secure_realloc(NULL, kem->length_secret_key);
 
     if (!*public_key || !*secret_key) {
-        set_error("Error allocating memory for keys");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for keys");
         goto cleanup;
     }
 
     if (OQS_KEM_keypair(kem, *public_key, *secret_key) != OQS_SUCCESS) {
-        set_error("Error generating keypair");
+        set_error(QRME_ERR_CRYPTO, "Error generating keypair");
         goto cleanup;
     }
 
@@ -65,203 +65,400 @@ cleanup:
     return ret;
 }
 
-int encrypt(const uint8_t *public_key, size_t public_key_len,
-            const uint8_t *plaintext, size_t plaintext_len,
-            uint8_t **ciphertext, size_t *ciphertext_len) {
-    OQS_KEM *kem = NULL;
-    EVP_CIPHER_CTX *ctx = NULL;
-    uint8_t *kem_ciphertext = NULL;
-    uint8_t *shared_secret = NULL;
-    uint8_t *aes_ciphertext = NULL;
-    uint8_t iv[GCM_IV_SIZE];
-    uint8_t tag[GCM_TAG_SIZE];
+struct QrmeCryptoCtx {
+    OQS_KEM *kem;
+    EVP_CIPHER_CTX *cipher;
+    int cipher_mode;            // 1 = encrypt, 0 = decrypt, -1 = not initialised
+    uint8_t *kem_ciphertext;    // both from the shared key arena
+    uint8_t *shared_secret;
+};
+
+static pthread_key_t thread_ctx_key;
+static pthread_once_t thread_ctx_once = PTHREAD_ONCE_INIT;
+
+QrmeCryptoCtx* create_crypto_ctx(void) {
+    QrmeCryptoCtx *ctx = secure_realloc(NULL, sizeof(QrmeCryptoCtx));
+    if (!ctx) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for crypto context");
+        return NULL;
+    }
+    ctx->cipher_mode = -1;
+
+    ctx->kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    if (ctx->kem == NULL) {
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
+        goto fail;
+    }
+
+    if (!(ctx->cipher = EVP_CIPHER_CTX_new())) {
+        set_error(QRME_ERR_CRYPTO, "Error creating cipher context");
+        goto fail;
+    }
+
+    // Locked memory for the per-call buffers, so the shared secret never
+    // reaches swap
+    ctx->kem_ciphertext = secure_key_alloc(ctx->kem->length_ciphertext);
+    ctx->shared_secret = secure_key_alloc(ctx->kem->length_shared_secret);
+    if (!ctx->kem_ciphertext || !ctx->shared_secret) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory");
+        goto fail;
+    }
+
+    return ctx;
+
+fail:
+    free_crypto_ctx(ctx);
+    return NULL;
+}
+
+void free_crypto_ctx(QrmeCryptoCtx *ctx) {
+    if (!ctx) {
+        return;
+    }
+    if (ctx->cipher) EVP_CIPHER_CTX_free(ctx->cipher);
+    if (ctx->kem) {
+        secure_key_free((void**)&ctx->kem_ciphertext, ctx->kem->length_ciphertext);
+        secure_key_free((void**)&ctx->shared_secret, ctx->kem->length_shared_secret);
+    }
+    OQS_KEM_free(ctx->kem);
+    secure_free((void**)&ctx);
+}
+
+static void free_thread_crypto_ctx(void *ctx) {
+    free_crypto_ctx((QrmeCryptoCtx*)ctx);
+}
+
+static void create_thread_ctx_key(void) {
+    pthread_key_create(&thread_ctx_key, free_thread_crypto_ctx);
+}
+
+QrmeCryptoCtx* get_thread_crypto_ctx(void) {
+    pthread_once(&thread_ctx_once, create_thread_ctx_key);
+
+    QrmeCryptoCtx *ctx = pthread_getspecific(thread_ctx_key);
+    if (ctx == NULL) {
+        ctx = create_crypto_ctx();
+        if (ctx && pthread_setspecific(thread_ctx_key, ctx) != 0) {
+            set_error(QRME_ERR_RESOURCE, "Error registering per-thread crypto context");
+            free_crypto_ctx(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+// Only pass the cipher when the direction changes, so that repeated calls in
+// the same direction merely rekey the existing context
+static int cipher_init(QrmeCryptoCtx *ctx, int enc, const uint8_t *key, const uint8_t *iv) {
+    const EVP_CIPHER *type = (ctx->cipher_mode == enc) ? NULL : EVP_aes_256_gcm();
+    if (EVP_CipherInit_ex(ctx->cipher, type, NULL, key, iv, enc) != 1) {
+        ctx->cipher_mode = -1;
+        return -1;
+    }
+    ctx->cipher_mode = enc;
+    return 0;
+}
+
+int encrypt_ctx(QrmeCryptoCtx *ctx,
+                const uint8_t *public_key, size_t public_key_len,
+                const uint8_t *plaintext, size_t plaintext_len,
+                uint8_t **ciphertext, size_t *ciphertext_len) {
+    uint8_t *out = NULL;
+    uint8_t *iv, *body;
     int len, aes_ciphertext_len;
-    int ret = -1;
 
-    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
-    if (kem == NULL) {
-        set_error("Error creating KEM instance");
-        return ret;
+    if (!ctx) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid crypto context");
+        return -1;
     }
 
-    if (public_key_len != kem->length_public_key) {
-        set_error("Invalid public key length");
-        goto cleanup;
+    if (public_key_len != ctx->kem->length_public_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid public key length");
+        return -1;
     }
 
-    kem_ciphertext = secure_realloc(NULL, kem->length_ciphertext);
-    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
-    aes_ciphertext = secure_realloc(NULL, plaintext_len + EVP_MAX_BLOCK_LENGTH);
+    if (plaintext_len > INT_MAX) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Plaintext too large");
+        return -1;
+    }
 
-    if (!kem_ciphertext || !shared_secret || !aes_ciphertext) {
-        set_error("Error allocating memory");
-        goto cleanup;
+    if (OQS_KEM_encaps(ctx->kem, ctx->kem_ciphertext, ctx->shared_secret, public_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM encapsulation");
+        return -1;
     }
 
-    if (OQS_KEM_encaps(kem, kem_ciphertext, shared_secret, public_key) != OQS_SUCCESS) {
-        set_error("Error in KEM encapsulation");
-        goto cleanup;
+    // GCM does not pad, so the AES output can be written straight into the
+    // final buffer: KEM ciphertext + IV + AES ciphertext + tag
+    *ciphertext_len = ctx->kem->length_ciphertext + GCM_IV_SIZE + plaintext_len + GCM_TAG_SIZE;
+    out = secure_realloc(NULL, *ciphertext_len);
+    if (!out) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for final ciphertext");
+        return -1;
     }
+    iv = out + ctx->kem->length_ciphertext;
+    body = iv + GCM_IV_SIZE;
+    memcpy(out, ctx->kem_ciphertext, ctx->kem->length_ciphertext);
 
     // Generate a random IV
     if (RAND_bytes(iv, GCM_IV_SIZE) != 1) {
-        set_error("Error generating random IV");
-        goto cleanup;
-    }
-
-    // Create and initialise the context
-    if (!(ctx = EVP_CIPHER_CTX_new())) {
-        set_error("Error creating cipher context");
-        goto cleanup;
+        set_error(QRME_ERR_CRYPTO, "Error generating random IV");
+        goto fail;
     }
 
     // Initialise the encryption operation
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, shared_secret, iv) != 1) {
-        set_error("Error initializing encryption");
-        goto cleanup;
+    if (cipher_init(ctx, 1, ctx->shared_secret, iv) != 0) {
+        set_error(QRME_ERR_CRYPTO, "Error initializing encryption");
+        goto fail;
     }
 
     // Encrypt plaintext
-    if (EVP_EncryptUpdate(ctx, aes_ciphertext, &len, plaintext, plaintext_len) != 1) {
-        set_error("Error in encryption update");
-        goto cleanup;
+    if (EVP_EncryptUpdate(ctx->cipher, body, &len, plaintext, (int)plaintext_len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error in encryption update");
+        goto fail;
     }
     aes_ciphertext_len = len;
 
     // Finalize encryption
-    if (EVP_EncryptFinal_ex(ctx, aes_ciphertext + len, &len) != 1) {
-        set_error("Error finalizing encryption");
-        goto cleanup;
+    if (EVP_EncryptFinal_ex(ctx->cipher, body + len, &len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error finalizing encryption");
+        goto fail;
     }
     aes_ciphertext_len += len;
 
     // Get the tag
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, tag) != 1) {
-        set_error("Error getting tag");
-        goto cleanup;
-    }
-
-    // Assemble final ciphertext: KEM ciphertext + IV + AES ciphertext + tag
-    *ciphertext_len = kem->length_ciphertext + GCM_IV_SIZE + aes_ciphertext_len + GCM_TAG_SIZE;
-    *ciphertext = secure_realloc(NULL, *ciphertext_len);
-    if (!*ciphertext) {
-        set_error("Error allocating memory for final ciphertext");
-        goto cleanup;
+    if (EVP_CIPHER_CTX_ctrl(ctx->cipher, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE,
+                            body + aes_ciphertext_len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error getting tag");
+        goto fail;
     }
 
-    memcpy(*ciphertext, kem_ciphertext, kem->length_ciphertext);
-    memcpy(*ciphertext + kem->length_ciphertext, iv, GCM_IV_SIZE);
-    memcpy(*ciphertext + kem->length_ciphertext + GCM_IV_SIZE, aes_ciphertext, aes_ciphertext_len);
-    memcpy(*ciphertext + kem->length_ciphertext + GCM_IV_SIZE + aes_ciphertext_len, tag, GCM_TAG_SIZE);
+    OQS_MEM_cleanse(ctx->shared_secret, ctx->kem->length_shared_secret);
+    *ciphertext = out;
+    return 0;
 
-    ret = 0;  // Success
+fail:
+    OQS_MEM_cleanse(ctx->shared_secret, ctx->kem->length_shared_secret);
+    secure_free((void**)&out);
+    return -1;
+}
 
-cleanup:
-    if (ctx) EVP_CIPHER_CTX_free(ctx);
-    secure_free((void**)&kem_ciphertext);
-    secure_free((void**)&shared_secret);
-    secure_free((void**)&aes_ciphertext);
-    OQS_KEM_free(kem);
-    return ret;
+size_t decrypted_size(size_t ciphertext_len) {
+    size_t overhead = KYBER_768_CIPHERTEXT_SIZE + GCM_IV_SIZE + GCM_TAG_SIZE;
+    return ciphertext_len > overhead ? ciphertext_len - overhead : 0;
 }
 
-int decrypt(const uint8_t *secret_key, size_t secret_key_len,
-            const uint8_t *ciphertext, size_t ciphertext_len,
-            uint8_t **plaintext, size_t *plaintext_len) {
-    OQS_KEM *kem = NULL;
-    EVP_CIPHER_CTX *ctx = NULL;
-    uint8_t *shared_secret = NULL;
-    uint8_t iv[GCM_IV_SIZE];
+int decrypt_ctx_into(QrmeCryptoCtx *ctx,
+                     const uint8_t *secret_key, size_t secret_key_len,
+                     const uint8_t *ciphertext, size_t ciphertext_len,
+                     uint8_t *plaintext, size_t plaintext_capacity,
+                     size_t *plaintext_len) {
     uint8_t tag[GCM_TAG_SIZE];
-    int len;
+    const uint8_t *iv;
+    size_t aes_ciphertext_len;
+    int len, total;
     int ret = -1;
 
-    printf("Debug: Initializing KEM\n");
-    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
-    if (kem == NULL) {
-        set_error("Error creating KEM instance");
+    if (!ctx) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid crypto context");
         return ret;
     }
 
-    printf("Debug: Checking key and ciphertext lengths\n");
-    printf("Debug: secret_key_len: %zu, kem->length_secret_key: %zu\n", secret_key_len, kem->length_secret_key);
-    printf("Debug: ciphertext_len: %zu, kem->length_ciphertext: %zu, GCM_IV_SIZE: %d, GCM_TAG_SIZE: %d\n",
-           ciphertext_len, kem->length_ciphertext, GCM_IV_SIZE, GCM_TAG_SIZE);
-
-    if (secret_key_len != kem->length_secret_key ||
-        ciphertext_len <= kem->length_ciphertext + GCM_IV_SIZE + GCM_TAG_SIZE) {
-        set_error("Invalid key or ciphertext length");
-        goto cleanup;
+    if (secret_key_len != ctx->kem->length_secret_key ||
+        ciphertext_len <= ctx->kem->length_ciphertext + GCM_IV_SIZE + GCM_TAG_SIZE) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid key or ciphertext length");
+        return ret;
     }
 
-    printf("Debug: Allocating shared secret\n");
-    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
-    if (!shared_secret) {
-        set_error("Error allocating memory");
-        goto cleanup;
+    aes_ciphertext_len = ciphertext_len - ctx->kem->length_ciphertext - GCM_IV_SIZE - GCM_TAG_SIZE;
+    if (aes_ciphertext_len > INT_MAX) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Ciphertext too large");
+        return ret;
+    }
+    if (!plaintext || aes_ciphertext_len > plaintext_capacity) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Plaintext buffer too small");
+        return ret;
     }
 
-    printf("Debug: Performing KEM decapsulation\n");
-    if (OQS_KEM_decaps(kem, shared_secret, ciphertext, secret_key) != OQS_SUCCESS) {
-        set_error("Error in KEM decapsulation");
+    TRACE_DEBUG(TRACE_CAT_CRYPTO, "Performing KEM decapsulation");
+    if (OQS_KEM_decaps(ctx->kem, ctx->shared_secret, ciphertext, secret_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM decapsulation");
         goto cleanup;
     }
 
-    printf("Debug: Extracting IV and tag\n");
-    memcpy(iv, ciphertext + kem->length_ciphertext, GCM_IV_SIZE);
+    iv = ciphertext + ctx->kem->length_ciphertext;
     memcpy(tag, ciphertext + ciphertext_len - GCM_TAG_SIZE, GCM_TAG_SIZE);
 
-    printf("Debug: Creating cipher context\n");
-    if (!(ctx = EVP_CIPHER_CTX_new())) {
-        set_error("Error creating cipher context");
+    if (cipher_init(ctx, 0, ctx->shared_secret, iv) != 0) {
+        set_error(QRME_ERR_CRYPTO, "Error initializing decryption");
         goto cleanup;
     }
 
-    printf("Debug: Initializing decryption\n");
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, shared_secret, iv) != 1) {
-        set_error("Error initializing decryption");
+    if (EVP_CIPHER_CTX_ctrl(ctx->cipher, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, (void*)tag) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error setting tag");
         goto cleanup;
     }
 
-    printf("Debug: Setting expected tag\n");
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, (void*)tag) != 1) {
-        set_error("Error setting tag");
+    TRACE_DEBUG(TRACE_CAT_CRYPTO, "Decrypting %zu bytes of ciphertext", aes_ciphertext_len);
+    if (EVP_DecryptUpdate(ctx->cipher, plaintext, &len,
+                          iv + GCM_IV_SIZE, (int)aes_ciphertext_len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error in decryption update");
         goto cleanup;
     }
+    total = len;
 
-    printf("Debug: Allocating memory for plaintext\n");
-    size_t aes_ciphertext_len = ciphertext_len - kem->length_ciphertext - GCM_IV_SIZE - GCM_TAG_SIZE;
-    *plaintext = secure_realloc(NULL, aes_ciphertext_len);
-    if (!*plaintext) {
-        set_error("Error allocating memory for plaintext");
+    if (EVP_DecryptFinal_ex(ctx->cipher, plaintext + len, &len) != 1) {
+        set_error(QRME_ERR_AUTH, "Error finalizing decryption");
         goto cleanup;
     }
+    *plaintext_len = (size_t)(total + len);
 
-    printf("Debug: Decrypting ciphertext\n");
-    if (EVP_DecryptUpdate(ctx, *plaintext, &len,
-                          ciphertext + kem->length_ciphertext + GCM_IV_SIZE,
-                          aes_ciphertext_len) != 1) {
-        set_error("Error in decryption update");
-        goto cleanup;
+    ret = 0;  // Success
+
+cleanup:
+    OQS_MEM_cleanse(ctx->shared_secret, ctx->kem->length_shared_secret);
+    if (ret != 0) {
+        // Never leave unauthenticated plaintext in the caller's buffer
+        OQS_MEM_cleanse(plaintext, aes_ciphertext_len);
+    }
+    return ret;
+}
+
+int decrypt_ctx(QrmeCryptoCtx *ctx,
+                const uint8_t *secret_key, size_t secret_key_len,
+                const uint8_t *ciphertext, size_t ciphertext_len,
+                uint8_t **plaintext, size_t *plaintext_len) {
+    size_t capacity = decrypted_size(ciphertext_len);
+
+    *plaintext = NULL;
+
+    if (capacity == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid key or ciphertext length");
+        return -1;
+    }
+
+    *plaintext = secure_realloc(NULL, capacity);
+    if (!*plaintext) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for plaintext");
+        return -1;
+    }
+
+    if (decrypt_ctx_into(ctx, secret_key, secret_key_len, ciphertext, ciphertext_len,
+                         *plaintext, capacity, plaintext_len) != 0) {
+        secure_free((void**)plaintext);
+        *plaintext = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int encrypt(const uint8_t *public_key, size_t public_key_len,
+            const uint8_t *plaintext, size_t plaintext_len,
+            uint8_t **ciphertext, size_t *ciphertext_len) {
+    QrmeCryptoCtx *ctx = get_thread_crypto_ctx();
+    if (!ctx) {
+        return -1;  // keep the reason create_crypto_ctx() recorded
+    }
+    return encrypt_ctx(ctx, public_key, public_key_len,
+                       plaintext, plaintext_len, ciphertext, ciphertext_len);
+}
+
+int decrypt(const uint8_t *secret_key, size_t secret_key_len,
+            const uint8_t *ciphertext, size_t ciphertext_len,
+            uint8_t **plaintext, size_t *plaintext_len) {
+    QrmeCryptoCtx *ctx = get_thread_crypto_ctx();
+    if (!ctx) {
+        return -1;
+    }
+    return decrypt_ctx(ctx, secret_key, secret_key_len,
+                       ciphertext, ciphertext_len, plaintext, plaintext_len);
+}
+
+int decrypt_into(const uint8_t *secret_key, size_t secret_key_len,
+                 const uint8_t *ciphertext, size_t ciphertext_len,
+                 uint8_t *plaintext, size_t plaintext_capacity,
+                 size_t *plaintext_len) {
+    QrmeCryptoCtx *ctx = get_thread_crypto_ctx();
+    if (!ctx) {
+        return -1;
+    }
+    return decrypt_ctx_into(ctx, secret_key, secret_key_len,
+                            ciphertext, ciphertext_len,
+                            plaintext, plaintext_capacity, plaintext_len);
+}
+
+int encrypt_floats(const uint8_t *public_key, size_t public_key_len,
+                   const float *values, size_t count,
+                   uint8_t **ciphertext, size_t *ciphertext_len) {
+    if (!values || count == 0 || count > SIZE_MAX / sizeof(float)) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid float vector");
+        return -1;
+    }
+#if QRME_HOST_BIG_ENDIAN
+    // The encoding differs from the in-memory layout, so swap into scratch
+    float *encoded = secure_alloc(count * sizeof(float));
+    if (!encoded) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for float encoding");
+        return -1;
     }
-    *plaintext_len = len;
+    memcpy(encoded, values, count * sizeof(float));
+    float_array_to_le(encoded, count);
+    int ret = encrypt(public_key, public_key_len, (const uint8_t *)encoded, count * sizeof(float),
+                      ciphertext, ciphertext_len);
+    secure_free((void **)&encoded);
+    return ret;
+#else
+    return encrypt(public_key, public_key_len, (const uint8_t *)values, count * sizeof(float),
+                   ciphertext, ciphertext_len);
+#endif
+}
+
+int decrypt_floats_into(const uint8_t *secret_key, size_t secret_key_len,
+                        const uint8_t *ciphertext, size_t ciphertext_len,
+                        float *values, size_t capacity, size_t *count) {
+    size_t len;
+    if (!values || !count || capacity > SIZE_MAX / sizeof(float)) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid float buffer");
+        return -1;
+    }
+    if (decrypt_into(secret_key, secret_key_len, ciphertext, ciphertext_len,
+                     (uint8_t *)values, capacity * sizeof(float), &len) != 0) {
+        return -1;
+    }
+    if (len % sizeof(float) != 0) {
+        secure_zero(values, len);
+        set_error(QRME_ERR_FORMAT, "Plaintext is not a whole number of floats");
+        return -1;
+    }
+    *count = len / sizeof(float);
+    float_array_from_le(values, *count);
+    return 0;
+}
 
-    printf("Debug: Finalizing decryption\n");
-    if (EVP_DecryptFinal_ex(ctx, *plaintext + len, &len) != 1) {
-        set_error("Error finalizing decryption");
+int hkdf_sha256(const uint8_t *key, size_t key_len,
+                const uint8_t *salt, size_t salt_len,
+                const char *info, uint8_t *out, size_t out_len) {
+    EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    int ret = -1;
+
+    if (!pctx) {
+        set_error(QRME_ERR_CRYPTO, "Error creating HKDF context");
+        return ret;
+    }
+
+    if (EVP_PKEY_derive_init(pctx) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_salt(pctx, salt, (int)salt_len) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(pctx, key, (int)key_len) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(pctx, (const unsigned char*)info, (int)strlen(info)) <= 0 ||
+        EVP_PKEY_derive(pctx, out, &out_len) <= 0) {
+        set_error(QRME_ERR_CRYPTO, "Error deriving key material");
         goto cleanup;
     }
-    *plaintext_len += len;
 
     ret = 0;  // Success
 
 cleanup:
-    if (ctx) EVP_CIPHER_CTX_free(ctx);
-    secure_free((void**)&shared_secret);
-    OQS_KEM_free(kem);
-    if (ret != 0 && *plaintext) {
-        secure_free((void**)plaintext);
-    }
+    EVP_PKEY_CTX_free(pctx);
     return ret;
 }
 
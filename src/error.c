@@ -0,0 +1,67 @@
+#include <string.h>
+#include "../include/error.h"
+
+#define MAX_ERROR_LENGTH 256
+
+// Each thread keeps the last message of every module, so a module's
+// get_*_error() still describes that module's failure after another
+// module has reported one on the same thread
+typedef struct {
+    QrmeErrorCode code;
+    QrmeErrorModule module;
+    char messages[QRME_MODULE_COUNT][MAX_ERROR_LENGTH];
+} ErrorState;
+
+static __thread ErrorState error_state;
+
+void qrme_set_error(QrmeErrorModule module, QrmeErrorCode code, const char* message) {
+    if ((unsigned)module >= QRME_MODULE_COUNT) {
+        module = QRME_MODULE_NONE;
+    }
+    char* slot = error_state.messages[module];
+    if (message != slot) {
+        strncpy(slot, message ? message : "", MAX_ERROR_LENGTH - 1);
+        slot[MAX_ERROR_LENGTH - 1] = '\0';
+    }
+    error_state.code = code;
+    error_state.module = module;
+}
+
+QrmeErrorCode qrme_last_error(void) {
+    return error_state.code;
+}
+
+QrmeErrorModule qrme_last_error_module(void) {
+    return error_state.module;
+}
+
+const char* qrme_last_error_message(void) {
+    return error_state.messages[error_state.module];
+}
+
+const char* qrme_module_error(QrmeErrorModule module) {
+    if ((unsigned)module >= QRME_MODULE_COUNT) {
+        return "";
+    }
+    return error_state.messages[module];
+}
+
+void qrme_clear_error(void) {
+    memset(&error_state, 0, sizeof(error_state));
+}
+
+const char* qrme_error_name(QrmeErrorCode code) {
+    switch (code) {
+    case QRME_OK: return "ok";
+    case QRME_ERR_INVALID_ARGUMENT: return "invalid argument";
+    case QRME_ERR_OUT_OF_MEMORY: return "out of memory";
+    case QRME_ERR_IO: return "I/O error";
+    case QRME_ERR_FORMAT: return "bad format";
+    case QRME_ERR_CRYPTO: return "crypto failure";
+    case QRME_ERR_AUTH: return "authentication failure";
+    case QRME_ERR_UNSUPPORTED: return "unsupported";
+    case QRME_ERR_STATE: return "bad state";
+    case QRME_ERR_RESOURCE: return "resource unavailable";
+    default: return "unknown error";
+    }
+}
@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/format.h"
+#include "../include/error.h"
+#include "../include/utils.h"
+
+#define VERIFY_BUFFER_SIZE (1 << 16)
+
+struct ModelWriter {
+    FILE* file;
+    ModelIndex index;
+    size_t next_layer;
+    uint64_t next_offset;
+};
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_FORMAT, code, message);
+}
+
+const char* get_format_error(void) {
+    return qrme_module_error(QRME_MODULE_FORMAT);
+}
+
+static void put_le32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void put_le64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_le32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t get_le64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static long file_size(FILE* file) {
+    if (fseek(file, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    return ftell(file);
+}
+
+static void encode_toc_entry(uint8_t* out, const LayerEntry* entry) {
+    put_le64(out, entry->offset);
+    put_le64(out + 8, entry->length);
+    put_le64(out + 16, entry->rows);
+    put_le64(out + 24, entry->cols);
+    put_le32(out + 32, entry->dtype);
+    put_le32(out + 36, entry->flags);
+    put_le32(out + 40, entry->checksum);
+    put_le32(out + 44, entry->activation);
+}
+
+static void decode_toc_entry(const uint8_t* in, LayerEntry* entry) {
+    entry->offset = get_le64(in);
+    entry->length = get_le64(in + 8);
+    entry->rows = get_le64(in + 16);
+    entry->cols = get_le64(in + 24);
+    entry->dtype = get_le32(in + 32);
+    entry->flags = get_le32(in + 36);
+    entry->checksum = get_le32(in + 40);
+    entry->activation = get_le32(in + 44);
+}
+
+// Every blob must lie inside the file
+static int check_extent(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+static int read_index_v2(FILE* file, const uint8_t* header, uint64_t size, ModelIndex* index) {
+    uint8_t* toc = NULL;
+    uint64_t toc_offset, toc_len;
+    int ret = -1;
+
+    if (get_le32(header + 60) != crc32_update(0, header, 60)) {
+        set_error(QRME_ERR_FORMAT, "Model header checksum mismatch");
+        return ret;
+    }
+    if (get_le32(header + 4) != MODEL_FORMAT_VERSION) {
+        set_error(QRME_ERR_UNSUPPORTED, "Unsupported model format version");
+        return ret;
+    }
+    if (get_le32(header + 8) != MODEL_HEADER_SIZE || get_le32(header + 12) != MODEL_TOC_ENTRY_SIZE) {
+        set_error(QRME_ERR_UNSUPPORTED, "Unsupported model header layout");
+        return ret;
+    }
+
+    index->version = MODEL_FORMAT_VERSION;
+    index->num_layers = (size_t)get_le64(header + 16);
+    toc_offset = get_le64(header + 24);
+    index->public_key_offset = get_le64(header + 32);
+    index->public_key_len = get_le64(header + 40);
+
+    if (index->num_layers > size / MODEL_TOC_ENTRY_SIZE) {
+        set_error(QRME_ERR_FORMAT, "Invalid layer count");
+        return ret;
+    }
+    toc_len = (uint64_t)index->num_layers * MODEL_TOC_ENTRY_SIZE;
+    if (!check_extent(toc_offset, toc_len, size) ||
+        !check_extent(index->public_key_offset, index->public_key_len, size)) {
+        set_error(QRME_ERR_FORMAT, "Truncated model file");
+        return ret;
+    }
+
+    index->layers = calloc(index->num_layers ? index->num_layers : 1, sizeof(LayerEntry));
+    toc = malloc(toc_len ? toc_len : 1);
+    if (!index->layers || !toc) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for model index");
+        goto cleanup;
+    }
+
+    if (fseek(file, (long)toc_offset, SEEK_SET) != 0 || fread(toc, 1, toc_len, file) != toc_len) {
+        set_error(QRME_ERR_IO, "Failed to read table of contents");
+        goto cleanup;
+    }
+    if (crc32_update(0, toc, toc_len) != get_le32(header + 52)) {
+        set_error(QRME_ERR_FORMAT, "Table of contents checksum mismatch");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < index->num_layers; i++) {
+        LayerEntry* entry = &index->layers[i];
+        decode_toc_entry(toc + i * MODEL_TOC_ENTRY_SIZE, entry);
+        if (!check_extent(entry->offset, entry->length, size)) {
+            set_error(QRME_ERR_FORMAT, "Layer extends past the end of the file");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;  // Success
+
+cleanup:
+    free(toc);
+    return ret;
+}
+
+static int read_size(FILE* file, size_t* value) {
+    return fread(value, sizeof(size_t), 1, file) == 1 ? 0 : -1;
+}
+
+// Version 1 has no table of contents, so walk the records and note where
+// each blob starts
+static int read_index_v1(FILE* file, uint64_t size, ModelIndex* index) {
+    size_t num_layers;
+
+    if (fseek(file, 0, SEEK_SET) != 0 || read_size(file, &num_layers) != 0) {
+        set_error(QRME_ERR_IO, "Failed to read number of layers");
+        return -1;
+    }
+    if (num_layers > size / (3 * sizeof(size_t))) {
+        set_error(QRME_ERR_FORMAT, "Invalid layer count");
+        return -1;
+    }
+
+    index->version = 1;
+    index->num_layers = num_layers;
+    index->layers = calloc(num_layers ? num_layers : 1, sizeof(LayerEntry));
+    if (!index->layers) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for model index");
+        return -1;
+    }
+
+    for (size_t i = 0; i < num_layers; i++) {
+        LayerEntry* entry = &index->layers[i];
+        size_t rows, cols, length;
+        if (read_size(file, &rows) != 0 || read_size(file, &cols) != 0 ||
+            read_size(file, &length) != 0) {
+            set_error(QRME_ERR_IO, "Failed to read layer header");
+            return -1;
+        }
+        entry->rows = rows;
+        entry->cols = cols;
+        entry->length = length;
+        entry->offset = (uint64_t)ftell(file);
+        if (!check_extent(entry->offset, entry->length, size) ||
+            fseek(file, (long)length, SEEK_CUR) != 0) {
+            set_error(QRME_ERR_FORMAT, "Layer extends past the end of the file");
+            return -1;
+        }
+    }
+
+    if (read_size(file, &index->public_key_len) != 0) {
+        set_error(QRME_ERR_IO, "Failed to read public key length");
+        return -1;
+    }
+    index->public_key_offset = (uint64_t)ftell(file);
+    if (!check_extent(index->public_key_offset, index->public_key_len, size)) {
+        set_error(QRME_ERR_FORMAT, "Truncated model file");
+        return -1;
+    }
+    return 0;
+}
+
+int read_model_index(FILE* file, ModelIndex* index) {
+    uint8_t header[MODEL_HEADER_SIZE];
+    long size;
+
+    if (!file || !index) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for read_model_index");
+        return -1;
+    }
+    memset(index, 0, sizeof(ModelIndex));
+
+    size = file_size(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        set_error(QRME_ERR_IO, "Failed to determine model file size");
+        return -1;
+    }
+
+    if ((size_t)size >= MODEL_HEADER_SIZE &&
+        fread(header, 1, MODEL_HEADER_SIZE, file) == MODEL_HEADER_SIZE &&
+        memcmp(header, MODEL_FORMAT_MAGIC, 4) == 0) {
+        if (read_index_v2(file, header, (uint64_t)size, index) == 0) {
+            return 0;
+        }
+    } else if (read_index_v1(file, (uint64_t)size, index) == 0) {
+        return 0;
+    }
+
+    free_model_index(index);
+    return -1;
+}
+
+void free_model_index(ModelIndex* index) {
+    if (index) {
+        free(index->layers);
+        memset(index, 0, sizeof(ModelIndex));
+    }
+}
+
+int verify_model_file(const char* filename) {
+    ModelIndex index;
+    uint8_t* buffer = NULL;
+    int ret = -1;
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        set_error(QRME_ERR_IO, "Failed to open file for reading");
+        return -1;
+    }
+
+    if (read_model_index(file, &index) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    buffer = malloc(VERIFY_BUFFER_SIZE);
+    if (!buffer) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for verification");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; index.version >= 2 && i < index.num_layers; i++) {
+        const LayerEntry* entry = &index.layers[i];
+        uint64_t remaining = entry->length;
+        uint32_t crc = 0;
+
+        if (fseek(file, (long)entry->offset, SEEK_SET) != 0) {
+            set_error(QRME_ERR_IO, "Failed to seek to layer");
+            goto cleanup;
+        }
+        while (remaining > 0) {
+            size_t chunk = remaining < VERIFY_BUFFER_SIZE ? (size_t)remaining : VERIFY_BUFFER_SIZE;
+            if (fread(buffer, 1, chunk, file) != chunk) {
+                set_error(QRME_ERR_IO, "Failed to read layer");
+                goto cleanup;
+            }
+            crc = crc32_update(crc, buffer, chunk);
+            remaining -= chunk;
+        }
+        if (crc != entry->checksum) {
+            set_error(QRME_ERR_FORMAT, "Layer checksum mismatch");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;  // Success
+
+cleanup:
+    free(buffer);
+    free_model_index(&index);
+    fclose(file);
+    return ret;
+}
+
+ModelWriter* begin_model_file(const char* filename, size_t num_layers,
+                              const uint8_t* public_key, size_t public_key_len) {
+    uint8_t placeholder[MODEL_TOC_ENTRY_SIZE] = {0};
+    ModelWriter* writer = calloc(1, sizeof(ModelWriter));
+    if (!writer) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for model writer");
+        return NULL;
+    }
+
+    writer->index.version = MODEL_FORMAT_VERSION;
+    writer->index.num_layers = num_layers;
+    writer->index.layers = calloc(num_layers ? num_layers : 1, sizeof(LayerEntry));
+    writer->index.public_key_offset = MODEL_HEADER_SIZE + (uint64_t)num_layers * MODEL_TOC_ENTRY_SIZE;
+    writer->index.public_key_len = public_key_len;
+    writer->next_offset = writer->index.public_key_offset + public_key_len;
+    if (!writer->index.layers) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for model index");
+        free(writer);
+        return NULL;
+    }
+
+    writer->file = fopen(filename, "wb");
+    if (!writer->file) {
+        set_error(QRME_ERR_IO, "Failed to open file for writing");
+        abort_model_file(writer);
+        return NULL;
+    }
+
+    // Reserve the header and table of contents; they are filled in once
+    // every layer's offset and checksum is known
+    for (uint64_t remaining = writer->index.public_key_offset; remaining > 0;) {
+        size_t n = remaining < sizeof(placeholder) ? (size_t)remaining : sizeof(placeholder);
+        if (fwrite(placeholder, 1, n, writer->file) != n) {
+            set_error(QRME_ERR_IO, "Failed to write model header");
+            abort_model_file(writer);
+            return NULL;
+        }
+        remaining -= n;
+    }
+
+    if (fwrite(public_key, 1, public_key_len, writer->file) != public_key_len) {
+        set_error(QRME_ERR_IO, "Failed to write public key");
+        abort_model_file(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+int write_model_layer(ModelWriter* writer, size_t rows, size_t cols,
+                      uint32_t dtype, uint32_t flags, uint32_t activation,
+                      const uint8_t* blob, size_t blob_len) {
+    if (!writer || writer->next_layer >= writer->index.num_layers) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Too many layers written to model file");
+        return -1;
+    }
+
+    if (fwrite(blob, 1, blob_len, writer->file) != blob_len) {
+        set_error(QRME_ERR_IO, "Failed to write layer");
+        return -1;
+    }
+
+    LayerEntry* entry = &writer->index.layers[writer->next_layer++];
+    entry->offset = writer->next_offset;
+    entry->length = blob_len;
+    entry->rows = rows;
+    entry->cols = cols;
+    entry->dtype = dtype;
+    entry->flags = flags;
+    entry->activation = activation;
+    entry->checksum = crc32_update(0, blob, blob_len);
+    writer->next_offset += blob_len;
+    return 0;
+}
+
+int finish_model_file(ModelWriter* writer) {
+    uint8_t header[MODEL_HEADER_SIZE] = {0};
+    uint8_t* toc = NULL;
+    size_t toc_len;
+    int ret = -1;
+
+    if (!writer) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid model writer");
+        return -1;
+    }
+    if (writer->next_layer != writer->index.num_layers) {
+        set_error(QRME_ERR_FORMAT, "Model file is missing layers");
+        goto cleanup;
+    }
+
+    toc_len = writer->index.num_layers * MODEL_TOC_ENTRY_SIZE;
+    toc = malloc(toc_len ? toc_len : 1);
+    if (!toc) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for table of contents");
+        goto cleanup;
+    }
+    for (size_t i = 0; i < writer->index.num_layers; i++) {
+        encode_toc_entry(toc + i * MODEL_TOC_ENTRY_SIZE, &writer->index.layers[i]);
+    }
+
+    memcpy(header, MODEL_FORMAT_MAGIC, 4);
+    put_le32(header + 4, MODEL_FORMAT_VERSION);
+    put_le32(header + 8, MODEL_HEADER_SIZE);
+    put_le32(header + 12, MODEL_TOC_ENTRY_SIZE);
+    put_le64(header + 16, writer->index.num_layers);
+    put_le64(header + 24, MODEL_HEADER_SIZE);
+    put_le64(header + 32, writer->index.public_key_offset);
+    put_le64(header + 40, writer->index.public_key_len);
+    put_le32(header + 48, 0);  // flags
+    put_le32(header + 52, crc32_update(0, toc, toc_len));
+    put_le32(header + 56, 0);  // reserved
+    put_le32(header + 60, crc32_update(0, header, 60));
+
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, 1, MODEL_HEADER_SIZE, writer->file) != MODEL_HEADER_SIZE ||
+        fwrite(toc, 1, toc_len, writer->file) != toc_len) {
+        set_error(QRME_ERR_IO, "Failed to write model header");
+        goto cleanup;
+    }
+
+    ret = 0;  // Success
+
+cleanup:
+    free(toc);
+    if (fclose(writer->file) != 0 && ret == 0) {
+        set_error(QRME_ERR_IO, "Failed to close model file");
+        ret = -1;
+    }
+    writer->file = NULL;
+    abort_model_file(writer);
+    return ret;
+}
+
+void abort_model_file(ModelWriter* writer) {
+    if (writer) {
+        if (writer->file) fclose(writer->file);
+        free_model_index(&writer->index);
+        free(writer);
+    }
+}
@@ -0,0 +1,1070 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/kernels.h"
+#include "../include/utils.h"
+#include "../include/secure_alloc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Rows computed together so each load of x feeds several accumulators
+#define ROW_BLOCK 4
+// Columns per tile: keeps the slice of x being reused resident in L1
+#define COL_TILE 2048
+// Weight panel for batched products: 64 x 512 floats (128 KiB) stays in L2
+// while every input in the batch is applied to it
+#define GEMM_ROW_TILE 64
+#define GEMM_COL_TILE 512
+// Int8 panels hold four times the columns in the same 128 KiB
+#define GEMM_Q8_COL_TILE 2048
+// Half-precision panels are widened into a 64 x 256 float (64 KiB) buffer
+#define GEMM_HALF_COL_TILE 256
+
+#define LEAKY_RELU_ALPHA 0.01f
+
+// Applied as each output is stored during the last column tile, so bias
+// and activation cost no extra pass over the output
+typedef struct {
+    const float* bias;          // may be NULL
+    Activation activation;      // softmax is finished by the caller
+} Epilogue;
+
+typedef void (*GemvTileFn)(const float* weights, size_t cols, size_t rows,
+                           size_t k0, size_t k1, const float* x, float* y,
+                           const Epilogue* ep);
+
+// Activations are quantized to [-Q7_MAX, Q7_MAX] and stored offset by Q7_OFFSET
+#define Q7_MAX 63
+#define Q7_OFFSET 64
+// Int8 columns per tile: keeps the int32 partial sums from overflowing
+#define Q8_COL_TILE 65536
+
+typedef struct {
+    const float* scales;
+    const int32_t* zero_points;
+    const int32_t* row_sums;
+    float x_scale;
+    int64_t x_sum;
+    Epilogue post;
+} Q8Epilogue;
+
+typedef void (*GemvQ8TileFn)(const int8_t* q, size_t cols, size_t rows,
+                             size_t k0, size_t k1, const uint8_t* xu, float* y,
+                             const Q8Epilogue* ep);
+
+typedef void (*GemvHalfTileFn)(const uint16_t* weights, size_t cols, size_t rows,
+                               size_t k0, size_t k1, const float* x, float* y,
+                               const Epilogue* ep);
+
+static KernelIsa active_isa = KERNEL_ISA_SCALAR;
+static GemvTileFn gemv_tile = NULL;
+static GemvQ8TileFn gemv_q8_tile = NULL;
+static GemvHalfTileFn gemv_f16_tile = NULL;
+static GemvHalfTileFn gemv_bf16_tile = NULL;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static inline float finish(float acc, size_t row, const Epilogue* ep) {
+    if (!ep) {
+        return acc;  // not the last column tile yet
+    }
+    if (ep->bias) {
+        acc += ep->bias[row];
+    }
+    switch (ep->activation) {
+    case ACTIVATION_RELU:
+        return acc > 0 ? acc : 0;
+    case ACTIVATION_LEAKY_RELU:
+        return acc > 0 ? acc : LEAKY_RELU_ALPHA * acc;
+    case ACTIVATION_SIGMOID:
+        return 1.0f / (1.0f + expf(-acc));
+    case ACTIVATION_TANH:
+        return tanhf(acc);
+    default:
+        return acc;
+    }
+}
+
+// Undo the quantization offsets for one row: partial holds the products of
+// earlier tiles, dot those of the last one
+static inline float finish_q8(float partial, int32_t dot, size_t row, const Q8Epilogue* ep) {
+    if (!ep) {
+        return partial + (float)dot;
+    }
+    double acc = (double)partial + dot - (double)Q7_OFFSET * ep->row_sums[row] -
+                 (double)ep->zero_points[row] * (double)ep->x_sum;
+    return finish((float)(acc * ep->scales[row] * ep->x_scale), row, &ep->post);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Scalar                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static void gemv_tile_scalar(const float* weights, size_t cols, size_t rows,
+                             size_t k0, size_t k1, const float* x, float* y,
+                             const Epilogue* ep) {
+    size_t r = 0;
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const float* w0 = weights + (r + 0) * cols;
+        const float* w1 = weights + (r + 1) * cols;
+        const float* w2 = weights + (r + 2) * cols;
+        const float* w3 = weights + (r + 3) * cols;
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (size_t k = k0; k < k1; k++) {
+            float xk = x[k];
+            s0 += w0[k] * xk;
+            s1 += w1[k] * xk;
+            s2 += w2[k] * xk;
+            s3 += w3[k] * xk;
+        }
+        y[r + 0] = finish(y[r + 0] + s0, r + 0, ep);
+        y[r + 1] = finish(y[r + 1] + s1, r + 1, ep);
+        y[r + 2] = finish(y[r + 2] + s2, r + 2, ep);
+        y[r + 3] = finish(y[r + 3] + s3, r + 3, ep);
+    }
+    for (; r < rows; r++) {
+        const float* w = weights + r * cols;
+        float s = 0;
+        for (size_t k = k0; k < k1; k++) {
+            s += w[k] * x[k];
+        }
+        y[r] = finish(y[r] + s, r, ep);
+    }
+}
+
+static void gemv_q8_tile_scalar(const int8_t* q, size_t cols, size_t rows,
+                                size_t k0, size_t k1, const uint8_t* xu, float* y,
+                                const Q8Epilogue* ep) {
+    for (size_t r = 0; r < rows; r++) {
+        const int8_t* w = q + r * cols;
+        int32_t dot = 0;
+        for (size_t k = k0; k < k1; k++) {
+            dot += (int32_t)w[k] * xu[k];
+        }
+        y[r] = finish_q8(y[r], dot, r, ep);
+    }
+}
+
+static inline float f16_to_f32_scalar(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);        // inf / NaN
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;                                        // +/- 0
+    } else {
+        // Subnormal: renormalize into a float32 exponent
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline float bf16_to_f32_scalar(uint16_t h) {
+    uint32_t bits = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+#define DEFINE_HALF_TILE_SCALAR(name, to_f32)                                   \
+static void name(const uint16_t* weights, size_t cols, size_t rows,            \
+                 size_t k0, size_t k1, const float* x, float* y,               \
+                 const Epilogue* ep) {                                         \
+    for (size_t r = 0; r < rows; r++) {                                        \
+        const uint16_t* w = weights + r * cols;                                \
+        float s = 0;                                                           \
+        for (size_t k = k0; k < k1; k++) {                                     \
+            s += to_f32(w[k]) * x[k];                                          \
+        }                                                                      \
+        y[r] = finish(y[r] + s, r, ep);                                        \
+    }                                                                          \
+}
+
+DEFINE_HALF_TILE_SCALAR(gemv_f16_tile_scalar, f16_to_f32_scalar)
+DEFINE_HALF_TILE_SCALAR(gemv_bf16_tile_scalar, bf16_to_f32_scalar)
+
+/* ------------------------------------------------------------------------ */
+/* AVX2 + FMA                                                               */
+/* ------------------------------------------------------------------------ */
+
+#ifdef KERNELS_X86
+__attribute__((target("avx2,fma")))
+static inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+static void gemv_tile_avx2(const float* weights, size_t cols, size_t rows,
+                           size_t k0, size_t k1, const float* x, float* y,
+                           const Epilogue* ep) {
+    size_t len = k1 - k0;
+    size_t vec_end = k0 + (len & ~(size_t)7);
+    size_t r = 0;
+
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const float* w0 = weights + (r + 0) * cols;
+        const float* w1 = weights + (r + 1) * cols;
+        const float* w2 = weights + (r + 2) * cols;
+        const float* w3 = weights + (r + 3) * cols;
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        size_t k = k0;
+        for (; k < vec_end; k += 8) {
+            __m256 xv = _mm256_loadu_ps(x + k);
+            a0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + k), xv, a0);
+            a1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + k), xv, a1);
+            a2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + k), xv, a2);
+            a3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + k), xv, a3);
+        }
+        float s0 = hsum256(a0), s1 = hsum256(a1), s2 = hsum256(a2), s3 = hsum256(a3);
+        for (; k < k1; k++) {
+            float xk = x[k];
+            s0 += w0[k] * xk;
+            s1 += w1[k] * xk;
+            s2 += w2[k] * xk;
+            s3 += w3[k] * xk;
+        }
+        y[r + 0] = finish(y[r + 0] + s0, r + 0, ep);
+        y[r + 1] = finish(y[r + 1] + s1, r + 1, ep);
+        y[r + 2] = finish(y[r + 2] + s2, r + 2, ep);
+        y[r + 3] = finish(y[r + 3] + s3, r + 3, ep);
+    }
+
+    for (; r < rows; r++) {
+        const float* w = weights + r * cols;
+        __m256 a = _mm256_setzero_ps();
+        size_t k = k0;
+        for (; k < vec_end; k += 8) {
+            a = _mm256_fmadd_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(x + k), a);
+        }
+        float s = hsum256(a);
+        for (; k < k1; k++) {
+            s += w[k] * x[k];
+        }
+        y[r] = finish(y[r] + s, r, ep);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline int32_t hsum256_epi32(__m256i v) {
+    __m128i lo = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+    lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(lo);
+}
+
+// pmaddubsw multiplies unsigned activations by signed weights and adds
+// adjacent pairs into int16; 7-bit activations keep that from saturating
+__attribute__((target("avx2")))
+static void gemv_q8_tile_avx2(const int8_t* q, size_t cols, size_t rows,
+                              size_t k0, size_t k1, const uint8_t* xu, float* y,
+                              const Q8Epilogue* ep) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    size_t len = k1 - k0;
+    size_t vec_end = k0 + (len & ~(size_t)31);
+    size_t r = 0;
+
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const int8_t* w0 = q + (r + 0) * cols;
+        const int8_t* w1 = q + (r + 1) * cols;
+        const int8_t* w2 = q + (r + 2) * cols;
+        const int8_t* w3 = q + (r + 3) * cols;
+        __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256(), a3 = _mm256_setzero_si256();
+        size_t k = k0;
+        for (; k < vec_end; k += 32) {
+            __m256i xv = _mm256_loadu_si256((const __m256i*)(xu + k));
+            a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(
+                _mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(w0 + k))), ones));
+            a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(
+                _mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(w1 + k))), ones));
+            a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(
+                _mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(w2 + k))), ones));
+            a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(
+                _mm256_maddubs_epi16(xv, _mm256_loadu_si256((const __m256i*)(w3 + k))), ones));
+        }
+        int32_t d0 = hsum256_epi32(a0), d1 = hsum256_epi32(a1);
+        int32_t d2 = hsum256_epi32(a2), d3 = hsum256_epi32(a3);
+        for (; k < k1; k++) {
+            int32_t xk = xu[k];
+            d0 += w0[k] * xk;
+            d1 += w1[k] * xk;
+            d2 += w2[k] * xk;
+            d3 += w3[k] * xk;
+        }
+        y[r + 0] = finish_q8(y[r + 0], d0, r + 0, ep);
+        y[r + 1] = finish_q8(y[r + 1], d1, r + 1, ep);
+        y[r + 2] = finish_q8(y[r + 2], d2, r + 2, ep);
+        y[r + 3] = finish_q8(y[r + 3], d3, r + 3, ep);
+    }
+
+    for (; r < rows; r++) {
+        const int8_t* w = q + r * cols;
+        __m256i a = _mm256_setzero_si256();
+        size_t k = k0;
+        for (; k < vec_end; k += 32) {
+            a = _mm256_add_epi32(a, _mm256_madd_epi16(_mm256_maddubs_epi16(
+                _mm256_loadu_si256((const __m256i*)(xu + k)),
+                _mm256_loadu_si256((const __m256i*)(w + k))), ones));
+        }
+        int32_t d = hsum256_epi32(a);
+        for (; k < k1; k++) {
+            d += w[k] * (int32_t)xu[k];
+        }
+        y[r] = finish_q8(y[r], d, r, ep);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* AVX-512F                                                                 */
+/* ------------------------------------------------------------------------ */
+
+__attribute__((target("avx512f")))
+static void gemv_tile_avx512(const float* weights, size_t cols, size_t rows,
+                             size_t k0, size_t k1, const float* x, float* y,
+                             const Epilogue* ep) {
+    size_t len = k1 - k0;
+    size_t vec_end = k0 + (len & ~(size_t)15);
+    // The ragged end of each row is handled with a masked load
+    __mmask16 tail = (__mmask16)((1u << (len & 15)) - 1);
+    size_t r = 0;
+
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const float* w0 = weights + (r + 0) * cols;
+        const float* w1 = weights + (r + 1) * cols;
+        const float* w2 = weights + (r + 2) * cols;
+        const float* w3 = weights + (r + 3) * cols;
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+        __m512 a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+        size_t k = k0;
+        for (; k < vec_end; k += 16) {
+            __m512 xv = _mm512_loadu_ps(x + k);
+            a0 = _mm512_fmadd_ps(_mm512_loadu_ps(w0 + k), xv, a0);
+            a1 = _mm512_fmadd_ps(_mm512_loadu_ps(w1 + k), xv, a1);
+            a2 = _mm512_fmadd_ps(_mm512_loadu_ps(w2 + k), xv, a2);
+            a3 = _mm512_fmadd_ps(_mm512_loadu_ps(w3 + k), xv, a3);
+        }
+        if (tail) {
+            __m512 xv = _mm512_maskz_loadu_ps(tail, x + k);
+            a0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w0 + k), xv, a0);
+            a1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w1 + k), xv, a1);
+            a2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w2 + k), xv, a2);
+            a3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w3 + k), xv, a3);
+        }
+        y[r + 0] = finish(y[r + 0] + _mm512_reduce_add_ps(a0), r + 0, ep);
+        y[r + 1] = finish(y[r + 1] + _mm512_reduce_add_ps(a1), r + 1, ep);
+        y[r + 2] = finish(y[r + 2] + _mm512_reduce_add_ps(a2), r + 2, ep);
+        y[r + 3] = finish(y[r + 3] + _mm512_reduce_add_ps(a3), r + 3, ep);
+    }
+
+    for (; r < rows; r++) {
+        const float* w = weights + r * cols;
+        __m512 a = _mm512_setzero_ps();
+        size_t k = k0;
+        for (; k < vec_end; k += 16) {
+            a = _mm512_fmadd_ps(_mm512_loadu_ps(w + k), _mm512_loadu_ps(x + k), a);
+        }
+        if (tail) {
+            a = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, w + k),
+                                _mm512_maskz_loadu_ps(tail, x + k), a);
+        }
+        y[r] = finish(y[r] + _mm512_reduce_add_ps(a), r, ep);
+    }
+}
+
+// vpdpbusd multiplies unsigned activations by signed weights and adds
+// groups of four straight into int32 lanes
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemv_q8_tile_vnni(const int8_t* q, size_t cols, size_t rows,
+                              size_t k0, size_t k1, const uint8_t* xu, float* y,
+                              const Q8Epilogue* ep) {
+    size_t len = k1 - k0;
+    size_t vec_end = k0 + (len & ~(size_t)63);
+    __mmask64 tail = (len & 63) ? (((__mmask64)1 << (len & 63)) - 1) : 0;
+    size_t r = 0;
+
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const int8_t* w0 = q + (r + 0) * cols;
+        const int8_t* w1 = q + (r + 1) * cols;
+        const int8_t* w2 = q + (r + 2) * cols;
+        const int8_t* w3 = q + (r + 3) * cols;
+        __m512i a0 = _mm512_setzero_si512(), a1 = _mm512_setzero_si512();
+        __m512i a2 = _mm512_setzero_si512(), a3 = _mm512_setzero_si512();
+        size_t k = k0;
+        for (; k < vec_end; k += 64) {
+            __m512i xv = _mm512_loadu_si512(xu + k);
+            a0 = _mm512_dpbusd_epi32(a0, xv, _mm512_loadu_si512(w0 + k));
+            a1 = _mm512_dpbusd_epi32(a1, xv, _mm512_loadu_si512(w1 + k));
+            a2 = _mm512_dpbusd_epi32(a2, xv, _mm512_loadu_si512(w2 + k));
+            a3 = _mm512_dpbusd_epi32(a3, xv, _mm512_loadu_si512(w3 + k));
+        }
+        if (tail) {
+            __m512i xv = _mm512_maskz_loadu_epi8(tail, xu + k);
+            a0 = _mm512_dpbusd_epi32(a0, xv, _mm512_maskz_loadu_epi8(tail, w0 + k));
+            a1 = _mm512_dpbusd_epi32(a1, xv, _mm512_maskz_loadu_epi8(tail, w1 + k));
+            a2 = _mm512_dpbusd_epi32(a2, xv, _mm512_maskz_loadu_epi8(tail, w2 + k));
+            a3 = _mm512_dpbusd_epi32(a3, xv, _mm512_maskz_loadu_epi8(tail, w3 + k));
+        }
+        y[r + 0] = finish_q8(y[r + 0], _mm512_reduce_add_epi32(a0), r + 0, ep);
+        y[r + 1] = finish_q8(y[r + 1], _mm512_reduce_add_epi32(a1), r + 1, ep);
+        y[r + 2] = finish_q8(y[r + 2], _mm512_reduce_add_epi32(a2), r + 2, ep);
+        y[r + 3] = finish_q8(y[r + 3], _mm512_reduce_add_epi32(a3), r + 3, ep);
+    }
+
+    for (; r < rows; r++) {
+        const int8_t* w = q + r * cols;
+        __m512i a = _mm512_setzero_si512();
+        size_t k = k0;
+        for (; k < vec_end; k += 64) {
+            a = _mm512_dpbusd_epi32(a, _mm512_loadu_si512(xu + k), _mm512_loadu_si512(w + k));
+        }
+        if (tail) {
+            a = _mm512_dpbusd_epi32(a, _mm512_maskz_loadu_epi8(tail, xu + k),
+                                    _mm512_maskz_loadu_epi8(tail, w + k));
+        }
+        y[r] = finish_q8(y[r], _mm512_reduce_add_epi32(a), r, ep);
+    }
+}
+
+// Half-precision weights are widened to float32 in registers as they are
+// loaded, so only half the bytes cross the memory bus. F16 uses F16C /
+// AVX-512 vcvtph2ps; BF16 is the top half of a float32, so a 16-bit shift
+// widens it exactly.
+#define LOAD8_F16(p)  _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(p)))
+#define LOAD8_BF16(p) _mm256_castsi256_ps(_mm256_slli_epi32( \
+                          _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(p))), 16))
+#define LOAD16_F16(p)  _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(p)))
+#define LOAD16_BF16(p) _mm512_castsi512_ps(_mm512_slli_epi32( \
+                           _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(p))), 16))
+
+#define DEFINE_HALF_TILE_AVX2(name, isa, LOAD8, to_f32)                         \
+__attribute__((target(isa)))                                                   \
+static void name(const uint16_t* weights, size_t cols, size_t rows,            \
+                 size_t k0, size_t k1, const float* x, float* y,               \
+                 const Epilogue* ep) {                                         \
+    size_t vec_end = k0 + ((k1 - k0) & ~(size_t)7);                            \
+    size_t r = 0;                                                              \
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {                            \
+        const uint16_t* w0 = weights + (r + 0) * cols;                         \
+        const uint16_t* w1 = weights + (r + 1) * cols;                         \
+        const uint16_t* w2 = weights + (r + 2) * cols;                         \
+        const uint16_t* w3 = weights + (r + 3) * cols;                         \
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();             \
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();             \
+        size_t k = k0;                                                         \
+        for (; k < vec_end; k += 8) {                                          \
+            __m256 xv = _mm256_loadu_ps(x + k);                                \
+            a0 = _mm256_fmadd_ps(LOAD8(w0 + k), xv, a0);                       \
+            a1 = _mm256_fmadd_ps(LOAD8(w1 + k), xv, a1);                       \
+            a2 = _mm256_fmadd_ps(LOAD8(w2 + k), xv, a2);                       \
+            a3 = _mm256_fmadd_ps(LOAD8(w3 + k), xv, a3);                       \
+        }                                                                      \
+        float s0 = hsum256(a0), s1 = hsum256(a1);                              \
+        float s2 = hsum256(a2), s3 = hsum256(a3);                              \
+        for (; k < k1; k++) {                                                  \
+            s0 += to_f32(w0[k]) * x[k];                                        \
+            s1 += to_f32(w1[k]) * x[k];                                        \
+            s2 += to_f32(w2[k]) * x[k];                                        \
+            s3 += to_f32(w3[k]) * x[k];                                        \
+        }                                                                      \
+        y[r + 0] = finish(y[r + 0] + s0, r + 0, ep);                           \
+        y[r + 1] = finish(y[r + 1] + s1, r + 1, ep);                           \
+        y[r + 2] = finish(y[r + 2] + s2, r + 2, ep);                           \
+        y[r + 3] = finish(y[r + 3] + s3, r + 3, ep);                           \
+    }                                                                          \
+    for (; r < rows; r++) {                                                    \
+        const uint16_t* w = weights + r * cols;                                \
+        __m256 a = _mm256_setzero_ps();                                        \
+        size_t k = k0;                                                         \
+        for (; k < vec_end; k += 8) {                                          \
+            a = _mm256_fmadd_ps(LOAD8(w + k), _mm256_loadu_ps(x + k), a);      \
+        }                                                                      \
+        float s = hsum256(a);                                                  \
+        for (; k < k1; k++) {                                                  \
+            s += to_f32(w[k]) * x[k];                                          \
+        }                                                                      \
+        y[r] = finish(y[r] + s, r, ep);                                        \
+    }                                                                          \
+}
+
+#define DEFINE_HALF_TILE_AVX512(name, LOAD16, to_f32)                          \
+__attribute__((target("avx512f")))                                             \
+static void name(const uint16_t* weights, size_t cols, size_t rows,            \
+                 size_t k0, size_t k1, const float* x, float* y,               \
+                 const Epilogue* ep) {                                         \
+    size_t vec_end = k0 + ((k1 - k0) & ~(size_t)15);                           \
+    size_t r = 0;                                                              \
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {                            \
+        const uint16_t* w0 = weights + (r + 0) * cols;                         \
+        const uint16_t* w1 = weights + (r + 1) * cols;                         \
+        const uint16_t* w2 = weights + (r + 2) * cols;                         \
+        const uint16_t* w3 = weights + (r + 3) * cols;                         \
+        __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();             \
+        __m512 a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();             \
+        size_t k = k0;                                                         \
+        for (; k < vec_end; k += 16) {                                         \
+            __m512 xv = _mm512_loadu_ps(x + k);                                \
+            a0 = _mm512_fmadd_ps(LOAD16(w0 + k), xv, a0);                      \
+            a1 = _mm512_fmadd_ps(LOAD16(w1 + k), xv, a1);                      \
+            a2 = _mm512_fmadd_ps(LOAD16(w2 + k), xv, a2);                      \
+            a3 = _mm512_fmadd_ps(LOAD16(w3 + k), xv, a3);                      \
+        }                                                                      \
+        float s0 = _mm512_reduce_add_ps(a0), s1 = _mm512_reduce_add_ps(a1);    \
+        float s2 = _mm512_reduce_add_ps(a2), s3 = _mm512_reduce_add_ps(a3);    \
+        for (; k < k1; k++) {                                                  \
+            s0 += to_f32(w0[k]) * x[k];                                        \
+            s1 += to_f32(w1[k]) * x[k];                                        \
+            s2 += to_f32(w2[k]) * x[k];                                        \
+            s3 += to_f32(w3[k]) * x[k];                                        \
+        }                                                                      \
+        y[r + 0] = finish(y[r + 0] + s0, r + 0, ep);                           \
+        y[r + 1] = finish(y[r + 1] + s1, r + 1, ep);                           \
+        y[r + 2] = finish(y[r + 2] + s2, r + 2, ep);                           \
+        y[r + 3] = finish(y[r + 3] + s3, r + 3, ep);                           \
+    }                                                                          \
+    for (; r < rows; r++) {                                                    \
+        const uint16_t* w = weights + r * cols;                                \
+        __m512 a = _mm512_setzero_ps();                                        \
+        size_t k = k0;                                                         \
+        for (; k < vec_end; k += 16) {                                         \
+            a = _mm512_fmadd_ps(LOAD16(w + k), _mm512_loadu_ps(x + k), a);     \
+        }                                                                      \
+        float s = _mm512_reduce_add_ps(a);                                     \
+        for (; k < k1; k++) {                                                  \
+            s += to_f32(w[k]) * x[k];                                          \
+        }                                                                      \
+        y[r] = finish(y[r] + s, r, ep);                                        \
+    }                                                                          \
+}
+
+DEFINE_HALF_TILE_AVX2(gemv_f16_tile_avx2, "avx2,fma,f16c", LOAD8_F16, f16_to_f32_scalar)
+DEFINE_HALF_TILE_AVX2(gemv_bf16_tile_avx2, "avx2,fma", LOAD8_BF16, bf16_to_f32_scalar)
+DEFINE_HALF_TILE_AVX512(gemv_f16_tile_avx512, LOAD16_F16, f16_to_f32_scalar)
+DEFINE_HALF_TILE_AVX512(gemv_bf16_tile_avx512, LOAD16_BF16, bf16_to_f32_scalar)
+#endif /* KERNELS_X86 */
+
+/* ------------------------------------------------------------------------ */
+/* NEON                                                                     */
+/* ------------------------------------------------------------------------ */
+
+#ifdef KERNELS_NEON
+static inline float hsum_neon(float32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_f32(v);
+#else
+    float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+}
+
+static void gemv_tile_neon(const float* weights, size_t cols, size_t rows,
+                           size_t k0, size_t k1, const float* x, float* y,
+                           const Epilogue* ep) {
+    size_t len = k1 - k0;
+    size_t vec_end = k0 + (len & ~(size_t)3);
+    size_t r = 0;
+
+    for (; r + ROW_BLOCK <= rows; r += ROW_BLOCK) {
+        const float* w0 = weights + (r + 0) * cols;
+        const float* w1 = weights + (r + 1) * cols;
+        const float* w2 = weights + (r + 2) * cols;
+        const float* w3 = weights + (r + 3) * cols;
+        float32x4_t a0 = vdupq_n_f32(0), a1 = vdupq_n_f32(0);
+        float32x4_t a2 = vdupq_n_f32(0), a3 = vdupq_n_f32(0);
+        size_t k = k0;
+        for (; k < vec_end; k += 4) {
+            float32x4_t xv = vld1q_f32(x + k);
+            a0 = vmlaq_f32(a0, vld1q_f32(w0 + k), xv);
+            a1 = vmlaq_f32(a1, vld1q_f32(w1 + k), xv);
+            a2 = vmlaq_f32(a2, vld1q_f32(w2 + k), xv);
+            a3 = vmlaq_f32(a3, vld1q_f32(w3 + k), xv);
+        }
+        float s0 = hsum_neon(a0), s1 = hsum_neon(a1), s2 = hsum_neon(a2), s3 = hsum_neon(a3);
+        for (; k < k1; k++) {
+            float xk = x[k];
+            s0 += w0[k] * xk;
+            s1 += w1[k] * xk;
+            s2 += w2[k] * xk;
+            s3 += w3[k] * xk;
+        }
+        y[r + 0] = finish(y[r + 0] + s0, r + 0, ep);
+        y[r + 1] = finish(y[r + 1] + s1, r + 1, ep);
+        y[r + 2] = finish(y[r + 2] + s2, r + 2, ep);
+        y[r + 3] = finish(y[r + 3] + s3, r + 3, ep);
+    }
+
+    for (; r < rows; r++) {
+        const float* w = weights + r * cols;
+        float32x4_t a = vdupq_n_f32(0);
+        size_t k = k0;
+        for (; k < vec_end; k += 4) {
+            a = vmlaq_f32(a, vld1q_f32(w + k), vld1q_f32(x + k));
+        }
+        float s = hsum_neon(a);
+        for (; k < k1; k++) {
+            s += w[k] * x[k];
+        }
+        y[r] = finish(y[r] + s, r, ep);
+    }
+}
+#endif /* KERNELS_NEON */
+
+/* ------------------------------------------------------------------------ */
+/* Dispatch                                                                 */
+/* ------------------------------------------------------------------------ */
+
+int kernel_isa_supported(KernelIsa isa) {
+    switch (isa) {
+    case KERNEL_ISA_SCALAR:
+        return 1;
+#ifdef KERNELS_X86
+    case KERNEL_ISA_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case KERNEL_ISA_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef KERNELS_NEON
+    case KERNEL_ISA_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void select_isa(KernelIsa isa) {
+    switch (isa) {
+#ifdef KERNELS_X86
+    case KERNEL_ISA_AVX2:
+        gemv_tile = gemv_tile_avx2;
+        gemv_q8_tile = gemv_q8_tile_avx2;
+        gemv_f16_tile = __builtin_cpu_supports("f16c") ? gemv_f16_tile_avx2 : gemv_f16_tile_scalar;
+        gemv_bf16_tile = gemv_bf16_tile_avx2;
+        break;
+    case KERNEL_ISA_AVX512:
+        gemv_tile = gemv_tile_avx512;
+        // VNNI is a separate extension; older AVX-512 parts fall back to AVX2
+        gemv_q8_tile = __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw") ?
+                       gemv_q8_tile_vnni : gemv_q8_tile_avx2;
+        gemv_f16_tile = gemv_f16_tile_avx512;
+        gemv_bf16_tile = gemv_bf16_tile_avx512;
+        break;
+#endif
+#ifdef KERNELS_NEON
+    case KERNEL_ISA_NEON:
+        gemv_tile = gemv_tile_neon;
+        gemv_q8_tile = gemv_q8_tile_scalar;
+        gemv_f16_tile = gemv_f16_tile_scalar;
+        gemv_bf16_tile = gemv_bf16_tile_scalar;
+        break;
+#endif
+    default:
+        isa = KERNEL_ISA_SCALAR;
+        gemv_tile = gemv_tile_scalar;
+        gemv_q8_tile = gemv_q8_tile_scalar;
+        gemv_f16_tile = gemv_f16_tile_scalar;
+        gemv_bf16_tile = gemv_bf16_tile_scalar;
+        break;
+    }
+    active_isa = isa;
+}
+
+static void init_dispatch(void) {
+    static const KernelIsa preference[] = {
+        KERNEL_ISA_AVX512, KERNEL_ISA_AVX2, KERNEL_ISA_NEON, KERNEL_ISA_SCALAR
+    };
+    for (size_t i = 0; i < sizeof(preference) / sizeof(preference[0]); i++) {
+        if (kernel_isa_supported(preference[i])) {
+            select_isa(preference[i]);
+            return;
+        }
+    }
+}
+
+KernelIsa get_kernel_isa(void) {
+    pthread_once(&dispatch_once, init_dispatch);
+    return active_isa;
+}
+
+int set_kernel_isa(KernelIsa isa) {
+    pthread_once(&dispatch_once, init_dispatch);
+    if (!kernel_isa_supported(isa)) {
+        return -1;
+    }
+    select_isa(isa);
+    return 0;
+}
+
+const char* kernel_isa_name(KernelIsa isa) {
+    switch (isa) {
+    case KERNEL_ISA_AVX2:   return "avx2";
+    case KERNEL_ISA_AVX512: return "avx512";
+    case KERNEL_ISA_NEON:   return "neon";
+    default:                return "scalar";
+    }
+}
+
+static void gemv_run(const float* weights, size_t rows, size_t cols, const float* x,
+                     const Epilogue* ep, float* y) {
+    memset(y, 0, rows * sizeof(float));
+    if (cols == 0) {
+        for (size_t r = 0; r < rows; r++) {
+            y[r] = finish(0, r, ep);
+        }
+        return;
+    }
+    // Walk the columns in tiles so the slice of x stays in L1 while every
+    // row block streams past it
+    for (size_t k0 = 0; k0 < cols; k0 += COL_TILE) {
+        size_t k1 = cols - k0 > COL_TILE ? k0 + COL_TILE : cols;
+        gemv_tile(weights, cols, rows, k0, k1, x, y, k1 == cols ? ep : NULL);
+    }
+}
+
+void gemv_f32(const float* weights, size_t rows, size_t cols, const float* x, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+
+    Epilogue ep = {NULL, ACTIVATION_NONE};
+    gemv_run(weights, rows, cols, x, &ep, y);
+}
+
+void gemv_f32_fused(const float* weights, size_t rows, size_t cols, const float* x,
+                    const float* bias, Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+
+    Epilogue ep = {bias, activation};
+    gemv_run(weights, rows, cols, x, &ep, y);
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        softmax(y, y, rows);
+    }
+}
+
+void gemm_f32_fused(const float* weights, size_t rows, size_t cols,
+                    const float* x, size_t batch, const float* bias,
+                    Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+
+    if (batch == 1 || cols == 0) {
+        for (size_t b = 0; b < batch; b++) {
+            gemv_f32_fused(weights, rows, cols, x + b * cols, bias, activation, y + b * rows);
+        }
+        return;
+    }
+
+    memset(y, 0, batch * rows * sizeof(float));
+    for (size_t k0 = 0; k0 < cols; k0 += GEMM_COL_TILE) {
+        size_t k1 = cols - k0 > GEMM_COL_TILE ? k0 + GEMM_COL_TILE : cols;
+        for (size_t r0 = 0; r0 < rows; r0 += GEMM_ROW_TILE) {
+            size_t panel_rows = rows - r0 > GEMM_ROW_TILE ? GEMM_ROW_TILE : rows - r0;
+            const float* panel = weights + r0 * cols;
+            Epilogue ep = {bias ? bias + r0 : NULL, activation};
+            for (size_t b = 0; b < batch; b++) {
+                gemv_tile(panel, cols, panel_rows, k0, k1, x + b * cols, y + b * rows + r0,
+                          k1 == cols ? &ep : NULL);
+            }
+        }
+    }
+
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        for (size_t b = 0; b < batch; b++) {
+            softmax(y + b * rows, y + b * rows, rows);
+        }
+    }
+}
+
+void gemm_f32(const float* weights, size_t rows, size_t cols,
+              const float* x, size_t batch, float* y) {
+    gemm_f32_fused(weights, rows, cols, x, batch, NULL, ACTIVATION_NONE, y);
+}
+
+void quantize_rows_q8(const float* weights, size_t rows, size_t cols, int8_t* q,
+                      float* scales, int32_t* zero_points, int32_t* row_sums) {
+    for (size_t r = 0; r < rows; r++) {
+        const float* w = weights + r * cols;
+        int8_t* out = q + r * cols;
+
+        // The range always includes zero so that zero stays exact
+        float lo = 0, hi = 0;
+        for (size_t k = 0; k < cols; k++) {
+            lo = w[k] < lo ? w[k] : lo;
+            hi = w[k] > hi ? w[k] : hi;
+        }
+
+        float scale = (hi - lo) / 255.0f;
+        if (scale == 0) {
+            scale = 1.0f;
+        }
+        long zero_point = lrintf(-128.0f - lo / scale);
+        zero_point = zero_point < -128 ? -128 : (zero_point > 127 ? 127 : zero_point);
+
+        int32_t sum = 0;
+        for (size_t k = 0; k < cols; k++) {
+            long v = lrintf(w[k] / scale) + zero_point;
+            v = v < -128 ? -128 : (v > 127 ? 127 : v);
+            out[k] = (int8_t)v;
+            sum += (int32_t)v;
+        }
+        scales[r] = scale;
+        zero_points[r] = (int32_t)zero_point;
+        row_sums[r] = sum;
+    }
+}
+
+void quantize_activations_q7(const float* x, size_t n, uint8_t* xu, float* scale, int32_t* sum) {
+    float amax = 0;
+    for (size_t k = 0; k < n; k++) {
+        float a = fabsf(x[k]);
+        amax = a > amax ? a : amax;
+    }
+
+    float s = amax > 0 ? amax / Q7_MAX : 1.0f;
+    float inv = 1.0f / s;
+    int32_t total = 0;
+    for (size_t k = 0; k < n; k++) {
+        long v = lrintf(x[k] * inv);
+        v = v < -Q7_MAX ? -Q7_MAX : (v > Q7_MAX ? Q7_MAX : v);
+        xu[k] = (uint8_t)(v + Q7_OFFSET);
+        total += (int32_t)v;
+    }
+    *scale = s;
+    *sum = total;
+}
+
+void gemv_q8_fused(const int8_t* q, const float* scales, const int32_t* zero_points,
+                   const int32_t* row_sums, size_t rows, size_t cols,
+                   const uint8_t* xu, float x_scale, int32_t x_sum,
+                   const float* bias, Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+
+    Q8Epilogue ep = {scales, zero_points, row_sums, x_scale, x_sum, {bias, activation}};
+    memset(y, 0, rows * sizeof(float));
+    if (cols == 0) {
+        gemv_q8_tile_scalar(q, cols, rows, 0, 0, xu, y, &ep);
+    }
+    for (size_t k0 = 0; k0 < cols; k0 += Q8_COL_TILE) {
+        size_t k1 = cols - k0 > Q8_COL_TILE ? k0 + Q8_COL_TILE : cols;
+        gemv_q8_tile(q, cols, rows, k0, k1, xu, y, k1 == cols ? &ep : NULL);
+    }
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        softmax(y, y, rows);
+    }
+}
+
+void gemm_q8_fused(const int8_t* q, const float* scales, const int32_t* zero_points,
+                   const int32_t* row_sums, size_t rows, size_t cols,
+                   const uint8_t* xu, const float* x_scales, const int32_t* x_sums,
+                   size_t batch, const float* bias, Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+
+    if (batch == 1 || cols == 0) {
+        for (size_t b = 0; b < batch; b++) {
+            gemv_q8_fused(q, scales, zero_points, row_sums, rows, cols, xu + b * cols,
+                          x_scales[b], x_sums[b], bias, activation, y + b * rows);
+        }
+        return;
+    }
+
+    memset(y, 0, batch * rows * sizeof(float));
+    for (size_t k0 = 0; k0 < cols; k0 += GEMM_Q8_COL_TILE) {
+        size_t k1 = cols - k0 > GEMM_Q8_COL_TILE ? k0 + GEMM_Q8_COL_TILE : cols;
+        for (size_t r0 = 0; r0 < rows; r0 += GEMM_ROW_TILE) {
+            size_t panel_rows = rows - r0 > GEMM_ROW_TILE ? GEMM_ROW_TILE : rows - r0;
+            const int8_t* panel = q + r0 * cols;
+            for (size_t b = 0; b < batch; b++) {
+                Q8Epilogue ep = {scales + r0, zero_points + r0, row_sums + r0,
+                                 x_scales[b], x_sums[b], {bias ? bias + r0 : NULL, activation}};
+                gemv_q8_tile(panel, cols, panel_rows, k0, k1, xu + b * cols, y + b * rows + r0,
+                             k1 == cols ? &ep : NULL);
+            }
+        }
+    }
+
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        for (size_t b = 0; b < batch; b++) {
+            softmax(y + b * rows, y + b * rows, rows);
+        }
+    }
+}
+
+// Round to nearest even, keeping NaNs quiet
+static uint16_t f32_to_f16_scalar(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+    uint32_t abs = bits & 0x7fffffff;
+
+    if (abs >= 0x7f800000) {
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    if (abs >= 0x477ff000) {
+        return sign | 0x7c00;                               // overflows to inf
+    }
+    if (abs < 0x38800000) {
+        // Subnormal or zero in half precision
+        if (abs < 0x33000000) {
+            return sign;
+        }
+        uint32_t exponent = abs >> 23;
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) {
+            half++;
+        }
+        return sign | (uint16_t)half;
+    }
+
+    uint32_t half = ((abs >> 13) - (112 << 10));
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return sign | (uint16_t)half;
+}
+
+static uint16_t f32_to_bf16_scalar(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000) {
+        return (uint16_t)((bits >> 16) | 0x40);             // quiet NaN
+    }
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t)(bits >> 16);
+}
+
+void f32_to_f16(const float* in, uint16_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = f32_to_f16_scalar(in[i]);
+    }
+}
+
+void f16_to_f32(const uint16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = f16_to_f32_scalar(in[i]);
+    }
+}
+
+void f32_to_bf16(const float* in, uint16_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = f32_to_bf16_scalar(in[i]);
+    }
+}
+
+void bf16_to_f32(const uint16_t* in, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = bf16_to_f32_scalar(in[i]);
+    }
+}
+
+static void gemv_half_run(GemvHalfTileFn tile, const uint16_t* weights, size_t rows, size_t cols,
+                          const float* x, const float* bias, Activation activation, float* y) {
+    Epilogue ep = {bias, activation};
+    memset(y, 0, rows * sizeof(float));
+    if (cols == 0) {
+        for (size_t r = 0; r < rows; r++) {
+            y[r] = finish(0, r, &ep);
+        }
+    }
+    for (size_t k0 = 0; k0 < cols; k0 += COL_TILE) {
+        size_t k1 = cols - k0 > COL_TILE ? k0 + COL_TILE : cols;
+        tile(weights, cols, rows, k0, k1, x, y, k1 == cols ? &ep : NULL);
+    }
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        softmax(y, y, rows);
+    }
+}
+
+void gemv_f16_fused(const uint16_t* weights, size_t rows, size_t cols, const float* x,
+                    const float* bias, Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+    gemv_half_run(gemv_f16_tile, weights, rows, cols, x, bias, activation, y);
+}
+
+void gemv_bf16_fused(const uint16_t* weights, size_t rows, size_t cols, const float* x,
+                     const float* bias, Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+    gemv_half_run(gemv_bf16_tile, weights, rows, cols, x, bias, activation, y);
+}
+
+// Each panel is widened to float32 once and then run through the float32
+// tile for every input, rather than widened again per input
+static void gemm_half_run(void (*widen)(const uint16_t*, float*, size_t),
+                          GemvHalfTileFn tile, const uint16_t* weights, size_t rows, size_t cols,
+                          const float* x, size_t batch, const float* bias,
+                          Activation activation, float* y) {
+    if (batch == 1 || cols == 0) {
+        for (size_t b = 0; b < batch; b++) {
+            gemv_half_run(tile, weights, rows, cols, x + b * cols, bias, activation, y + b * rows);
+        }
+        return;
+    }
+
+    float panel[GEMM_ROW_TILE * GEMM_HALF_COL_TILE];
+    memset(y, 0, batch * rows * sizeof(float));
+    for (size_t k0 = 0; k0 < cols; k0 += GEMM_HALF_COL_TILE) {
+        size_t k1 = cols - k0 > GEMM_HALF_COL_TILE ? k0 + GEMM_HALF_COL_TILE : cols;
+        size_t width = k1 - k0;
+        for (size_t r0 = 0; r0 < rows; r0 += GEMM_ROW_TILE) {
+            size_t panel_rows = rows - r0 > GEMM_ROW_TILE ? GEMM_ROW_TILE : rows - r0;
+            for (size_t r = 0; r < panel_rows; r++) {
+                widen(weights + (r0 + r) * cols + k0, panel + r * width, width);
+            }
+            Epilogue ep = {bias ? bias + r0 : NULL, activation};
+            for (size_t b = 0; b < batch; b++) {
+                gemv_tile(panel, width, panel_rows, 0, width, x + b * cols + k0,
+                          y + b * rows + r0, k1 == cols ? &ep : NULL);
+            }
+        }
+    }
+    secure_zero(panel, sizeof(panel));
+
+    if (activation == ACTIVATION_SOFTMAX && rows > 0) {
+        for (size_t b = 0; b < batch; b++) {
+            softmax(y + b * rows, y + b * rows, rows);
+        }
+    }
+}
+
+void gemm_f16_fused(const uint16_t* weights, size_t rows, size_t cols,
+                    const float* x, size_t batch, const float* bias,
+                    Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+    gemm_half_run(f16_to_f32, gemv_f16_tile, weights, rows, cols, x, batch, bias, activation, y);
+}
+
+void gemm_bf16_fused(const uint16_t* weights, size_t rows, size_t cols,
+                     const float* x, size_t batch, const float* bias,
+                     Activation activation, float* y) {
+    pthread_once(&dispatch_once, init_dispatch);
+    gemm_half_run(bf16_to_f32, gemv_bf16_tile, weights, rows, cols, x, batch, bias, activation, y);
+}
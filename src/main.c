@@ -74,57 +74,42 @@ int main(int argc, char* argv[]) {
     printf("Generated random input:\n");
     print_float_array(input, 10, "First 10 elements");  // Print first 10 elements for conciseness
 
-    // Encrypt the input
-    uint8_t* input_bytes;
-    size_t input_bytes_len;
-    if (float_to_byte_array(input, INPUT_SIZE, &input_bytes, &input_bytes_len) != 0) {
-        fprintf(stderr, "Error: %s\n", get_utils_error());
-        secure_free((void**)&input);
-        free_model(model);
-        secure_free((void**)&secret_key);
-        return 1;
-    }
-
+    // Encrypt the input straight from the float array
     uint8_t* encrypted_input;
     size_t encrypted_input_len;
-    if (encrypt(public_key, public_key_len, input_bytes, input_bytes_len, &encrypted_input, &encrypted_input_len) != 0) {
+    if (encrypt_floats(public_key, public_key_len, input, INPUT_SIZE, &encrypted_input, &encrypted_input_len) != 0) {
         fprintf(stderr, "Error: %s\n", get_error());
-        secure_free((void**)&input_bytes);
         secure_free((void**)&input);
         free_model(model);
         secure_free((void**)&secret_key);
         return 1;
     }
 
-    secure_free((void**)&input_bytes);
-
     // Decrypt the input (simulating what would happen on the server)
-    uint8_t* decrypted_input;
-    size_t decrypted_input_len;
-    if (decrypt(secret_key, secret_key_len, encrypted_input, encrypted_input_len, &decrypted_input, &decrypted_input_len) != 0) {
-        fprintf(stderr, "Error: %s\n", get_error());
+    // directly into the buffer inference reads from
+    float* decrypted_input_float = secure_alloc(INPUT_SIZE * sizeof(float));
+    size_t decrypted_input_float_len;
+    if (!decrypted_input_float) {
+        fprintf(stderr, "Error: Unable to allocate memory for decrypted input.\n");
         secure_free((void**)&encrypted_input);
         secure_free((void**)&input);
         free_model(model);
         secure_free((void**)&secret_key);
         return 1;
     }
-
-    secure_free((void**)&encrypted_input);
-
-    // Convert decrypted input back to float array
-    float* decrypted_input_float;
-    size_t decrypted_input_float_len;
-    if (byte_to_float_array(decrypted_input, decrypted_input_len, &decrypted_input_float, &decrypted_input_float_len) != 0) {
-        fprintf(stderr, "Error: %s\n", get_utils_error());
-        secure_free((void**)&decrypted_input);
+    int decrypt_ret = decrypt_floats_into(secret_key, secret_key_len, encrypted_input, encrypted_input_len,
+                                          decrypted_input_float, INPUT_SIZE, &decrypted_input_float_len);
+    if (decrypt_ret != 0 || decrypted_input_float_len != INPUT_SIZE) {
+        fprintf(stderr, "Error: %s\n", decrypt_ret != 0 ? get_error() : "Decrypted input has the wrong size");
+        secure_free((void**)&decrypted_input_float);
+        secure_free((void**)&encrypted_input);
         secure_free((void**)&input);
         free_model(model);
         secure_free((void**)&secret_key);
         return 1;
     }
 
-    secure_free((void**)&decrypted_input);
+    secure_free((void**)&encrypted_input);
 
     // Perform inference
     float* output = secure_realloc(NULL, OUTPUT_SIZE * sizeof(float));
@@ -166,22 +151,10 @@ int main(int argc, char* argv[]) {
     printf("Predicted class: %d (probability: %.4f)\n", max_class, max_prob);
 
     // Encrypt the output (simulating sending the result back to the client)
-    uint8_t* output_bytes;
-    size_t output_bytes_len;
-    if (float_to_byte_array(output, OUTPUT_SIZE, &output_bytes, &output_bytes_len) != 0) {
-        fprintf(stderr, "Error: %s\n", get_utils_error());
-        secure_free((void**)&output);
-        secure_free((void**)&input);
-        free_model(model);
-        secure_free((void**)&secret_key);
-        return 1;
-    }
-
     uint8_t* encrypted_output;
     size_t encrypted_output_len;
-    if (encrypt(public_key, public_key_len, output_bytes, output_bytes_len, &encrypted_output, &encrypted_output_len) != 0) {
+    if (encrypt_floats(public_key, public_key_len, output, OUTPUT_SIZE, &encrypted_output, &encrypted_output_len) != 0) {
         fprintf(stderr, "Error: %s\n", get_error());
-        secure_free((void**)&output_bytes);
         secure_free((void**)&output);
         secure_free((void**)&input);
         free_model(model);
@@ -189,8 +162,6 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    secure_free((void**)&output_bytes);
-
     printf("Encrypted output length: %zu bytes\n", encrypted_output_len);
 
     // Clean up
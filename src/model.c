@@ -1,324 +1,1605 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/model.h"
+#include "../include/error.h"
 #include "../include/encryption.h"
+#include "../include/format.h"
+#include "../include/kernels.h"
+#include "../include/threadpool.h"
+#include "../include/trace.h"
 #include "../include/utils.h"
 
-#define MAX_ERROR_LENGTH 256
+#define WEIGHT_ALIGNMENT 64
+// Minimum multiply-adds per parallel chunk; smaller layers stay on one thread
+#define PARALLEL_MIN_CHUNK_WORK 32768
 
-static char error_message[MAX_ERROR_LENGTH] = {0};
-
-static void set_error(const char* message) {
-    strncpy(error_message, message, MAX_ERROR_LENGTH - 1);
-    error_message[MAX_ERROR_LENGTH - 1] = '\0';
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_MODEL, code, message);
 }
 
 const char* get_model_error(void) {
-    return error_message;
+    return qrme_module_error(QRME_MODULE_MODEL);
 }
 
 Model* create_model(void) {
     Model* model = secure_realloc(NULL, sizeof(Model));
     if (!model) {
-        set_error("Failed to allocate memory for model");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for model");
         return NULL;
     }
     memset(model, 0, sizeof(Model));
-    printf("Debug: Created model at %p\n", (void*)model);
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Created model at %p", (void*)model);
     return model;
 }
 
-int add_layer(Model* model, const float* weights, size_t rows, size_t cols) {
-    if (!model) {
-        set_error("Invalid model pointer");
+// Recompute the execution plan from the current layer chain
+static void compile_execution_plan(Model* model) {
+    ExecutionPlan* plan = &model->plan;
+    memset(plan, 0, sizeof(*plan));
+    if (model->num_layers == 0) {
+        return;
+    }
+
+    plan->input_size = model->layers[0].cols;
+    plan->output_size = model->layers[model->num_layers - 1].rows;
+    plan->valid = 1;
+    for (size_t i = 0; i + 1 < model->num_layers; i++) {
+        if (model->layers[i].rows != model->layers[i + 1].cols) {
+            plan->valid = 0;
+        }
+        if (model->layers[i].rows > plan->max_hidden_width) {
+            plan->max_hidden_width = model->layers[i].rows;
+        }
+    }
+}
+
+// Per-row metadata of an INT8 layer: scale, zero point and row sum
+#define INT8_ROW_META_BYTES (sizeof(float) + 2 * sizeof(int32_t))
+
+// Pointers into a layer's plaintext, laid out as described for LayerDType
+typedef struct {
+    const float* weights;       // F32 only
+    const int8_t* q;            // INT8 only
+    const uint16_t* halves;     // F16 and BF16 only
+    const float* scales;
+    const int32_t* zero_points;
+    const int32_t* row_sums;
+    const float* bias;
+} LayerView;
+
+// Size of a layer's plaintext in its storage layout
+static size_t layer_data_bytes(const Layer* layer) {
+    size_t bias_bytes = layer->has_bias ? layer->rows * sizeof(float) : 0;
+    if (layer->dtype == LAYER_DTYPE_INT8) {
+        return layer->rows * INT8_ROW_META_BYTES + bias_bytes + layer->rows * layer->cols;
+    }
+    if (layer->dtype == LAYER_DTYPE_F16 || layer->dtype == LAYER_DTYPE_BF16) {
+        return bias_bytes + layer->rows * layer->cols * sizeof(uint16_t);
+    }
+    return layer->rows * layer->cols * sizeof(float) + bias_bytes;
+}
+
+static LayerView layer_view(const Layer* layer, const void* data) {
+    LayerView view = {0};
+    if (!data) {
+        return view;
+    }
+    if (layer->dtype == LAYER_DTYPE_INT8) {
+        const uint8_t* p = data;
+        view.scales = (const float*)p;
+        view.zero_points = (const int32_t*)(p + layer->rows * sizeof(float));
+        view.row_sums = view.zero_points + layer->rows;
+        p += layer->rows * INT8_ROW_META_BYTES;
+        if (layer->has_bias) {
+            view.bias = (const float*)p;
+            p += layer->rows * sizeof(float);
+        }
+        view.q = (const int8_t*)p;
+    } else if (layer->dtype == LAYER_DTYPE_F16 || layer->dtype == LAYER_DTYPE_BF16) {
+        // Bias first keeps it 4-byte aligned ahead of the 2-byte weights
+        const uint8_t* p = data;
+        if (layer->has_bias) {
+            view.bias = (const float*)p;
+            p += layer->rows * sizeof(float);
+        }
+        view.halves = (const uint16_t*)p;
+    } else {
+        view.weights = data;
+        view.bias = layer->has_bias ? view.weights + layer->rows * layer->cols : NULL;
+    }
+    return view;
+}
+
+// Copy a layer's shape and epilogue from its table of contents entry
+static void init_layer_from_entry(Layer* layer, const LayerEntry* entry) {
+    layer->rows = (size_t)entry->rows;
+    layer->cols = (size_t)entry->cols;
+    layer->has_bias = (entry->flags & MODEL_LAYER_FLAG_HAS_BIAS) != 0;
+    layer->activation = (Activation)entry->activation;
+    layer->dtype = (LayerDType)entry->dtype;
+}
+
+// Point the typed views at the resident plaintext
+static void attach_layer_views(Layer* layer) {
+    LayerView view = layer_view(layer, layer->data);
+    layer->weights = (float*)view.weights;
+    layer->bias = (float*)view.bias;
+}
+
+// Grow the layer table to hold at least count layers
+static int reserve_layers(Model* model, size_t count) {
+    if (count <= model->layer_capacity) {
+        return 0;
+    }
+
+    size_t capacity = model->layer_capacity ? model->layer_capacity : 4;
+    while (capacity < count) {
+        if (capacity > SIZE_MAX / 2 / sizeof(Layer)) {
+            set_error(QRME_ERR_OUT_OF_MEMORY, "Too many layers");
+            return -1;
+        }
+        capacity *= 2;
+    }
+
+    Layer* layers = realloc(model->layers, capacity * sizeof(Layer));
+    if (!layers) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for layer table");
         return -1;
     }
-    if (model->num_layers >= MAX_LAYERS) {
-        set_error("Maximum number of layers reached");
+    memset(layers + model->layer_capacity, 0, (capacity - model->layer_capacity) * sizeof(Layer));
+    model->layers = layers;
+    model->layer_capacity = capacity;
+    return 0;
+}
+
+// Size the layer table for a model file and copy each layer's shape
+static int init_layers_from_index(Model* model, const ModelIndex* index) {
+    if (reserve_layers(model, index->num_layers) != 0) {
         return -1;
     }
+    model->num_layers = index->num_layers;
+    for (size_t i = 0; i < index->num_layers; i++) {
+        init_layer_from_entry(&model->layers[i], &index->layers[i]);
+    }
+    return 0;
+}
 
-    Layer* layer = &model->layers[model->num_layers];
-    layer->weights = secure_realloc(NULL, rows * cols * sizeof(float));
-    if (!layer->weights) {
-        set_error("Failed to allocate memory for layer weights");
+// Place every layer's plaintext in one slab, in order and each on a cache
+// line boundary, so a loaded model streams through memory front to back
+static int allocate_layer_slab(Model* model) {
+    size_t total = 0;
+    for (size_t i = 0; i < model->num_layers; i++) {
+        size_t bytes = layer_data_bytes(&model->layers[i]);
+        if (bytes > SIZE_MAX - total - WEIGHT_ALIGNMENT) {
+            set_error(QRME_ERR_FORMAT, "Model weights too large");
+            return -1;
+        }
+        total = (total + bytes + WEIGHT_ALIGNMENT - 1) & ~(size_t)(WEIGHT_ALIGNMENT - 1);
+    }
+
+    // Prefer locked, unswappable memory; fall back to the heap if no
+    // mapping can be made
+    void* slab = NULL;
+    model->arena = create_secure_arena(total);
+    if (model->arena) {
+        slab = secure_arena_alloc(model->arena, total);
+    } else if (posix_memalign(&slab, WEIGHT_ALIGNMENT, total ? total : WEIGHT_ALIGNMENT) != 0) {
+        slab = NULL;
+    }
+    if (!slab) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for layer weights");
         return -1;
     }
+    model->slab = slab;
+    model->slab_bytes = total;
+
+    size_t offset = 0;
+    for (size_t i = 0; i < model->num_layers; i++) {
+        Layer* layer = &model->layers[i];
+        layer->data = (uint8_t*)slab + offset;
+        layer->in_slab = 1;
+        layer->is_secure_allocated = 0;
+        attach_layer_views(layer);
+        offset = (offset + layer_data_bytes(layer) + WEIGHT_ALIGNMENT - 1) &
+                 ~(size_t)(WEIGHT_ALIGNMENT - 1);
+    }
+    return 0;
+}
 
-    memcpy(layer->weights, weights, rows * cols * sizeof(float));
+// Drop a layer's resident plaintext; slab-backed data is wiped and left
+// for free_model() to release with the slab
+static void free_layer_data(Layer* layer) {
+    if (layer->data) {
+        if (layer->in_slab) {
+            secure_zero(layer->data, layer_data_bytes(layer));
+        } else if (layer->is_secure_allocated) {
+            secure_free(&layer->data);
+        } else {
+            secure_zero(layer->data, layer_data_bytes(layer));
+            free(layer->data);
+        }
+    }
+    layer->data = NULL;
+    layer->in_slab = 0;
+    attach_layer_views(layer);
+}
+
+int add_layer(Model* model, const float* weights, size_t rows, size_t cols) {
+    return add_layer_ex(model, weights, NULL, rows, cols, ACTIVATION_RELU);
+}
+
+int add_layer_ex(Model* model, const float* weights, const float* bias,
+                 size_t rows, size_t cols, Activation activation) {
+    if (!model || !weights) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid model pointer");
+        return -1;
+    }
+    if (model->lazy) {
+        set_error(QRME_ERR_UNSUPPORTED, "Cannot add layers to a lazily loaded model");
+        return -1;
+    }
+    if ((unsigned)activation >= ACTIVATION_COUNT) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid activation");
+        return -1;
+    }
+    if (reserve_layers(model, model->num_layers + 1) != 0) {
+        return -1;
+    }
+
+    Layer* layer = &model->layers[model->num_layers];
     layer->rows = rows;
     layer->cols = cols;
+    layer->has_bias = bias != NULL;
+    layer->activation = activation;
+    layer->dtype = LAYER_DTYPE_F32;
+    layer->data = secure_realloc(NULL, layer_data_bytes(layer));
+    if (!layer->data) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for layer weights");
+        memset(layer, 0, sizeof(*layer));
+        return -1;
+    }
+
+    memcpy(layer->data, weights, rows * cols * sizeof(float));
+    if (bias) {
+        memcpy((float*)layer->data + rows * cols, bias, rows * sizeof(float));
+    }
+    attach_layer_views(layer);
     layer->is_secure_allocated = 1;
     model->num_layers++;
+    compile_execution_plan(model);
 
-    printf("Debug: Added layer %zu to model at %p, weights at %p\n",
-           model->num_layers - 1, (void*)model, (void*)layer->weights);
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Added layer %zu to model at %p, weights at %p",
+                model->num_layers - 1, (void*)model, layer->data);
     return 0;
 }
 
 int save_model(const Model* model, const char* filename, const uint8_t* public_key, size_t public_key_len) {
     if (!model || !filename || !public_key) {
-        set_error("Invalid parameters for save_model");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for save_model");
         return -1;
     }
 
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        set_error("Failed to open file for writing");
+    ModelWriter* writer = begin_model_file(filename, model->num_layers, public_key, public_key_len);
+    if (!writer) {
+        set_error(qrme_last_error(), get_format_error());
         return -1;
     }
 
-    // Write number of layers
-    fwrite(&model->num_layers, sizeof(size_t), 1, file);
-
     // Write each layer
     for (size_t i = 0; i < model->num_layers; i++) {
         const Layer* layer = &model->layers[i];
-        fwrite(&layer->rows, sizeof(size_t), 1, file);
-        fwrite(&layer->cols, sizeof(size_t), 1, file);
 
         // Encrypt weights
+        const void* weights = acquire_layer_data(model, i);
         uint8_t* encrypted_weights;
         size_t encrypted_weights_len;
-        if (encrypt(public_key, public_key_len, (uint8_t*)layer->weights,
-                    layer->rows * layer->cols * sizeof(float),
-                    &encrypted_weights, &encrypted_weights_len) != 0) {
-            set_error("Failed to encrypt layer weights");
-            fclose(file);
+        int encrypted = weights &&
+            encrypt(public_key, public_key_len, (const uint8_t*)weights,
+                    layer_data_bytes(layer),
+                    &encrypted_weights, &encrypted_weights_len) == 0;
+        release_layer_weights(model, i);
+        if (!encrypted) {
+            set_error(qrme_last_error(), "Failed to encrypt layer weights");
+            abort_model_file(writer);
             return -1;
         }
 
-        // Write encrypted weights
-        fwrite(&encrypted_weights_len, sizeof(size_t), 1, file);
-        fwrite(encrypted_weights, 1, encrypted_weights_len, file);
+        int written = write_model_layer(writer, layer->rows, layer->cols, layer->dtype,
+                                        layer->has_bias ? MODEL_LAYER_FLAG_HAS_BIAS : 0,
+                                        layer->activation, encrypted_weights, encrypted_weights_len);
         secure_free((void**)&encrypted_weights);
+        if (written != 0) {
+            set_error(qrme_last_error(), get_format_error());
+            abort_model_file(writer);
+            return -1;
+        }
+    }
+
+    // Write the header and table of contents
+    if (finish_model_file(writer) != 0) {
+        set_error(qrme_last_error(), get_format_error());
+        return -1;
     }
+    return 0;
+}
+
+typedef struct SaveState SaveState;
 
-    // Write public key
-    fwrite(&public_key_len, sizeof(size_t), 1, file);
-    fwrite(public_key, 1, public_key_len, file);
+typedef struct {
+    SaveState* state;
+    const Model* model;
+    size_t index;
+    uint8_t* encrypted_weights;
+    size_t encrypted_weights_len;
+    int status;                 // 0 = pending, 1 = done, -1 = failed
+    QrmeErrorCode error;        // the worker's error code when status is -1
+} SaveJob;
+
+struct SaveState {
+    const uint8_t* public_key;
+    size_t public_key_len;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+};
+
+static void encrypt_layer_task(void* arg) {
+    SaveJob* job = arg;
+    const Layer* layer = &job->model->layers[job->index];
+    const void* weights = acquire_layer_data(job->model, job->index);
+    int status = weights &&
+        encrypt(job->state->public_key, job->state->public_key_len,
+                (const uint8_t*)weights, layer_data_bytes(layer),
+                &job->encrypted_weights, &job->encrypted_weights_len) == 0 ? 1 : -1;
+    release_layer_weights(job->model, job->index);
+    QrmeErrorCode error = status == 1 ? QRME_OK : qrme_last_error();
+
+    pthread_mutex_lock(&job->state->lock);
+    job->error = error;
+    job->status = status;
+    pthread_cond_broadcast(&job->state->job_done);
+    pthread_mutex_unlock(&job->state->lock);
+}
+
+int save_model_parallel(const Model* model, const char* filename,
+                        const uint8_t* public_key, size_t public_key_len,
+                        size_t num_threads) {
+    if (!model || !filename || !public_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for save_model_parallel");
+        return -1;
+    }
+
+    num_threads = resolve_thread_count(num_threads);
+    if (num_threads == 1 || model->num_layers <= 1) {
+        return save_model(model, filename, public_key, public_key_len);
+    }
+
+    SaveState state = {public_key, public_key_len,
+                       PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    SaveJob* jobs = calloc(model->num_layers, sizeof(SaveJob));
+    ThreadPool* pool = NULL;
+    ModelWriter* writer = NULL;
+    // Keep a bounded number of encrypted layers in flight so peak memory
+    // does not grow with the model
+    size_t window = 2 * num_threads;
+    size_t submitted = 0;
+    int ret = -1;
+
+    if (!jobs) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for save jobs");
+        return -1;
+    }
+
+    pool = create_thread_pool(num_threads);
+    if (!pool) {
+        set_error(QRME_ERR_RESOURCE, "Failed to create thread pool");
+        goto cleanup;
+    }
+
+    writer = begin_model_file(filename, model->num_layers, public_key, public_key_len);
+    if (!writer) {
+        set_error(qrme_last_error(), get_format_error());
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < model->num_layers; i++) {
+        jobs[i].state = &state;
+        jobs[i].model = model;
+        jobs[i].index = i;
+    }
+
+    // Layers are encrypted out of order but written strictly in order, so
+    // the file layout is exactly that of save_model()
+    for (size_t i = 0; i < model->num_layers; i++) {
+        while (submitted < model->num_layers && submitted < i + window) {
+            if (thread_pool_submit(pool, encrypt_layer_task, &jobs[submitted]) != 0) {
+                set_error(QRME_ERR_RESOURCE, "Failed to queue layer encryption");
+                goto cleanup;
+            }
+            submitted++;
+        }
+
+        pthread_mutex_lock(&state.lock);
+        while (jobs[i].status == 0) {
+            pthread_cond_wait(&state.job_done, &state.lock);
+        }
+        pthread_mutex_unlock(&state.lock);
+
+        if (jobs[i].status != 1) {
+            set_error(jobs[i].error, "Failed to encrypt layer weights");
+            goto cleanup;
+        }
+
+        const Layer* layer = &model->layers[i];
+        if (write_model_layer(writer, layer->rows, layer->cols, layer->dtype,
+                              layer->has_bias ? MODEL_LAYER_FLAG_HAS_BIAS : 0, layer->activation,
+                              jobs[i].encrypted_weights, jobs[i].encrypted_weights_len) != 0) {
+            set_error(qrme_last_error(), get_format_error());
+            goto cleanup;
+        }
+        secure_free((void**)&jobs[i].encrypted_weights);
+    }
+
+    ret = finish_model_file(writer);
+    writer = NULL;
+    if (ret != 0) {
+        set_error(qrme_last_error(), get_format_error());
+    }
 
+cleanup:
+    // Let in-flight encryptions finish before their buffers are released
+    thread_pool_wait(pool);
+    free_thread_pool(pool);
+    abort_model_file(writer);
+    for (size_t i = 0; i < submitted; i++) {
+        if (jobs[i].status == 1 && jobs[i].encrypted_weights) {
+            secure_free((void**)&jobs[i].encrypted_weights);
+        }
+    }
+    free(jobs);
+    pthread_mutex_destroy(&state.lock);
+    pthread_cond_destroy(&state.job_done);
+    return ret;
+}
+
+// Open a model file and read its layer index, checking that every layer
+// has a supported layout and that its blob decrypts to exactly its size
+static FILE* open_model_file(const char* filename, ModelIndex* index) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        set_error(QRME_ERR_IO, "Failed to open file for reading");
+        return NULL;
+    }
+
+    if (read_model_index(file, index) != 0) {
+        set_error(qrme_last_error(), get_format_error());
+        fclose(file);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < index->num_layers; i++) {
+        const LayerEntry* entry = &index->layers[i];
+        if (entry->dtype != MODEL_DTYPE_F32 && entry->dtype != MODEL_DTYPE_INT8 &&
+            entry->dtype != MODEL_DTYPE_F16 && entry->dtype != MODEL_DTYPE_BF16) {
+            set_error(QRME_ERR_UNSUPPORTED, "Unsupported layer dtype");
+            goto fail;
+        }
+        if (entry->activation >= ACTIVATION_COUNT) {
+            set_error(QRME_ERR_UNSUPPORTED, "Unsupported layer activation");
+            goto fail;
+        }
+        // Bounds the float32 layout, which is the largest
+        if (entry->cols >= SIZE_MAX / sizeof(float) - 16 ||
+            (entry->rows != 0 && entry->cols + 16 > SIZE_MAX / sizeof(float) / entry->rows)) {
+            set_error(QRME_ERR_FORMAT, "Invalid layer dimensions");
+            goto fail;
+        }
+        Layer shape = {0};
+        init_layer_from_entry(&shape, entry);
+        if (decrypted_size(entry->length) != layer_data_bytes(&shape)) {
+            set_error(QRME_ERR_FORMAT, "Decrypted weights size mismatch");
+            goto fail;
+        }
+    }
+    return file;
+
+fail:
+    free_model_index(index);
     fclose(file);
+    return NULL;
+}
+
+static int read_public_key(FILE* file, const ModelIndex* index, Model* model) {
+    size_t public_key_len = (size_t)index->public_key_len;
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Public key length: %zu", public_key_len);
+
+    model->public_key = secure_realloc(NULL, public_key_len);
+    if (!model->public_key) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for public key");
+        return -1;
+    }
+
+    if (fseek(file, (long)index->public_key_offset, SEEK_SET) != 0 ||
+        fread(model->public_key, 1, public_key_len, file) != public_key_len) {
+        set_error(QRME_ERR_IO, "Failed to read public key");
+        return -1;
+    }
+    model->public_key_len = public_key_len;
     return 0;
 }
 
+static uint8_t* read_layer_blob(FILE* file, const LayerEntry* entry) {
+    uint8_t* blob = secure_realloc(NULL, (size_t)entry->length);
+    if (!blob) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for encrypted weights");
+        return NULL;
+    }
+
+    if (fseek(file, (long)entry->offset, SEEK_SET) != 0 ||
+        fread(blob, 1, (size_t)entry->length, file) != entry->length) {
+        set_error(QRME_ERR_IO, "Failed to read encrypted weights");
+        secure_free((void**)&blob);
+        return NULL;
+    }
+    return blob;
+}
+
 Model* load_model(const char* filename, const uint8_t* secret_key, size_t secret_key_len) {
     if (!filename || !secret_key) {
-        set_error("Invalid parameters for load_model");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for load_model");
         return NULL;
     }
 
-    FILE* file = fopen(filename, "rb");
+    ModelIndex index;
+    FILE* file = open_model_file(filename, &index);
     if (!file) {
-        set_error("Failed to open file for reading");
         return NULL;
     }
 
     Model* model = create_model();
     if (!model) {
+        free_model_index(&index);
         fclose(file);
         return NULL;
     }
 
-    printf("Debug: Created model at %p during load_model\n", (void*)model);
-    printf("Debug: Secret key length: %zu\n", secret_key_len);
-    printf("Debug: Reading number of layers\n");
-    if (fread(&model->num_layers, sizeof(size_t), 1, file) != 1) {
-        set_error("Failed to read number of layers");
-        free_model(model);
-        fclose(file);
-        return NULL;
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Created model at %p during load_model", (void*)model);
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Model format version %u with %zu layers", index.version, index.num_layers);
+    if (init_layers_from_index(model, &index) != 0 || allocate_layer_slab(model) != 0) {
+        goto fail;
     }
-    printf("Debug: Number of layers: %zu\n", model->num_layers);
 
     for (size_t i = 0; i < model->num_layers; i++) {
+        const LayerEntry* entry = &index.layers[i];
         Layer* layer = &model->layers[i];
-        printf("Debug: Reading layer %zu dimensions\n", i);
-        if (fread(&layer->rows, sizeof(size_t), 1, file) != 1 ||
-            fread(&layer->cols, sizeof(size_t), 1, file) != 1) {
-            set_error("Failed to read layer dimensions");
-            free_model(model);
-            fclose(file);
-            return NULL;
-        }
-        printf("Debug: Layer %zu dimensions: %zu x %zu\n", i, layer->rows, layer->cols);
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Layer %zu dimensions: %zu x %zu", i, layer->rows, layer->cols);
 
-        size_t encrypted_weights_len;
-        printf("Debug: Reading encrypted weights length for layer %zu\n", i);
-        if (fread(&encrypted_weights_len, sizeof(size_t), 1, file) != 1) {
-            set_error("Failed to read encrypted weights length");
-            free_model(model);
-            fclose(file);
-            return NULL;
-        }
-        printf("Debug: Encrypted weights length for layer %zu: %zu\n", i, encrypted_weights_len);
-
-        uint8_t* encrypted_weights = secure_realloc(NULL, encrypted_weights_len);
+        uint8_t* encrypted_weights = read_layer_blob(file, entry);
         if (!encrypted_weights) {
-            set_error("Failed to allocate memory for encrypted weights");
-            free_model(model);
-            fclose(file);
-            return NULL;
-        }
-
-        printf("Debug: Reading encrypted weights for layer %zu\n", i);
-        if (fread(encrypted_weights, 1, encrypted_weights_len, file) != encrypted_weights_len) {
-            set_error("Failed to read encrypted weights");
-            secure_free((void**)&encrypted_weights);
-            free_model(model);
-            fclose(file);
-            return NULL;
+            goto fail;
         }
 
-        uint8_t* decrypted_weights;
         size_t decrypted_weights_len;
-        printf("Debug: Decrypting weights for layer %zu (encrypted_weights_len: %zu)\n", i, encrypted_weights_len);
-        if (decrypt(secret_key, secret_key_len, encrypted_weights, encrypted_weights_len,
-                    &decrypted_weights, &decrypted_weights_len) != 0) {
-            set_error("Failed to decrypt layer weights");
-            printf("Debug: Decryption error: %s\n", get_error());
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Decrypting weights for layer %zu (encrypted_weights_len: %zu)", i, (size_t)entry->length);
+        if (decrypt_into(secret_key, secret_key_len, encrypted_weights, (size_t)entry->length,
+                         layer->data, layer_data_bytes(layer), &decrypted_weights_len) != 0) {
+            set_error(qrme_last_error(), "Failed to decrypt layer weights");
+            TRACE_ERROR(TRACE_CAT_MODEL, "Decryption error: %s", get_error());
             secure_free((void**)&encrypted_weights);
-            free_model(model);
-            fclose(file);
-            return NULL;
+            goto fail;
         }
         secure_free((void**)&encrypted_weights);
+    }
 
-        printf("Debug: Decrypted weights length for layer %zu: %zu\n", i, decrypted_weights_len);
-        if (decrypted_weights_len != layer->rows * layer->cols * sizeof(float)) {
-            set_error("Decrypted weights size mismatch");
-            secure_free((void**)&decrypted_weights);
-            free_model(model);
-            fclose(file);
-            return NULL;
+    // Read public key
+    if (read_public_key(file, &index, model) != 0) {
+        goto fail;
+    }
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Public key loaded successfully");
+
+    free_model_index(&index);
+    fclose(file);
+    compile_execution_plan(model);
+    TRACE_DEBUG(TRACE_CAT_MODEL, "Model loaded and decrypted successfully");
+    return model;
+
+fail:
+    free_model(model);
+    free_model_index(&index);
+    fclose(file);
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    const uint8_t* secret_key;
+    size_t secret_key_len;
+    pthread_mutex_t lock;
+    pthread_cond_t job_done;
+    size_t in_flight;
+    int failed;
+    QrmeErrorCode error;        // the code of the first failure
+    double decrypt_seconds;
+} LoadState;
+
+typedef struct {
+    LoadState* state;
+    Layer* layer;
+    uint8_t* encrypted_weights;
+    size_t encrypted_weights_len;
+} LoadJob;
+
+static void decrypt_layer_task(void* arg) {
+    LoadJob* job = arg;
+    Layer* layer = job->layer;
+    size_t decrypted_weights_len = 0;
+    double start = now_seconds();
+    // Each worker decrypts straight into its layer's place in the slab
+    int ok = decrypt_into(job->state->secret_key, job->state->secret_key_len,
+                          job->encrypted_weights, job->encrypted_weights_len,
+                          layer->data, layer_data_bytes(layer), &decrypted_weights_len) == 0;
+
+    QrmeErrorCode error = ok ? QRME_OK : qrme_last_error();
+    secure_free((void**)&job->encrypted_weights);
+    double elapsed = now_seconds() - start;
+
+    pthread_mutex_lock(&job->state->lock);
+    job->state->in_flight--;
+    job->state->decrypt_seconds += elapsed;
+    if (!ok && !job->state->failed) {
+        job->state->failed = 1;
+        job->state->error = error;
+    }
+    pthread_cond_broadcast(&job->state->job_done);
+    pthread_mutex_unlock(&job->state->lock);
+}
+
+Model* load_model_parallel(const char* filename, const uint8_t* secret_key, size_t secret_key_len,
+                           size_t num_threads, LoadStats* stats) {
+    if (!filename || !secret_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for load_model_parallel");
+        return NULL;
+    }
+
+    LoadState state = {secret_key, secret_key_len,
+                       PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, QRME_OK, 0.0};
+    LoadJob* jobs = NULL;
+    ModelIndex index;
+    ThreadPool* pool = NULL;
+    Model* model = NULL;
+    double start = now_seconds();
+    double io_seconds = 0.0;
+    double io_start;
+    size_t bytes_read = 0;
+    size_t window;
+    int ok = 0;
+
+    num_threads = resolve_thread_count(num_threads);
+    // Bound the number of ciphertexts held in memory while workers catch up
+    window = 2 * num_threads;
+
+    io_start = now_seconds();
+    FILE* file = open_model_file(filename, &index);
+    if (!file) {
+        return NULL;
+    }
+    io_seconds += now_seconds() - io_start;
+
+    model = create_model();
+    pool = create_thread_pool(num_threads);
+    jobs = calloc(index.num_layers ? index.num_layers : 1, sizeof(LoadJob));
+    if (!model || !pool || !jobs) {
+        if (!pool) set_error(QRME_ERR_RESOURCE, "Failed to create thread pool");
+        else if (!jobs) set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for load jobs");
+        goto cleanup;
+    }
+    if (init_layers_from_index(model, &index) != 0 || allocate_layer_slab(model) != 0) {
+        goto cleanup;
+    }
+
+    // I/O stage: read each encrypted layer in file order and hand it to the
+    // decrypt workers as soon as it is in memory
+    for (size_t i = 0; i < model->num_layers; i++) {
+        const LayerEntry* entry = &index.layers[i];
+        Layer* layer = &model->layers[i];
+        LoadJob* job = &jobs[i];
+        job->state = &state;
+        job->layer = layer;
+
+        pthread_mutex_lock(&state.lock);
+        while (state.in_flight >= window && !state.failed) {
+            pthread_cond_wait(&state.job_done, &state.lock);
         }
+        int failed = state.failed;
+        pthread_mutex_unlock(&state.lock);
+        if (failed) {
+            set_error(state.error, "Failed to decrypt layer weights");
+            goto cleanup;
+        }
+
+        io_start = now_seconds();
+        job->encrypted_weights = read_layer_blob(file, entry);
+        if (!job->encrypted_weights) {
+            goto cleanup;
+        }
+        job->encrypted_weights_len = (size_t)entry->length;
+        io_seconds += now_seconds() - io_start;
+        bytes_read += job->encrypted_weights_len;
+
+        pthread_mutex_lock(&state.lock);
+        state.in_flight++;
+        pthread_mutex_unlock(&state.lock);
+        if (thread_pool_submit(pool, decrypt_layer_task, job) != 0) {
+            set_error(QRME_ERR_RESOURCE, "Failed to queue layer decryption");
+            pthread_mutex_lock(&state.lock);
+            state.in_flight--;
+            pthread_mutex_unlock(&state.lock);
+            secure_free((void**)&job->encrypted_weights);
+            goto cleanup;
+        }
+    }
 
-        layer->weights = (float*)decrypted_weights;
-        layer->is_secure_allocated = 1;
+    io_start = now_seconds();
+    if (read_public_key(file, &index, model) != 0) {
+        goto cleanup;
     }
+    io_seconds += now_seconds() - io_start;
+    bytes_read += model->public_key_len;
 
-    // Read public key
-    size_t public_key_len;
-    if (fread(&public_key_len, sizeof(size_t), 1, file) != 1) {
-        set_error("Failed to read public key length");
+    ok = 1;
+
+cleanup:
+    // Layers are assembled in place by the workers; wait for the stragglers
+    thread_pool_wait(pool);
+    free_thread_pool(pool);
+    free(jobs);
+    if (ok && state.failed) {
+        set_error(state.error, "Failed to decrypt layer weights");
+        ok = 0;
+    }
+    if (!ok) {
         free_model(model);
-        fclose(file);
+        model = NULL;
+    }
+    free_model_index(&index);
+    fclose(file);
+
+    if (stats) {
+        stats->io_seconds = io_seconds;
+        stats->decrypt_seconds = state.decrypt_seconds;
+        stats->total_seconds = now_seconds() - start;
+        stats->bytes_read = bytes_read;
+        stats->num_threads = num_threads;
+    }
+
+    pthread_mutex_destroy(&state.lock);
+    pthread_cond_destroy(&state.job_done);
+    if (model) {
+        compile_execution_plan(model);
+    }
+    return model;
+}
+
+Model* load_model_mmap(const char* filename, const uint8_t* secret_key, size_t secret_key_len) {
+    if (!filename || !secret_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for load_model_mmap");
         return NULL;
     }
-    printf("Debug: Public key length: %zu\n", public_key_len);
 
-    model->public_key = secure_realloc(NULL, public_key_len);
+    // The index reader has already checked that every blob and the public
+    // key lie inside the file, so the mapping can be indexed directly
+    ModelIndex index;
+    FILE* file = open_model_file(filename, &index);
+    if (!file) {
+        return NULL;
+    }
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    }
+    fclose(file);
+    if (map == MAP_FAILED) {
+        set_error(QRME_ERR_IO, "Failed to map model file");
+        free_model_index(&index);
+        return NULL;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    const uint8_t* data = map;
+    Model* model = create_model();
+    int ok = 0;
+    if (!model || init_layers_from_index(model, &index) != 0 || allocate_layer_slab(model) != 0) {
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < model->num_layers; i++) {
+        const LayerEntry* entry = &index.layers[i];
+        Layer* layer = &model->layers[i];
+
+        // Decrypt straight from the mapping into the layer's cache-line
+        // aligned place in the slab; no ciphertext copy is ever made
+        size_t decrypted_weights_len;
+        if (decrypt_into(secret_key, secret_key_len, data + entry->offset, (size_t)entry->length,
+                         layer->data, layer_data_bytes(layer), &decrypted_weights_len) != 0) {
+            set_error(qrme_last_error(), "Failed to decrypt layer weights");
+            goto cleanup;
+        }
+    }
+
+    model->public_key = secure_realloc(NULL, (size_t)index.public_key_len);
     if (!model->public_key) {
-        set_error("Failed to allocate memory for public key");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for public key");
+        goto cleanup;
+    }
+    memcpy(model->public_key, data + index.public_key_offset, (size_t)index.public_key_len);
+    model->public_key_len = (size_t)index.public_key_len;
+
+    compile_execution_plan(model);
+    ok = 1;
+
+cleanup:
+    munmap(map, (size_t)st.st_size);
+    free_model_index(&index);
+    if (!ok) {
         free_model(model);
-        fclose(file);
         return NULL;
     }
+    return model;
+}
 
-    if (fread(model->public_key, 1, public_key_len, file) != public_key_len) {
-        set_error("Failed to read public key");
-        free_model(model);
-        fclose(file);
+typedef struct {
+    void* data;
+    size_t pins;
+    uint64_t last_used;
+    int loading;
+    int in_arena;               // holds [offset, offset + span) of the arena, loaded or not
+    size_t offset;
+} LazySlot;
+
+struct LazyLayerStore {
+    int fd;
+    uint8_t* secret_key;        // from the shared key arena
+    size_t secret_key_len;
+    SecureArena* arena;         // backs the slots, or NULL if they are on the heap
+    uint8_t* arena_base;
+    size_t arena_bytes;
+    LayerEntry* entries;
+    LazySlot* slots;
+    size_t num_layers;
+    size_t memory_budget;
+    size_t resident_bytes;
+    uint64_t clock;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+};
+
+
+// Bytes a layer takes in the slot arena, keeping every slot cache aligned
+static size_t lazy_span(const Model* model, size_t index) {
+    return (layer_data_bytes(&model->layers[index]) + WEIGHT_ALIGNMENT - 1) &
+           ~(size_t)(WEIGHT_ALIGNMENT - 1);
+}
+
+// Find room for a layer in the slot arena, first fit, or fall back to the
+// heap when the arena is too fragmented or pinned layers overrun the
+// budget. Called with the store lock held.
+static void* lazy_reserve(LazyLayerStore* store, const Model* model, size_t index) {
+    size_t span = lazy_span(model, index);
+    size_t start = 0;
+    while (store->arena && start <= store->arena_bytes && span <= store->arena_bytes - start) {
+        size_t next = start;
+        for (size_t i = 0; i < store->num_layers; i++) {
+            const LazySlot* other = &store->slots[i];
+            size_t end = other->offset + lazy_span(model, i);
+            if (other->in_arena && other->offset < start + span && start < end && end > next) {
+                next = end;
+            }
+        }
+        if (next == start) {
+            store->slots[index].in_arena = 1;
+            store->slots[index].offset = start;
+            return store->arena_base + start;
+        }
+        start = next;
+    }
+    return secure_alloc(layer_data_bytes(&model->layers[index]));
+}
+
+// Wipe a layer's plaintext and give its space back. Called with the store
+// lock held.
+static void lazy_release(LazyLayerStore* store, const Model* model, size_t index, void* data) {
+    LazySlot* slot = &store->slots[index];
+    if (slot->in_arena) {
+        secure_zero(data, layer_data_bytes(&model->layers[index]));
+        slot->in_arena = 0;
+    } else {
+        secure_free(&data);
+    }
+}
+
+// Evict unpinned layers, least recently used first, until `incoming` more
+// bytes fit in the budget. Called with the store lock held.
+static void lazy_evict(LazyLayerStore* store, const Model* model, size_t incoming) {
+    if (store->memory_budget == 0) {
+        return;
+    }
+    while (store->resident_bytes + incoming > store->memory_budget) {
+        size_t victim = SIZE_MAX;
+        for (size_t i = 0; i < store->num_layers; i++) {
+            const LazySlot* slot = &store->slots[i];
+            if (slot->data && slot->pins == 0 &&
+                (victim == SIZE_MAX || slot->last_used < store->slots[victim].last_used)) {
+                victim = i;
+            }
+        }
+        if (victim == SIZE_MAX) {
+            return;  // everything resident is in use; the budget is soft
+        }
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Evicting lazy layer %zu", victim);
+        lazy_release(store, model, victim, store->slots[victim].data);
+        store->slots[victim].data = NULL;
+        store->resident_bytes -= layer_data_bytes(&model->layers[victim]);
+    }
+}
+
+static int lazy_decrypt_layer(const LazyLayerStore* store, size_t index, void* data, size_t bytes) {
+    const LayerEntry* entry = &store->entries[index];
+    size_t decrypted_weights_len;
+    int result = -1;
+    uint8_t* blob = secure_realloc(NULL, (size_t)entry->length);
+    if (!blob) {
+        return -1;
+    }
+
+    if (pread(store->fd, blob, (size_t)entry->length, (off_t)entry->offset) != (ssize_t)entry->length) {
+        set_error(QRME_ERR_IO, "Failed to read layer weights");
+    } else if (decrypt_into(store->secret_key, store->secret_key_len, blob, (size_t)entry->length,
+                            data, bytes, &decrypted_weights_len) == 0) {
+        result = 0;
+    }
+    secure_free((void**)&blob);
+    return result;
+}
+
+const void* acquire_layer_data(const Model* model, size_t index) {
+    if (!model || index >= model->num_layers) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid layer index");
         return NULL;
     }
-    model->public_key_len = public_key_len;
-    printf("Debug: Public key loaded successfully\n");
 
+    LazyLayerStore* store = model->lazy;
+    if (!store) {
+        return model->layers[index].data;
+    }
+
+    LazySlot* slot = &store->slots[index];
+    pthread_mutex_lock(&store->lock);
+    // Another thread may already be decrypting this layer
+    while (slot->loading) {
+        pthread_cond_wait(&store->loaded, &store->lock);
+    }
+    slot->pins++;
+    slot->last_used = ++store->clock;
+
+    if (!slot->data) {
+        size_t bytes = layer_data_bytes(&model->layers[index]);
+        lazy_evict(store, model, bytes);
+        void* data = lazy_reserve(store, model, index);
+        slot->loading = 1;
+        pthread_mutex_unlock(&store->lock);
+
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Decrypting lazy layer %zu", index);
+        int ok = data && lazy_decrypt_layer(store, index, data, bytes) == 0;
+
+        pthread_mutex_lock(&store->lock);
+        slot->loading = 0;
+        if (ok) {
+            slot->data = data;
+            store->resident_bytes += bytes;
+        } else {
+            if (data) {
+                lazy_release(store, model, index, data);
+            }
+            slot->pins--;
+        }
+        pthread_cond_broadcast(&store->loaded);
+    }
+
+    void* data = slot->data;
+    pthread_mutex_unlock(&store->lock);
+
+    if (!data) {
+        set_error(qrme_last_error(), "Failed to decrypt layer weights");
+    }
+    return data;
+}
+
+const float* acquire_layer_weights(const Model* model, size_t index) {
+    if (model && index < model->num_layers && model->layers[index].dtype != LAYER_DTYPE_F32) {
+        set_error(QRME_ERR_UNSUPPORTED, "Layer is not stored as float32");
+        return NULL;
+    }
+    return acquire_layer_data(model, index);
+}
+
+void release_layer_weights(const Model* model, size_t index) {
+    if (!model || !model->lazy || index >= model->num_layers) {
+        return;
+    }
+
+    LazyLayerStore* store = model->lazy;
+    pthread_mutex_lock(&store->lock);
+    if (store->slots[index].pins > 0) {
+        store->slots[index].pins--;
+    }
+    lazy_evict(store, model, 0);
+    pthread_mutex_unlock(&store->lock);
+}
+
+int convert_layer(Model* model, size_t index, LayerDType dtype) {
+    if (!model || index >= model->num_layers) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid layer index");
+        return -1;
+    }
+    if (model->lazy) {
+        set_error(QRME_ERR_UNSUPPORTED, "Cannot convert layers of a lazily loaded model");
+        return -1;
+    }
+    if (dtype != LAYER_DTYPE_F32 && dtype != LAYER_DTYPE_INT8 &&
+        dtype != LAYER_DTYPE_F16 && dtype != LAYER_DTYPE_BF16) {
+        set_error(QRME_ERR_UNSUPPORTED, "Unsupported layer dtype");
+        return -1;
+    }
+
+    Layer* layer = &model->layers[index];
+    if (layer->dtype == dtype) {
+        return 0;
+    }
+
+    Layer converted = *layer;
+    converted.dtype = dtype;
+    converted.in_slab = 0;
+    converted.data = secure_realloc(NULL, layer_data_bytes(&converted));
+    if (!converted.data) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for converted layer");
+        return -1;
+    }
+    converted.is_secure_allocated = 1;
+
+    LayerView from = layer_view(layer, layer->data);
+    LayerView to = layer_view(&converted, converted.data);
+    size_t rows = layer->rows, cols = layer->cols;
+
+    // Go through float32 unless one side already is float32
+    float* weights = (float*)from.weights;
+    if (layer->dtype != LAYER_DTYPE_F32) {
+        weights = dtype == LAYER_DTYPE_F32 ? (float*)to.weights :
+                  secure_realloc(NULL, rows * cols * sizeof(float));
+        if (!weights) {
+            set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for converted layer");
+            secure_free(&converted.data);
+            return -1;
+        }
+        if (layer->dtype == LAYER_DTYPE_INT8) {
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t k = 0; k < cols; k++) {
+                    weights[r * cols + k] = from.scales[r] *
+                        (float)(from.q[r * cols + k] - from.zero_points[r]);
+                }
+            }
+        } else if (layer->dtype == LAYER_DTYPE_F16) {
+            f16_to_f32(from.halves, weights, rows * cols);
+        } else {
+            bf16_to_f32(from.halves, weights, rows * cols);
+        }
+    }
+
+    if (dtype == LAYER_DTYPE_INT8) {
+        quantize_rows_q8(weights, rows, cols, (int8_t*)to.q, (float*)to.scales,
+                         (int32_t*)to.zero_points, (int32_t*)to.row_sums);
+    } else if (dtype == LAYER_DTYPE_F16) {
+        f32_to_f16(weights, (uint16_t*)to.halves, rows * cols);
+    } else if (dtype == LAYER_DTYPE_BF16) {
+        f32_to_bf16(weights, (uint16_t*)to.halves, rows * cols);
+    }
+    if (weights != from.weights && weights != to.weights) {
+        secure_zero(weights, rows * cols * sizeof(float));
+        secure_free((void**)&weights);
+    }
+    if (layer->has_bias) {
+        memcpy((float*)to.bias, from.bias, rows * sizeof(float));
+    }
+
+    free_layer_data(layer);
+    *layer = converted;
+    attach_layer_views(layer);
+    return 0;
+}
+
+size_t get_model_resident_bytes(const Model* model) {
+    size_t total = 0;
+    if (!model) {
+        return 0;
+    }
+    if (model->lazy) {
+        pthread_mutex_lock(&model->lazy->lock);
+        total = model->lazy->resident_bytes;
+        pthread_mutex_unlock(&model->lazy->lock);
+        return total;
+    }
+    for (size_t i = 0; i < model->num_layers; i++) {
+        if (model->layers[i].data) {
+            total += layer_data_bytes(&model->layers[i]);
+        }
+    }
+    return total;
+}
+
+static void free_lazy_store(LazyLayerStore* store) {
+    if (!store) {
+        return;
+    }
+    for (size_t i = 0; i < store->num_layers; i++) {
+        if (store->slots && store->slots[i].data && !store->slots[i].in_arena) {
+            secure_free((void**)&store->slots[i].data);
+        }
+    }
+    free_secure_arena(store->arena);
+    secure_key_free((void**)&store->secret_key, store->secret_key_len);
+    if (store->fd >= 0) close(store->fd);
+    free(store->entries);
+    free(store->slots);
+    pthread_mutex_destroy(&store->lock);
+    pthread_cond_destroy(&store->loaded);
+    free(store);
+}
+
+Model* load_model_lazy(const char* filename, const uint8_t* secret_key, size_t secret_key_len,
+                       size_t memory_budget) {
+    if (!filename || !secret_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for load_model_lazy");
+        return NULL;
+    }
+
+    ModelIndex index;
+    FILE* file = open_model_file(filename, &index);
+    if (!file) {
+        return NULL;
+    }
+
+    Model* model = create_model();
+    LazyLayerStore* store = calloc(1, sizeof(LazyLayerStore));
+    if (!model || !store) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for lazy model");
+        free(store);
+        goto fail;
+    }
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->loaded, NULL);
+    store->fd = -1;
+    model->lazy = store;
+
+    // Only the index and public key are read now; layers are decrypted by
+    // acquire_layer_weights() when first needed
+    if (init_layers_from_index(model, &index) != 0) {
+        goto fail;
+    }
+    store->num_layers = index.num_layers;
+    store->memory_budget = memory_budget;
+    store->entries = index.layers;
+    index.layers = NULL;
+    store->slots = calloc(index.num_layers ? index.num_layers : 1, sizeof(LazySlot));
+    // The key is held for the model's lifetime, so keep it in locked memory
+    store->secret_key = secure_key_alloc(secret_key_len);
+    store->secret_key_len = secret_key_len;
+    store->fd = dup(fileno(file));
+    if (!store->slots || !store->secret_key || store->fd < 0) {
+        set_error(QRME_ERR_RESOURCE, "Failed to set up lazy layer store");
+        goto fail;
+    }
+    memcpy(store->secret_key, secret_key, secret_key_len);
+
+    // Decrypted layers go to one locked arena sized for the budget, or for
+    // the whole model without one; the heap takes over if it cannot be mapped
+    size_t total = 0, largest = 0;
+    for (size_t i = 0; i < store->num_layers; i++) {
+        size_t span = lazy_span(model, i);
+        if (span > SIZE_MAX - total) {
+            set_error(QRME_ERR_FORMAT, "Model weights too large");
+            goto fail;
+        }
+        total += span;
+        largest = span > largest ? span : largest;
+    }
+    if (memory_budget > 0 && memory_budget < total) {
+        total = memory_budget > largest ? memory_budget : largest;
+    }
+    if (total > 0) {
+        store->arena = create_secure_arena(total);
+        store->arena_bytes = secure_arena_capacity(store->arena);
+        store->arena_base = store->arena ? secure_arena_alloc(store->arena, store->arena_bytes) : NULL;
+        if (!store->arena_base) {
+            store->arena_bytes = 0;
+        }
+    }
+
+    compile_execution_plan(model);
+
+    if (read_public_key(file, &index, model) != 0) {
+        goto fail;
+    }
+
+    free_model_index(&index);
     fclose(file);
-    printf("Debug: Model loaded and decrypted successfully\n");
     return model;
+
+fail:
+    free_model(model);
+    free_model_index(&index);
+    fclose(file);
+    return NULL;
 }
 
-int inference(const Model* model, const float* input, size_t input_size,
-              float* output, size_t output_size) {
+struct InferenceWorkspace {
+    float* buffers[2];          // ping-pong activations for hidden layers
+    size_t capacity;            // floats per buffer
+    uint8_t* quantized;         // layer input quantized for INT8 layers
+    size_t quantized_capacity;
+};
+
+typedef struct {
+    LayerDType dtype;
+    LayerView view;
+    size_t cols;
+    Activation activation;      // element-wise only; softmax is applied after the barrier
+    const float* input;
+    const uint8_t* quantized_input;
+    float x_scale;
+    int32_t x_sum;
+    float* output;
+} RowRangeJob;
+
+static void row_range_task(void* arg, size_t begin, size_t end) {
+    RowRangeJob* job = arg;
+    const LayerView* v = &job->view;
+    const float* bias = v->bias ? v->bias + begin : NULL;
+
+    if (job->dtype == LAYER_DTYPE_INT8) {
+        gemv_q8_fused(v->q + begin * job->cols, v->scales + begin, v->zero_points + begin,
+                      v->row_sums + begin, end - begin, job->cols, job->quantized_input,
+                      job->x_scale, job->x_sum, bias, job->activation, job->output + begin);
+    } else if (job->dtype == LAYER_DTYPE_F16) {
+        gemv_f16_fused(v->halves + begin * job->cols, end - begin, job->cols, job->input,
+                       bias, job->activation, job->output + begin);
+    } else if (job->dtype == LAYER_DTYPE_BF16) {
+        gemv_bf16_fused(v->halves + begin * job->cols, end - begin, job->cols, job->input,
+                        bias, job->activation, job->output + begin);
+    } else {
+        gemv_f32_fused(v->weights + begin * job->cols, end - begin, job->cols, job->input,
+                       bias, job->activation, job->output + begin);
+    }
+}
+
+static int check_inference_args(const Model* model, const float* input, size_t input_size,
+                                const float* output, size_t output_size) {
     if (!model || !input || !output) {
-        set_error("Invalid parameters for inference");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for inference");
         return -1;
     }
 
-    printf("Debug: Model public key length: %zu\n", model->public_key_len);
-    printf("Debug: Model has %zu layers\n", model->num_layers);
-    printf("Debug: Input size: %zu, Expected input size: %zu\n", input_size, model->layers[0].cols);
-    printf("Debug: Output size: %zu, Expected output size: %zu\n", output_size, model->layers[model->num_layers - 1].rows);
-
     if (model->num_layers == 0) {
-        set_error("Model has no layers");
+        set_error(QRME_ERR_STATE, "Model has no layers");
         return -1;
     }
 
-    if (input_size != model->layers[0].cols) {
-        set_error("Input size mismatch");
+    if (!model->plan.valid) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Layer input size does not match previous layer output");
         return -1;
     }
 
-    if (output_size != model->layers[model->num_layers - 1].rows) {
-        set_error("Output size mismatch");
+    if (input_size != model->plan.input_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Input size mismatch");
         return -1;
     }
 
-    float* temp_input = secure_realloc(NULL, input_size * sizeof(float));
-    float* temp_output = secure_realloc(NULL, output_size * sizeof(float));
-    if (!temp_input || !temp_output) {
-        set_error("Failed to allocate memory for temporary buffers");
-        secure_free((void**)&temp_input);
-        secure_free((void**)&temp_output);
+    if (output_size != model->plan.output_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Output size mismatch");
         return -1;
     }
 
-    memcpy(temp_input, input, input_size * sizeof(float));
+    return 0;
+}
+
+// Run every layer, reading the first from input and writing the last
+// straight into output, so only hidden activations touch the workspace
+static int run_layers(const Model* model, ThreadPool* pool, InferenceWorkspace* ws,
+                      const float* input, float* output) {
+    const float* current = input;
 
     for (size_t i = 0; i < model->num_layers; i++) {
         const Layer* layer = &model->layers[i];
-        printf("Debug: Processing layer %zu (%zu x %zu)\n", i, layer->rows, layer->cols);
+        float* next = (i + 1 == model->num_layers) ? output : ws->buffers[i % 2];
 
-        for (size_t j = 0; j < layer->rows; j++) {
-            float sum = 0;
-            for (size_t k = 0; k < layer->cols; k++) {
-                sum += layer->weights[j * layer->cols + k] * temp_input[k];
-            }
-            temp_output[j] = (sum > 0) ? sum : 0;  // ReLU activation
+        const void* data = acquire_layer_data(model, i);
+        if (!data) {
+            return -1;
+        }
+
+        int softmax_after = layer->activation == ACTIVATION_SOFTMAX;
+        RowRangeJob job = {layer->dtype, layer_view(layer, data), layer->cols,
+                           softmax_after ? ACTIVATION_NONE : layer->activation,
+                           current, ws->quantized, 0, 0, next};
+        if (layer->dtype == LAYER_DTYPE_INT8) {
+            // Quantize the input once; every row range shares it
+            quantize_activations_q7(current, layer->cols, ws->quantized, &job.x_scale, &job.x_sum);
         }
+        if (pool) {
+            size_t grain = layer->cols > 0 ? PARALLEL_MIN_CHUNK_WORK / layer->cols : layer->rows;
+            // Round up to the kernel's 4-row block
+            grain = (grain + 3) & ~(size_t)3;
+            thread_pool_parallel_for(pool, layer->rows, grain, row_range_task, &job);
+        } else {
+            row_range_task(&job, 0, layer->rows);
+        }
+        release_layer_weights(model, i);
 
-        // Print intermediate results for debugging
-        printf("Debug: Layer %zu output:\n", i);
-        print_float_array(temp_output, layer->rows, "Layer output");
+        if (softmax_after && layer->rows > 0) {
+            softmax(next, next, layer->rows);
+        }
 
-        memcpy(temp_input, temp_output, layer->rows * sizeof(float));
+        current = next;
     }
 
-    memcpy(output, temp_output, output_size * sizeof(float));
+    return 0;
+}
+
+InferenceWorkspace* create_inference_workspace(const Model* model) {
+    if (!model) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for inference workspace");
+        return NULL;
+    }
+
+    InferenceWorkspace* ws = calloc(1, sizeof(InferenceWorkspace));
+    if (!ws) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate inference workspace");
+        return NULL;
+    }
 
-    secure_free((void**)&temp_input);
-    secure_free((void**)&temp_output);
+    ws->capacity = model->plan.max_hidden_width;
+    size_t bytes = ws->capacity > 0 ? ws->capacity * sizeof(float) : WEIGHT_ALIGNMENT;
+    for (int i = 0; i < 2; i++) {
+        if (posix_memalign((void**)&ws->buffers[i], WEIGHT_ALIGNMENT, bytes) != 0) {
+            ws->buffers[i] = NULL;
+            set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate inference workspace buffers");
+            free_inference_workspace(ws);
+            return NULL;
+        }
+    }
+
+    // Any layer may be converted to INT8 later, so always size this for
+    // the widest layer input
+    ws->quantized_capacity = model->plan.input_size > ws->capacity ?
+                             model->plan.input_size : ws->capacity;
+    ws->quantized = malloc(ws->quantized_capacity ? ws->quantized_capacity : 1);
+    if (!ws->quantized) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate inference workspace buffers");
+        free_inference_workspace(ws);
+        return NULL;
+    }
+
+    return ws;
+}
+
+void free_inference_workspace(InferenceWorkspace* ws) {
+    if (!ws) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (ws->buffers[i]) {
+            secure_zero(ws->buffers[i], ws->capacity * sizeof(float));
+            free(ws->buffers[i]);
+        }
+    }
+    if (ws->quantized) {
+        secure_zero(ws->quantized, ws->quantized_capacity);
+        free(ws->quantized);
+    }
+    free(ws);
+}
 
+static int check_workspace(const Model* model, const InferenceWorkspace* ws) {
+    if (!ws || ws->capacity < model->plan.max_hidden_width ||
+        ws->quantized_capacity < model->plan.input_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Inference workspace is too small for the model");
+        return -1;
+    }
     return 0;
 }
 
+int inference_ws(const Model* model, InferenceWorkspace* ws, const float* input,
+                 size_t input_size, float* output, size_t output_size) {
+    if (check_inference_args(model, input, input_size, output, output_size) != 0 ||
+        check_workspace(model, ws) != 0) {
+        return -1;
+    }
+
+    return run_layers(model, NULL, ws, input, output);
+}
+
+int inference(const Model* model, const float* input, size_t input_size,
+              float* output, size_t output_size) {
+    if (check_inference_args(model, input, input_size, output, output_size) != 0) {
+        return -1;
+    }
+
+    InferenceWorkspace* ws = create_inference_workspace(model);
+    if (!ws) {
+        return -1;
+    }
+
+    int result = run_layers(model, NULL, ws, input, output);
+    free_inference_workspace(ws);
+    return result;
+}
+
+int inference_batch(const Model* model, const float* inputs, size_t batch_size,
+                    size_t input_size, float* outputs, size_t output_size) {
+    if (check_inference_args(model, inputs, input_size, outputs, output_size) != 0) {
+        return -1;
+    }
+
+    if (batch_size == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for batched inference");
+        return -1;
+    }
+
+    size_t max_width = model->plan.max_hidden_width > input_size ?
+                       model->plan.max_hidden_width : input_size;
+    if (output_size > max_width) {
+        max_width = output_size;
+    }
+
+    if (max_width > SIZE_MAX / sizeof(float) / batch_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Batch too large");
+        return -1;
+    }
+
+    size_t buffer_bytes = batch_size * max_width * sizeof(float);
+    float* current = secure_realloc(NULL, buffer_bytes);
+    float* next = secure_realloc(NULL, buffer_bytes);
+    uint8_t* quantized = secure_realloc(NULL, batch_size * max_width);
+    float* x_scales = secure_realloc(NULL, batch_size * sizeof(float));
+    int32_t* x_sums = secure_realloc(NULL, batch_size * sizeof(int32_t));
+    int result = -1;
+    if (!current || !next || !quantized || !x_scales || !x_sums) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for batch buffers");
+        goto cleanup;
+    }
+
+    memcpy(current, inputs, batch_size * input_size * sizeof(float));
+
+    for (size_t i = 0; i < model->num_layers; i++) {
+        const Layer* layer = &model->layers[i];
+
+        const void* data = acquire_layer_data(model, i);
+        if (!data) {
+            goto cleanup;
+        }
+
+        LayerView view = layer_view(layer, data);
+        if (layer->dtype == LAYER_DTYPE_INT8) {
+            for (size_t b = 0; b < batch_size; b++) {
+                quantize_activations_q7(current + b * layer->cols, layer->cols,
+                                        quantized + b * layer->cols, &x_scales[b], &x_sums[b]);
+            }
+            gemm_q8_fused(view.q, view.scales, view.zero_points, view.row_sums,
+                          layer->rows, layer->cols, quantized, x_scales, x_sums, batch_size,
+                          view.bias, layer->activation, next);
+        } else if (layer->dtype == LAYER_DTYPE_F16) {
+            gemm_f16_fused(view.halves, layer->rows, layer->cols, current, batch_size,
+                           view.bias, layer->activation, next);
+        } else if (layer->dtype == LAYER_DTYPE_BF16) {
+            gemm_bf16_fused(view.halves, layer->rows, layer->cols, current, batch_size,
+                            view.bias, layer->activation, next);
+        } else {
+            gemm_f32_fused(view.weights, layer->rows, layer->cols, current, batch_size,
+                           view.bias, layer->activation, next);
+        }
+        release_layer_weights(model, i);
+
+        float* swap = current;
+        current = next;
+        next = swap;
+    }
+
+    memcpy(outputs, current, batch_size * output_size * sizeof(float));
+    result = 0;
+
+cleanup:
+    secure_free((void**)&current);
+    secure_free((void**)&next);
+    secure_free((void**)&quantized);
+    secure_free((void**)&x_scales);
+    secure_free((void**)&x_sums);
+
+    return result;
+}
+
+int inference_parallel(const Model* model, ThreadPool* pool, const float* input,
+                       size_t input_size, float* output, size_t output_size) {
+    if (check_inference_args(model, input, input_size, output, output_size) != 0) {
+        return -1;
+    }
+
+    InferenceWorkspace* ws = create_inference_workspace(model);
+    if (!ws) {
+        return -1;
+    }
+
+    int result = run_layers(model, pool, ws, input, output);
+    free_inference_workspace(ws);
+    return result;
+}
+
+int inference_parallel_ws(const Model* model, ThreadPool* pool, InferenceWorkspace* ws,
+                          const float* input, size_t input_size,
+                          float* output, size_t output_size) {
+    if (check_inference_args(model, input, input_size, output, output_size) != 0 ||
+        check_workspace(model, ws) != 0) {
+        return -1;
+    }
+
+    return run_layers(model, pool, ws, input, output);
+}
+
 void free_model(Model* model) {
     if (model) {
-        printf("Debug: Freeing model at %p\n", (void*)model);
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Freeing model at %p", (void*)model);
         for (size_t i = 0; i < model->num_layers; i++) {
-            if (model->layers[i].is_secure_allocated) {
-                printf("Debug: Freeing layer %zu weights at %p\n", i, (void*)model->layers[i].weights);
-                secure_free((void**)&model->layers[i].weights);
+            Layer* layer = &model->layers[i];
+            TRACE_DEBUG(TRACE_CAT_MODEL, "Freeing layer %zu weights at %p", i, layer->data);
+            if (layer->in_slab) {
+                // Wiped below along with the rest of the slab
+                layer->data = NULL;
+                layer->in_slab = 0;
+                attach_layer_views(layer);
             } else {
-                printf("Debug: Freeing layer %zu weights at %p (non-secure)\n", i, (void*)model->layers[i].weights);
-                free(model->layers[i].weights);
+                free_layer_data(layer);
             }
         }
+        if (model->arena) {
+            free_secure_arena(model->arena);
+        } else if (model->slab) {
+            secure_zero(model->slab, model->slab_bytes);
+            free(model->slab);
+        }
+        free(model->layers);
+        free_lazy_store(model->lazy);
         if (model->public_key) {
-            printf("Debug: Freeing public key at %p\n", (void*)model->public_key);
+            TRACE_DEBUG(TRACE_CAT_MODEL, "Freeing public key at %p", (void*)model->public_key);
             secure_free((void**)&model->public_key);
         }
         secure_free((void**)&model);
-        printf("Debug: Model freed\n");
+        TRACE_DEBUG(TRACE_CAT_MODEL, "Model freed");
     }
 }
 
 int get_model_public_key(const Model* model, const uint8_t** public_key, size_t* public_key_len) {
     if (!model || !public_key || !public_key_len) {
-        set_error("Invalid parameters for get_model_public_key");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for get_model_public_key");
         return -1;
     }
 
@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../include/pipeline.h"
+#include "../include/encryption.h"
+#include "../include/error.h"
+#include "../include/secure_arena.h"
+#include "../include/threadpool.h"
+#include "../include/trace.h"
+#include "../include/utils.h"
+
+#define DEFAULT_DECRYPT_THREADS 2
+#define DEFAULT_INFER_THREADS 1
+#define DEFAULT_ENCRYPT_THREADS 2
+#define DEFAULT_MAX_IN_FLIGHT 64
+// Empty polls before a consumer blocks on the queue's condition variable
+#define POP_SPINS 64
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_PIPELINE, code, message);
+}
+
+const char* get_pipeline_error(void) {
+    return qrme_module_error(QRME_MODULE_PIPELINE);
+}
+
+typedef struct {
+    uint64_t sequence;
+    void* user_data;
+    const uint8_t* request;     // borrowed from the submitter
+    size_t request_len;
+    float* input;               // input_size floats, decrypted in place
+    float* output;              // output_size floats
+    uint8_t* response;
+    size_t response_len;
+    uint64_t enqueued_ns;       // when the item entered its current queue
+    QrmeErrorCode status;
+    char message[256];
+} PipelineItem;
+
+// Bounded multi-producer multi-consumer queue (Vyukov). Each cell's
+// sequence says whether it is ready for the push at that position or for
+// the pop, so producers and consumers only contend on head or tail.
+// Consumers that find the queue empty spin briefly, then sleep on the
+// condition variable; producers take the lock only when someone sleeps.
+typedef struct {
+    size_t sequence;
+    PipelineItem* item;
+} QueueCell;
+
+typedef struct {
+    QueueCell* cells;
+    size_t mask;
+    char pad0[64];
+    size_t head;                // next position to pop
+    char pad1[64];
+    size_t tail;                // next position to push
+    char pad2[64];
+    uint64_t peak_depth;
+    unsigned waiters;           // consumers asleep or about to sleep
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+} ItemQueue;
+
+typedef struct {
+    uint64_t processed;
+    uint64_t failed;
+    uint64_t total_wait_ns;
+    uint64_t total_service_ns;
+    uint64_t max_wait_ns;
+    uint64_t max_service_ns;
+} StageCounters;
+
+typedef struct {
+    ItemQueue queue;            // requests waiting for this stage
+    ThreadPool* pool;
+    size_t num_workers;
+    size_t active_workers;      // the last to finish closes the next queue
+    StageCounters counters;
+} Stage;
+
+typedef struct {
+    struct QrmePipeline* pipeline;
+    PipelineStage stage;
+    InferenceWorkspace* workspace;  // infer stage only
+} StageWorker;
+
+struct QrmePipeline {
+    const Model* model;
+    size_t input_size;
+    size_t output_size;
+    uint8_t* secret_key;        // from the shared key arena
+    size_t secret_key_len;
+    uint8_t* public_key;
+    size_t public_key_len;
+
+    PipelineItem* items;
+    size_t num_items;
+    ItemQueue free_items;       // items available to pipeline_submit()
+    ItemQueue completed;        // results waiting for pipeline_receive()
+    Stage stages[PIPELINE_STAGE_COUNT];
+    StageWorker* workers;
+    size_t num_workers;
+
+    uint64_t next_sequence;
+    size_t submitted;
+    size_t received;
+    int closed;
+    int abandoning;             // set by free_pipeline(): fail queued requests unprocessed
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void stat_add(uint64_t* counter, uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t* counter, uint64_t value) {
+    uint64_t seen = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > seen &&
+           !__atomic_compare_exchange_n(counter, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static int queue_init(ItemQueue* queue, size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    memset(queue, 0, sizeof(*queue));
+    queue->cells = malloc(size * sizeof(QueueCell));
+    if (!queue->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        queue->cells[i].sequence = i;
+    }
+    queue->mask = size - 1;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->nonempty, NULL);
+    return 0;
+}
+
+static void queue_destroy(ItemQueue* queue) {
+    if (!queue->cells) {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->nonempty);
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+static size_t queue_depth(const ItemQueue* queue) {
+    size_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    return tail > head ? tail - head : 0;
+}
+
+static int queue_try_push(ItemQueue* queue, PipelineItem* item) {
+    size_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueCell* cell = &queue->cells[pos & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->item = item;
+                __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;  // full
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static PipelineItem* queue_try_pop(ItemQueue* queue) {
+    size_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    for (;;) {
+        QueueCell* cell = &queue->cells[pos & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                PipelineItem* item = cell->item;
+                __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+                return item;
+            }
+        } else if (diff < 0) {
+            return NULL;  // empty
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Every queue can hold every item, so a push never finds it full
+static void queue_push(ItemQueue* queue, PipelineItem* item) {
+    item->enqueued_ns = now_ns();
+    while (queue_try_push(queue, item) != 0) {
+    }
+    stat_max(&queue->peak_depth, queue_depth(queue));
+
+    // Pairs with the fence in queue_pop(): either the sleeper's retry
+    // sees the item or this sees the sleeper
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->waiters, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_signal(&queue->nonempty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+// Returns NULL once the queue is closed and empty
+static PipelineItem* queue_pop(ItemQueue* queue) {
+    PipelineItem* item;
+    for (int spin = 0; spin < POP_SPINS; spin++) {
+        if ((item = queue_try_pop(queue))) {
+            return item;
+        }
+        if (__atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) {
+            return queue_try_pop(queue);
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->waiters, 1, __ATOMIC_RELAXED);
+    for (;;) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if ((item = queue_try_pop(queue)) || __atomic_load_n(&queue->closed, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        pthread_cond_wait(&queue->nonempty, &queue->lock);
+    }
+    __atomic_sub_fetch(&queue->waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&queue->lock);
+    return item ? item : queue_try_pop(queue);
+}
+
+static void queue_close(ItemQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    __atomic_store_n(&queue->closed, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&queue->nonempty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void fail_item(PipelineItem* item, QrmeErrorCode code, const char* message) {
+    item->status = code != QRME_OK ? code : QRME_ERR_STATE;
+    snprintf(item->message, sizeof(item->message), "%s", message);
+}
+
+static int run_decrypt(QrmePipeline* pipeline, PipelineItem* item) {
+    size_t count;
+    if (decrypt_floats_into(pipeline->secret_key, pipeline->secret_key_len, item->request, item->request_len,
+                            item->input, pipeline->input_size, &count) != 0) {
+        fail_item(item, qrme_last_error(), qrme_last_error_message());
+        return -1;
+    }
+    if (count != pipeline->input_size) {
+        secure_zero(item->input, count * sizeof(float));
+        fail_item(item, QRME_ERR_FORMAT, "Request is not one input vector");
+        return -1;
+    }
+    return 0;
+}
+
+static int run_infer(QrmePipeline* pipeline, StageWorker* worker, PipelineItem* item) {
+    int ret = inference_ws(pipeline->model, worker->workspace, item->input, pipeline->input_size,
+                           item->output, pipeline->output_size);
+    secure_zero(item->input, pipeline->input_size * sizeof(float));
+    if (ret != 0) {
+        fail_item(item, qrme_last_error(), qrme_last_error_message());
+        return -1;
+    }
+    return 0;
+}
+
+static int run_encrypt(QrmePipeline* pipeline, PipelineItem* item) {
+    int ret = encrypt_floats(pipeline->public_key, pipeline->public_key_len,
+                             item->output, pipeline->output_size, &item->response, &item->response_len);
+    secure_zero(item->output, pipeline->output_size * sizeof(float));
+    if (ret != 0) {
+        fail_item(item, qrme_last_error(), qrme_last_error_message());
+        return -1;
+    }
+    return 0;
+}
+
+static void stage_main(void* arg) {
+    StageWorker* worker = arg;
+    QrmePipeline* pipeline = worker->pipeline;
+    Stage* stage = &pipeline->stages[worker->stage];
+    ItemQueue* next = worker->stage + 1 < PIPELINE_STAGE_COUNT ?
+                      &pipeline->stages[worker->stage + 1].queue : &pipeline->completed;
+    StageCounters* counters = &stage->counters;
+
+    PipelineItem* item;
+    while ((item = queue_pop(&stage->queue))) {
+        uint64_t start = now_ns();
+        // Requests that failed earlier pass straight through to their result
+        if (item->status == QRME_OK) {
+            int ret;
+            if (__atomic_load_n(&pipeline->abandoning, __ATOMIC_RELAXED)) {
+                fail_item(item, QRME_ERR_STATE, "Pipeline was freed");
+                ret = -1;
+            } else if (worker->stage == PIPELINE_STAGE_DECRYPT) {
+                ret = run_decrypt(pipeline, item);
+            } else if (worker->stage == PIPELINE_STAGE_INFER) {
+                ret = run_infer(pipeline, worker, item);
+            } else {
+                ret = run_encrypt(pipeline, item);
+            }
+            uint64_t end = now_ns();
+            stat_add(ret == 0 ? &counters->processed : &counters->failed, 1);
+            stat_add(&counters->total_wait_ns, start - item->enqueued_ns);
+            stat_add(&counters->total_service_ns, end - start);
+            stat_max(&counters->max_wait_ns, start - item->enqueued_ns);
+            stat_max(&counters->max_service_ns, end - start);
+        }
+        queue_push(next, item);
+    }
+
+    if (__atomic_sub_fetch(&stage->active_workers, 1, __ATOMIC_ACQ_REL) == 0) {
+        queue_close(next);
+    }
+}
+
+void pipeline_default_config(PipelineConfig* config) {
+    if (!config) {
+        return;
+    }
+    config->decrypt_threads = DEFAULT_DECRYPT_THREADS;
+    config->infer_threads = DEFAULT_INFER_THREADS;
+    config->encrypt_threads = DEFAULT_ENCRYPT_THREADS;
+    config->max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+}
+
+QrmePipeline* create_pipeline(const PipelineConfig* config, const Model* model,
+                              const uint8_t* secret_key, size_t secret_key_len,
+                              const uint8_t* response_public_key, size_t response_public_key_len) {
+    if (!config || !model || !secret_key || secret_key_len == 0 ||
+        !response_public_key || response_public_key_len == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid pipeline arguments");
+        return NULL;
+    }
+    size_t threads[PIPELINE_STAGE_COUNT] = {config->decrypt_threads, config->infer_threads,
+                                            config->encrypt_threads};
+    if (threads[0] == 0 || threads[1] == 0 || threads[2] == 0 || config->max_in_flight == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Every stage needs a worker and max_in_flight must be positive");
+        return NULL;
+    }
+    if (!model->plan.valid) {
+        set_error(QRME_ERR_STATE, "Model has no valid execution plan");
+        return NULL;
+    }
+
+    QrmePipeline* pipeline = calloc(1, sizeof(QrmePipeline));
+    if (!pipeline) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for pipeline");
+        return NULL;
+    }
+    pipeline->model = model;
+    pipeline->input_size = model->plan.input_size;
+    pipeline->output_size = model->plan.output_size;
+    pipeline->num_items = config->max_in_flight;
+    pipeline->num_workers = threads[0] + threads[1] + threads[2];
+
+    // The key is held for the pipeline's lifetime, so keep it in locked memory
+    pipeline->secret_key = secure_key_alloc(secret_key_len);
+    pipeline->secret_key_len = secret_key_len;
+    pipeline->public_key = malloc(response_public_key_len);
+    pipeline->items = calloc(pipeline->num_items, sizeof(PipelineItem));
+    pipeline->workers = calloc(pipeline->num_workers, sizeof(StageWorker));
+    if (!pipeline->secret_key || !pipeline->public_key || !pipeline->items || !pipeline->workers) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for pipeline");
+        goto fail;
+    }
+    memcpy(pipeline->secret_key, secret_key, secret_key_len);
+    memcpy(pipeline->public_key, response_public_key, response_public_key_len);
+    pipeline->public_key_len = response_public_key_len;
+
+    int queues_ok = queue_init(&pipeline->free_items, pipeline->num_items) == 0 &&
+                    queue_init(&pipeline->completed, pipeline->num_items) == 0;
+    for (int s = 0; s < PIPELINE_STAGE_COUNT && queues_ok; s++) {
+        queues_ok = queue_init(&pipeline->stages[s].queue, pipeline->num_items) == 0;
+    }
+    if (!queues_ok) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate pipeline queues");
+        goto fail;
+    }
+    for (size_t i = 0; i < pipeline->num_items; i++) {
+        PipelineItem* item = &pipeline->items[i];
+        item->input = secure_alloc(pipeline->input_size * sizeof(float));
+        item->output = secure_alloc(pipeline->output_size * sizeof(float));
+        if (!item->input || !item->output) {
+            set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate pipeline buffers");
+            goto fail;
+        }
+        queue_push(&pipeline->free_items, item);
+    }
+
+    size_t w = 0;
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        for (size_t i = 0; i < threads[s]; i++, w++) {
+            pipeline->workers[w].pipeline = pipeline;
+            pipeline->workers[w].stage = (PipelineStage)s;
+            if (s == PIPELINE_STAGE_INFER &&
+                !(pipeline->workers[w].workspace = create_inference_workspace(model))) {
+                set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate inference workspace");
+                goto fail;
+            }
+        }
+    }
+
+    w = 0;
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        Stage* stage = &pipeline->stages[s];
+        if (!(stage->pool = create_thread_pool(threads[s]))) {
+            set_error(QRME_ERR_RESOURCE, "Failed to start pipeline workers");
+            goto fail;
+        }
+        // Each worker runs one long-lived task that drains the stage's queue
+        for (size_t i = 0; i < threads[s]; i++, w++) {
+            if (thread_pool_submit(stage->pool, stage_main, &pipeline->workers[w]) != 0) {
+                set_error(QRME_ERR_RESOURCE, "Failed to start pipeline workers");
+                goto fail;
+            }
+            stage->num_workers++;
+            __atomic_add_fetch(&stage->active_workers, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    TRACE_INFO(TRACE_CAT_PIPELINE, "Pipeline started (%zu/%zu/%zu workers, %zu in flight)",
+               threads[0], threads[1], threads[2], pipeline->num_items);
+    return pipeline;
+
+fail:
+    free_pipeline(pipeline);
+    return NULL;
+}
+
+int pipeline_submit(QrmePipeline* pipeline, const uint8_t* request, size_t request_len,
+                    void* user_data, uint64_t* sequence) {
+    if (!pipeline || !request || request_len == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid request");
+        return -1;
+    }
+    if (__atomic_load_n(&pipeline->closed, __ATOMIC_RELAXED)) {
+        set_error(QRME_ERR_STATE, "Pipeline is closed");
+        return -1;
+    }
+
+    PipelineItem* item = queue_pop(&pipeline->free_items);
+    if (!item) {
+        set_error(QRME_ERR_STATE, "Pipeline is closed");
+        return -1;
+    }
+    item->sequence = __atomic_fetch_add(&pipeline->next_sequence, 1, __ATOMIC_RELAXED);
+    item->user_data = user_data;
+    item->request = request;
+    item->request_len = request_len;
+    item->response = NULL;
+    item->response_len = 0;
+    item->status = QRME_OK;
+    item->message[0] = '\0';
+    if (sequence) {
+        *sequence = item->sequence;
+    }
+    __atomic_fetch_add(&pipeline->submitted, 1, __ATOMIC_RELAXED);
+    queue_push(&pipeline->stages[PIPELINE_STAGE_DECRYPT].queue, item);
+    return 0;
+}
+
+int pipeline_receive(QrmePipeline* pipeline, PipelineResult* result) {
+    if (!pipeline || !result) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid pipeline arguments");
+        return -1;
+    }
+
+    PipelineItem* item = queue_pop(&pipeline->completed);
+    if (!item) {
+        return 1;
+    }
+    result->sequence = item->sequence;
+    result->user_data = item->user_data;
+    result->status = item->status;
+    result->response = item->response;
+    result->response_len = item->response_len;
+    if (item->status != QRME_OK) {
+        set_error(item->status, item->message);
+    }
+
+    item->request = NULL;
+    item->response = NULL;
+    __atomic_fetch_add(&pipeline->received, 1, __ATOMIC_RELAXED);
+    queue_push(&pipeline->free_items, item);
+    return 0;
+}
+
+void pipeline_close(QrmePipeline* pipeline) {
+    if (!pipeline || __atomic_exchange_n(&pipeline->closed, 1, __ATOMIC_RELAXED)) {
+        return;
+    }
+    queue_close(&pipeline->stages[PIPELINE_STAGE_DECRYPT].queue);
+    queue_close(&pipeline->free_items);
+}
+
+void get_pipeline_stats(const QrmePipeline* pipeline, PipelineStats* stats) {
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (!pipeline) {
+        return;
+    }
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        const Stage* stage = &pipeline->stages[s];
+        PipelineStageStats* out = &stats->stages[s];
+        out->queue_depth = queue_depth(&stage->queue);
+        out->peak_queue_depth = __atomic_load_n(&stage->queue.peak_depth, __ATOMIC_RELAXED);
+        out->processed = __atomic_load_n(&stage->counters.processed, __ATOMIC_RELAXED);
+        out->failed = __atomic_load_n(&stage->counters.failed, __ATOMIC_RELAXED);
+        out->total_wait_ns = __atomic_load_n(&stage->counters.total_wait_ns, __ATOMIC_RELAXED);
+        out->total_service_ns = __atomic_load_n(&stage->counters.total_service_ns, __ATOMIC_RELAXED);
+        out->max_wait_ns = __atomic_load_n(&stage->counters.max_wait_ns, __ATOMIC_RELAXED);
+        out->max_service_ns = __atomic_load_n(&stage->counters.max_service_ns, __ATOMIC_RELAXED);
+    }
+    stats->submitted = __atomic_load_n(&pipeline->submitted, __ATOMIC_RELAXED);
+    stats->received = __atomic_load_n(&pipeline->received, __ATOMIC_RELAXED);
+    stats->completed_depth = queue_depth(&pipeline->completed);
+}
+
+void free_pipeline(QrmePipeline* pipeline) {
+    if (!pipeline) {
+        return;
+    }
+
+    // Let the workers run dry, failing whatever is still queued, then
+    // discard the results nobody received
+    __atomic_store_n(&pipeline->abandoning, 1, __ATOMIC_RELAXED);
+    if (pipeline->stages[PIPELINE_STAGE_DECRYPT].queue.cells) {
+        queue_close(&pipeline->stages[PIPELINE_STAGE_DECRYPT].queue);
+    }
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        Stage* stage = &pipeline->stages[s];
+        // A stage that never started its workers still has to pass the close on
+        if (stage->num_workers == 0 && stage->queue.cells) {
+            ItemQueue* next = s + 1 < PIPELINE_STAGE_COUNT ? &pipeline->stages[s + 1].queue :
+                              &pipeline->completed;
+            if (next->cells) {
+                queue_close(next);
+            }
+        }
+        free_thread_pool(stage->pool);
+    }
+    if (pipeline->completed.cells) {
+        PipelineItem* item;
+        while ((item = queue_try_pop(&pipeline->completed))) {
+            if (item->response) {
+                secure_free((void**)&item->response);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pipeline->num_workers && pipeline->workers; i++) {
+        free_inference_workspace(pipeline->workers[i].workspace);
+    }
+    for (size_t i = 0; i < pipeline->num_items && pipeline->items; i++) {
+        if (pipeline->items[i].input) secure_free((void**)&pipeline->items[i].input);
+        if (pipeline->items[i].output) secure_free((void**)&pipeline->items[i].output);
+    }
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        queue_destroy(&pipeline->stages[s].queue);
+    }
+    queue_destroy(&pipeline->free_items);
+    queue_destroy(&pipeline->completed);
+    secure_key_free((void**)&pipeline->secret_key, pipeline->secret_key_len);
+    free(pipeline->public_key);
+    free(pipeline->items);
+    free(pipeline->workers);
+    free(pipeline);
+}
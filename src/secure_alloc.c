@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../include/secure_alloc.h"
+#include "../include/error.h"
+#include "../include/trace.h"
+
+
+// Size classes 64, 128, ..., SECURE_ALLOC_MAX_POOLED bytes
+#define MIN_CLASS_SHIFT 6
+#define NUM_SIZE_CLASSES 7
+#define LARGE_CLASS NUM_SIZE_CLASSES
+
+// Wiped blocks kept per class before they spill to the shared pool, and
+// kept in the shared pool before they go back to the system
+#define THREAD_CACHE_LIMIT 32
+#define SHARED_POOL_LIMIT 256
+
+#define BLOCK_LIVE 0x5ecb10c1u
+#define BLOCK_FREE 0x5ecb10c0u
+
+// Sits in the SECURE_ALLOC_ALIGNMENT bytes just before each user block
+typedef struct BlockHeader {
+    struct BlockHeader* next;   // free-list link while pooled
+    size_t size;                // bytes requested by the caller
+    size_t capacity;            // usable bytes after the header
+    uint32_t size_class;        // LARGE_CLASS for unpooled blocks
+    uint32_t magic;
+} BlockHeader;
+
+_Static_assert(sizeof(BlockHeader) <= SECURE_ALLOC_ALIGNMENT,
+               "block header must fit in one alignment unit");
+
+typedef struct {
+    BlockHeader* head[NUM_SIZE_CLASSES];
+    size_t count[NUM_SIZE_CLASSES];
+} FreeLists;
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static FreeLists shared_pool;
+
+// Flushed to the shared pool by the key destructor when a thread exits.
+// Other destructors may free blocks after that, so the cache is then
+// closed and those blocks go to the shared pool
+#define CACHE_UNREGISTERED 0
+#define CACHE_OPEN 1
+#define CACHE_CLOSED 2
+
+static __thread FreeLists thread_cache;
+static __thread int thread_cache_state;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static SecureAllocStats stats;
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_SECURE_ALLOC, code, message);
+}
+
+const char* get_secure_alloc_error(void) {
+    return qrme_module_error(QRME_MODULE_SECURE_ALLOC);
+}
+
+void secure_zero(void* ptr, size_t size) {
+    if (!ptr || size == 0) {
+        return;
+    }
+#if defined(__GNUC__)
+    // The empty asm claims to read the buffer, so the memset stays
+    memset(ptr, 0, size);
+    __asm__ __volatile__("" : : "r"(ptr) : "memory");
+#else
+    // Write through a volatile pointer so the compiler cannot drop the wipe
+    volatile unsigned char* p = ptr;
+    while (size--) {
+        *p++ = 0;
+    }
+#endif
+}
+
+static void stat_add(size_t* counter, size_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void track_in_use(size_t added, size_t removed) {
+    size_t now = __atomic_add_fetch(&stats.bytes_in_use, added - removed, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&stats.peak_bytes_in_use, __ATOMIC_RELAXED);
+    while (now > peak &&
+           !__atomic_compare_exchange_n(&stats.peak_bytes_in_use, &peak, now, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static inline BlockHeader* header_of(void* ptr) {
+    return (BlockHeader*)((unsigned char*)ptr - SECURE_ALLOC_ALIGNMENT);
+}
+
+static inline void* data_of(BlockHeader* block) {
+    return (unsigned char*)block + SECURE_ALLOC_ALIGNMENT;
+}
+
+static uint32_t size_class_of(size_t size) {
+    if (size > SECURE_ALLOC_MAX_POOLED) {
+        return LARGE_CLASS;
+    }
+    uint32_t c = 0;
+    while (((size_t)1 << (c + MIN_CLASS_SHIFT)) < size) {
+        c++;
+    }
+    return c;
+}
+
+static void release_list(BlockHeader* block) {
+    while (block) {
+        BlockHeader* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static void flush_thread_cache(void* cache) {
+    FreeLists* lists = cache;
+    BlockHeader* excess = NULL;
+
+    pthread_mutex_lock(&shared_lock);
+    for (size_t c = 0; c < NUM_SIZE_CLASSES; c++) {
+        while (lists->head[c]) {
+            BlockHeader* block = lists->head[c];
+            lists->head[c] = block->next;
+            if (shared_pool.count[c] < SHARED_POOL_LIMIT) {
+                block->next = shared_pool.head[c];
+                shared_pool.head[c] = block;
+                shared_pool.count[c]++;
+            } else {
+                block->next = excess;
+                excess = block;
+            }
+        }
+        lists->count[c] = 0;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    release_list(excess);
+    thread_cache_state = CACHE_CLOSED;
+}
+
+static void create_cache_key(void) {
+    pthread_key_create(&cache_key, flush_thread_cache);
+}
+
+static void register_thread_cache(void) {
+    pthread_once(&cache_key_once, create_cache_key);
+    pthread_setspecific(cache_key, &thread_cache);
+    thread_cache_state = CACHE_OPEN;
+}
+
+// Pop a wiped block of class c, from this thread's cache first
+static BlockHeader* take_pooled(uint32_t c) {
+    BlockHeader* block = thread_cache.head[c];
+    if (block) {
+        thread_cache.head[c] = block->next;
+        thread_cache.count[c]--;
+        return block;
+    }
+
+    pthread_mutex_lock(&shared_lock);
+    block = shared_pool.head[c];
+    if (block) {
+        shared_pool.head[c] = block->next;
+        shared_pool.count[c]--;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    return block;
+}
+
+// Keep a wiped block of class c for reuse, or give it back to the system
+static void put_pooled(BlockHeader* block, uint32_t c) {
+    if (thread_cache_state == CACHE_UNREGISTERED) {
+        register_thread_cache();
+    }
+    if (thread_cache_state == CACHE_OPEN && thread_cache.count[c] < THREAD_CACHE_LIMIT) {
+        block->next = thread_cache.head[c];
+        thread_cache.head[c] = block;
+        thread_cache.count[c]++;
+        return;
+    }
+
+    pthread_mutex_lock(&shared_lock);
+    if (shared_pool.count[c] < SHARED_POOL_LIMIT) {
+        block->next = shared_pool.head[c];
+        shared_pool.head[c] = block;
+        shared_pool.count[c]++;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    free(block);
+}
+
+static BlockHeader* new_block(uint32_t c, size_t capacity) {
+    void* memory = NULL;
+    if (capacity > SIZE_MAX - SECURE_ALLOC_ALIGNMENT ||
+        posix_memalign(&memory, SECURE_ALLOC_ALIGNMENT, SECURE_ALLOC_ALIGNMENT + capacity) != 0) {
+        return NULL;
+    }
+    BlockHeader* block = memory;
+    block->size_class = c;
+    block->capacity = capacity;
+    memset(data_of(block), 0, capacity);
+    return block;
+}
+
+static void* allocate(size_t size) {
+    uint32_t c = size_class_of(size);
+    BlockHeader* block;
+
+    if (c == LARGE_CLASS) {
+        block = new_block(c, size);
+        stat_add(&stats.large_allocations, 1);
+    } else {
+        // Pooled blocks were wiped when freed, so need no zero fill
+        block = take_pooled(c);
+        if (block) {
+            stat_add(&stats.pool_hits, 1);
+        } else {
+            block = new_block(c, (size_t)1 << (c + MIN_CLASS_SHIFT));
+            stat_add(&stats.pool_misses, 1);
+        }
+    }
+    if (!block) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory");
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->magic = BLOCK_LIVE;
+    track_in_use(size, 0);
+    return data_of(block);
+}
+
+void* secure_alloc(size_t size) {
+    void* ptr = allocate(size);
+    if (ptr) {
+        stat_add(&stats.allocations, 1);
+    }
+    return ptr;
+}
+
+static void release_block(BlockHeader* block) {
+    secure_zero(data_of(block), block->size);
+    block->magic = BLOCK_FREE;
+    track_in_use(0, block->size);
+
+    if (block->size_class == LARGE_CLASS) {
+        free(block);
+    } else {
+        put_pooled(block, block->size_class);
+    }
+}
+
+static BlockHeader* checked_header(void* ptr) {
+    if ((uintptr_t)ptr % SECURE_ALLOC_ALIGNMENT != 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Pointer was not allocated by the secure allocator");
+        return NULL;
+    }
+    BlockHeader* block = header_of(ptr);
+    if (block->magic == BLOCK_FREE) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Secure block freed twice");
+        return NULL;
+    }
+    if (block->magic != BLOCK_LIVE) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Pointer was not allocated by the secure allocator");
+        return NULL;
+    }
+    return block;
+}
+
+void* secure_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return secure_alloc(size);
+    }
+
+    BlockHeader* block = checked_header(ptr);
+    if (!block) {
+        return NULL;
+    }
+
+    if (size <= block->capacity) {
+        // Fits in place: wipe a cut-off tail, a grown tail is already zero
+        if (size < block->size) {
+            secure_zero((unsigned char*)ptr + size, block->size - size);
+        }
+        track_in_use(size, block->size);
+        block->size = size;
+        return ptr;
+    }
+
+    void* moved = allocate(size);
+    if (!moved) {
+        return NULL;
+    }
+    memcpy(moved, ptr, block->size);
+    release_block(block);
+    return moved;
+}
+
+void secure_free(void** ptr) {
+    if (ptr == NULL || *ptr == NULL) {
+        return;
+    }
+
+    BlockHeader* block = checked_header(*ptr);
+    if (!block) {
+        TRACE_WARN(TRACE_CAT_ALLOC, "secure_free(%p): %s", *ptr, get_secure_alloc_error());
+        return;
+    }
+    release_block(block);
+    stat_add(&stats.frees, 1);
+    *ptr = NULL;
+}
+
+void get_secure_alloc_stats(SecureAllocStats* out) {
+    if (!out) {
+        return;
+    }
+    out->bytes_in_use = __atomic_load_n(&stats.bytes_in_use, __ATOMIC_RELAXED);
+    out->peak_bytes_in_use = __atomic_load_n(&stats.peak_bytes_in_use, __ATOMIC_RELAXED);
+    out->allocations = __atomic_load_n(&stats.allocations, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&stats.frees, __ATOMIC_RELAXED);
+    out->pool_hits = __atomic_load_n(&stats.pool_hits, __ATOMIC_RELAXED);
+    out->pool_misses = __atomic_load_n(&stats.pool_misses, __ATOMIC_RELAXED);
+    out->large_allocations = __atomic_load_n(&stats.large_allocations, __ATOMIC_RELAXED);
+}
+
+void secure_alloc_trim(void) {
+    for (size_t c = 0; c < NUM_SIZE_CLASSES; c++) {
+        release_list(thread_cache.head[c]);
+        thread_cache.head[c] = NULL;
+        thread_cache.count[c] = 0;
+    }
+
+    BlockHeader* lists[NUM_SIZE_CLASSES];
+    pthread_mutex_lock(&shared_lock);
+    for (size_t c = 0; c < NUM_SIZE_CLASSES; c++) {
+        lists[c] = shared_pool.head[c];
+        shared_pool.head[c] = NULL;
+        shared_pool.count[c] = 0;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    for (size_t c = 0; c < NUM_SIZE_CLASSES; c++) {
+        release_list(lists[c]);
+    }
+}
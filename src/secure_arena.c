@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "../include/secure_arena.h"
+#include "../include/error.h"
+#include "../include/secure_alloc.h"
+
+#define ARENA_ALIGNMENT 64
+// The shared key arena grows a locked chunk at a time
+#define KEY_CHUNK_SIZE (64 * 1024)
+// Key size classes run from ARENA_ALIGNMENT to SECURE_KEY_MAX_BLOCK bytes
+#define KEY_CLASSES 7
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+struct SecureArena {
+    unsigned char* mapping;     // guard page, usable region, guard page
+    size_t mapping_len;
+    unsigned char* base;        // first usable byte, page aligned
+    size_t capacity;
+    size_t used;                // atomic bump offset from base
+    int locked;
+};
+
+typedef struct KeyChunk {
+    SecureArena* arena;
+    struct KeyChunk* next;
+} KeyChunk;
+
+// Freed key blocks, linked through their first word
+typedef struct FreeKey {
+    struct FreeKey* next;
+} FreeKey;
+
+static pthread_mutex_t key_lock = PTHREAD_MUTEX_INITIALIZER;
+static KeyChunk* key_chunks = NULL;        // newest first
+static FreeKey* free_keys[KEY_CLASSES];
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_SECURE_ARENA, code, message);
+}
+
+const char* get_secure_arena_error(void) {
+    return qrme_module_error(QRME_MODULE_SECURE_ARENA);
+}
+
+SecureArena* create_secure_arena(size_t capacity) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    if (capacity > SIZE_MAX - 3 * page) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Secure arena too large");
+        return NULL;
+    }
+    capacity = (capacity + page - 1) & ~(page - 1);
+
+    SecureArena* arena = calloc(1, sizeof(SecureArena));
+    if (!arena) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for secure arena");
+        return NULL;
+    }
+
+    // Map everything inaccessible, then open up the middle, so the pages
+    // either side fault on any overrun
+    arena->mapping_len = capacity + 2 * page;
+    arena->mapping = mmap(NULL, arena->mapping_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena->mapping == MAP_FAILED) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to map secure arena");
+        free(arena);
+        return NULL;
+    }
+    arena->base = arena->mapping + page;
+    arena->capacity = capacity;
+    if (mprotect(arena->base, capacity, PROT_READ | PROT_WRITE) != 0) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to enable secure arena pages");
+        munmap(arena->mapping, arena->mapping_len);
+        free(arena);
+        return NULL;
+    }
+
+#ifdef MADV_DONTDUMP
+    madvise(arena->base, capacity, MADV_DONTDUMP);
+#endif
+    arena->locked = mlock(arena->base, capacity) == 0;
+    return arena;
+}
+
+void* secure_arena_alloc(SecureArena* arena, size_t size) {
+    if (!arena) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid secure arena");
+        return NULL;
+    }
+
+    size_t used = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+    size_t start, end;
+    do {
+        start = (used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+        if (start > arena->capacity || size > arena->capacity - start) {
+            set_error(QRME_ERR_OUT_OF_MEMORY, "Secure arena exhausted");
+            return NULL;
+        }
+        end = start + size;
+    } while (!__atomic_compare_exchange_n(&arena->used, &used, end, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    // Fresh pages are zero and reset() wipes, so there is nothing to clear
+    return arena->base + start;
+}
+
+void secure_arena_reset(SecureArena* arena) {
+    if (!arena) {
+        return;
+    }
+    secure_zero(arena->base, arena->used);
+    arena->used = 0;
+}
+
+void free_secure_arena(SecureArena* arena) {
+    if (!arena) {
+        return;
+    }
+    secure_zero(arena->base, arena->used);
+    if (arena->locked) {
+        munlock(arena->base, arena->capacity);
+    }
+    munmap(arena->mapping, arena->mapping_len);
+    free(arena);
+}
+
+int secure_arena_is_locked(const SecureArena* arena) {
+    return arena ? arena->locked : 0;
+}
+
+size_t secure_arena_used(const SecureArena* arena) {
+    return arena ? __atomic_load_n(&arena->used, __ATOMIC_RELAXED) : 0;
+}
+
+size_t secure_arena_capacity(const SecureArena* arena) {
+    return arena ? arena->capacity : 0;
+}
+
+static size_t key_class(size_t size, size_t* block) {
+    size_t c = 0;
+    *block = ARENA_ALIGNMENT;
+    while (*block < size) {
+        *block <<= 1;
+        c++;
+    }
+    return c;
+}
+
+// Carve a block off the newest chunk, mapping a new one when it is full.
+// Called with key_lock held.
+static void* carve_key_block(size_t block) {
+    KeyChunk* chunk = key_chunks;
+    if (!chunk || chunk->arena->capacity - chunk->arena->used < block) {
+        chunk = malloc(sizeof(KeyChunk));
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->arena = create_secure_arena(KEY_CHUNK_SIZE);
+        if (!chunk->arena) {
+            free(chunk);
+            return NULL;
+        }
+        chunk->next = key_chunks;
+        key_chunks = chunk;
+    }
+    return secure_arena_alloc(chunk->arena, block);
+}
+
+void* secure_key_alloc(size_t size) {
+    if (size > SECURE_KEY_MAX_BLOCK) {
+        return secure_alloc(size);
+    }
+
+    size_t block;
+    size_t c = key_class(size, &block);
+    pthread_mutex_lock(&key_lock);
+    void* ptr = free_keys[c];
+    if (ptr) {
+        free_keys[c] = free_keys[c]->next;
+        ((FreeKey*)ptr)->next = NULL;  // the rest was wiped when freed
+    } else {
+        ptr = carve_key_block(block);
+    }
+    pthread_mutex_unlock(&key_lock);
+
+    // Without a locked chunk the key still needs somewhere to live
+    return ptr ? ptr : secure_alloc(size);
+}
+
+void secure_key_free(void** ptr, size_t size) {
+    if (!ptr || !*ptr) {
+        return;
+    }
+    if (size > SECURE_KEY_MAX_BLOCK) {
+        secure_free(ptr);
+        return;
+    }
+
+    unsigned char* p = *ptr;
+    size_t block;
+    size_t c = key_class(size, &block);
+    pthread_mutex_lock(&key_lock);
+    for (KeyChunk* chunk = key_chunks; chunk; chunk = chunk->next) {
+        if (p >= chunk->arena->base && p < chunk->arena->base + chunk->arena->capacity) {
+            secure_zero(p, block);
+            ((FreeKey*)p)->next = free_keys[c];
+            free_keys[c] = (FreeKey*)p;
+            pthread_mutex_unlock(&key_lock);
+            *ptr = NULL;
+            return;
+        }
+    }
+    pthread_mutex_unlock(&key_lock);
+    secure_free(ptr);
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include "../include/encryption.h"
+#include "../include/model.h"
+#include "../include/server.h"
+#include "../include/utils.h"
+
+static QrmeServer* running_server;
+
+static void handle_signal(int signal_number) {
+    (void)signal_number;
+    server_stop(running_server);
+}
+
+static void print_usage(const char* program_name) {
+    printf("Usage: %s [options] <model_file> <secret_key_file> <socket_path>\n", program_name);
+    printf("  --max-batch N        Requests per batch (default 32)\n");
+    printf("  --max-wait-us N      Longest a request waits for its batch to fill (default 1000)\n");
+    printf("  --max-connections N  Clients served at once (default 256)\n");
+}
+
+// Accepts only plain decimal numbers no larger than max
+static int parse_size(const char* text, size_t max, size_t* value) {
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*text < '0' || *text > '9' || *end != '\0' || errno == ERANGE || parsed > max) {
+        return -1;
+    }
+    *value = (size_t)parsed;
+    return 0;
+}
+
+static uint8_t* read_secret_key(const char* filename, size_t* len) {
+    FILE* key_file = fopen(filename, "rb");
+    if (!key_file) {
+        return NULL;
+    }
+    uint8_t* secret_key = NULL;
+    long size = -1;
+    if (fseek(key_file, 0, SEEK_END) == 0) {
+        size = ftell(key_file);
+    }
+    if (size > 0 && fseek(key_file, 0, SEEK_SET) == 0) {
+        secret_key = secure_realloc(NULL, (size_t)size);
+        if (secret_key && fread(secret_key, 1, (size_t)size, key_file) != (size_t)size) {
+            secure_free((void**)&secret_key);
+        }
+    }
+    fclose(key_file);
+    *len = (size_t)size;
+    return secret_key;
+}
+
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    server_default_config(&config, NULL);
+
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        size_t value;
+        size_t max = strcmp(argv[arg], "--max-wait-us") == 0 ? UINT_MAX : SIZE_MAX;
+        if (arg + 1 >= argc || parse_size(argv[arg + 1], max, &value) != 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[arg], "--max-batch") == 0) {
+            config.max_batch_size = value;
+        } else if (strcmp(argv[arg], "--max-wait-us") == 0) {
+            config.max_wait_us = (unsigned)value;
+        } else if (strcmp(argv[arg], "--max-connections") == 0) {
+            config.max_connections = value;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - arg != 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char* model_file = argv[arg];
+    const char* secret_key_file = argv[arg + 1];
+    config.socket_path = argv[arg + 2];
+
+    init_encryption();
+
+    // The model is decrypted once; every request after that only pays for
+    // its session message and its share of a batch
+    size_t secret_key_len;
+    uint8_t* secret_key = read_secret_key(secret_key_file, &secret_key_len);
+    if (!secret_key) {
+        fprintf(stderr, "Error: Unable to read secret key.\n");
+        return 1;
+    }
+    Model* model = load_model(model_file, secret_key, secret_key_len);
+    if (!model) {
+        fprintf(stderr, "Error: %s\n", get_model_error());
+        secure_free((void**)&secret_key);
+        return 1;
+    }
+
+    QrmeServer* server = create_server(&config, model, secret_key, secret_key_len);
+    secure_free((void**)&secret_key);
+    if (!server) {
+        fprintf(stderr, "Error: %s\n", get_server_error());
+        free_model(model);
+        return 1;
+    }
+
+    running_server = server;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving %s on %s\n", model_file, config.socket_path);
+    fflush(stdout);
+    int ret = server_run(server);
+    if (ret != 0) {
+        fprintf(stderr, "Error: %s\n", get_server_error());
+    }
+
+    ServerStats stats;
+    get_server_stats(server, &stats);
+    printf("Served %zu requests in %zu batches (largest %zu), %zu errors\n",
+           stats.requests, stats.batches, stats.largest_batch, stats.errors);
+
+    free_server(server);
+    free_model(model);
+    cleanup_encryption();
+    return ret == 0 ? 0 : 1;
+}
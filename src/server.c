@@ -0,0 +1,947 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/server.h"
+#include "../include/error.h"
+#include "../include/encryption.h"
+#include "../include/secure_arena.h"
+#include "../include/session.h"
+#include "../include/trace.h"
+#include "../include/utils.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define DEFAULT_MAX_BATCH_SIZE 32
+#define DEFAULT_MAX_WAIT_US 1000
+#define DEFAULT_MAX_CONNECTIONS 256
+#define DEFAULT_MAX_FRAME_BYTES ((size_t)16 << 20)
+#define READ_CHUNK_SIZE 65536
+#define MAX_EVENTS 64
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_SERVER, code, message);
+}
+
+const char* get_server_error(void) {
+    return qrme_module_error(QRME_MODULE_SERVER);
+}
+
+static void put_le32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_le32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static int fill_socket_address(struct sockaddr_un* address, const char* socket_path) {
+    if (!socket_path || strlen(socket_path) >= sizeof(address->sun_path)) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid socket path");
+        return -1;
+    }
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+void server_default_config(ServerConfig* config, const char* socket_path) {
+    if (!config) {
+        return;
+    }
+    config->socket_path = socket_path;
+    config->max_batch_size = DEFAULT_MAX_BATCH_SIZE;
+    config->max_wait_us = DEFAULT_MAX_WAIT_US;
+    config->max_connections = DEFAULT_MAX_CONNECTIONS;
+    config->max_frame_bytes = DEFAULT_MAX_FRAME_BYTES;
+}
+
+#ifdef __linux__
+
+// Bytes [start, len) of data are still to be consumed
+typedef struct {
+    uint8_t* data;
+    size_t start;
+    size_t len;
+    size_t capacity;
+} Buffer;
+
+typedef struct Connection {
+    int fd;
+    QrmeSession* session;       // NULL until the client's hello
+    Buffer in;
+    Buffer out;
+    size_t queued;              // requests waiting in the current batch
+    int watching_writes;        // EPOLLOUT is registered
+    int closing;                // close once out has drained
+    int dead;                   // close at the end of this loop iteration
+    struct Connection* next;
+} Connection;
+
+struct QrmeServer {
+    const Model* model;
+    ServerConfig config;
+    char* socket_path;
+    uint8_t* secret_key;        // from the shared key arena
+    size_t secret_key_len;
+    size_t input_size;
+    size_t output_size;
+
+    int listen_fd;
+    int epoll_fd;
+    int timer_fd;               // fires when the oldest queued request has waited max_wait_us
+    int stop_fd;                // eventfd written by server_stop()
+
+    Connection* connections;
+    size_t num_connections;
+
+    // The current batch: row i of inputs belongs to owners[i]
+    Connection** owners;
+    float* inputs;
+    float* outputs;
+    size_t batch_count;
+
+    ServerStats stats;          // written by the loop, read atomically
+};
+
+// epoll user data for the descriptors that are not connections
+static int listener_tag, timer_tag, stop_tag;
+
+static void stat_add(size_t* counter, size_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static int buffer_reserve(Buffer* buffer, size_t extra) {
+    if (buffer->start > 0 && buffer->start == buffer->len) {
+        buffer->start = buffer->len = 0;
+    }
+    if (buffer->len + extra <= buffer->capacity) {
+        return 0;
+    }
+    // Slide unconsumed bytes to the front before growing
+    if (buffer->start > 0) {
+        memmove(buffer->data, buffer->data + buffer->start, buffer->len - buffer->start);
+        buffer->len -= buffer->start;
+        buffer->start = 0;
+        if (buffer->len + extra <= buffer->capacity) {
+            return 0;
+        }
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->len + extra) {
+        capacity *= 2;
+    }
+    uint8_t* data = realloc(buffer->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append_frame(Buffer* buffer, uint8_t type, const uint8_t* payload, size_t len) {
+    if (len > UINT32_MAX || buffer_reserve(buffer, SERVER_FRAME_HEADER_SIZE + len) != 0) {
+        return -1;
+    }
+    uint8_t* p = buffer->data + buffer->len;
+    put_le32(p, (uint32_t)len);
+    p[4] = type;
+    if (len) {
+        memcpy(p + SERVER_FRAME_HEADER_SIZE, payload, len);
+    }
+    buffer->len += SERVER_FRAME_HEADER_SIZE + len;
+    return 0;
+}
+
+static void watch_writes(QrmeServer* server, Connection* conn, int enable) {
+    if (conn->watching_writes == enable) {
+        return;
+    }
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN | EPOLLRDHUP | (enable ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == 0) {
+        conn->watching_writes = enable;
+    } else {
+        conn->dead = 1;
+    }
+}
+
+// Send as much of the output buffer as the socket takes
+static void connection_write(QrmeServer* server, Connection* conn) {
+    Buffer* out = &conn->out;
+    while (!conn->dead && out->start < out->len) {
+        ssize_t n = send(conn->fd, out->data + out->start, out->len - out->start, MSG_NOSIGNAL);
+        if (n > 0) {
+            out->start += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch_writes(server, conn, 1);
+            return;
+        } else {
+            conn->dead = 1;
+        }
+    }
+    out->start = out->len = 0;
+    watch_writes(server, conn, 0);
+    if (conn->closing) {
+        conn->dead = 1;
+    }
+}
+
+static void queue_frame(QrmeServer* server, Connection* conn, uint8_t type,
+                        const uint8_t* payload, size_t len) {
+    if (buffer_append_frame(&conn->out, type, payload, len) != 0) {
+        conn->dead = 1;
+        return;
+    }
+    connection_write(server, conn);
+}
+
+static void send_error_frame(QrmeServer* server, Connection* conn, QrmeErrorCode code, const char* message) {
+    uint8_t payload[4 + 256];
+    size_t len = strlen(message);
+    if (len > 256) {
+        len = 256;
+    }
+    put_le32(payload, (uint32_t)code);
+    memcpy(payload + 4, message, len);
+    // Counted before the frame can reach the client, so a client that has
+    // its answer always sees it in the stats
+    stat_add(&server->stats.errors, 1);
+    queue_frame(server, conn, SERVER_FRAME_ERROR, payload, 4 + len);
+}
+
+// output is a row of the batch, which is wiped afterwards, so it can be
+// encoded in place
+static void send_response(QrmeServer* server, Connection* conn, float* output) {
+    uint8_t* ciphertext = NULL;
+    size_t ciphertext_len;
+    float_array_to_le(output, server->output_size);
+    if (session_encrypt(conn->session, (const uint8_t*)output, server->output_size * sizeof(float),
+                        &ciphertext, &ciphertext_len) != 0) {
+        send_error_frame(server, conn, qrme_last_error(), get_session_error());
+        return;
+    }
+    stat_add(&server->stats.requests, 1);
+    queue_frame(server, conn, SERVER_FRAME_RESPONSE, ciphertext, ciphertext_len);
+    cleanup((void**)&ciphertext);
+}
+
+static void arm_timer(QrmeServer* server, unsigned microseconds) {
+    struct itimerspec when = {0};
+    when.it_value.tv_sec = microseconds / 1000000;
+    when.it_value.tv_nsec = (long)(microseconds % 1000000) * 1000;
+    timerfd_settime(server->timer_fd, 0, &when, NULL);
+}
+
+// Run the queued requests as one batch and answer each of them
+static void run_batch(QrmeServer* server) {
+    size_t n = server->batch_count;
+    if (n == 0) {
+        return;
+    }
+    arm_timer(server, 0);
+
+    int ret = inference_batch(server->model, server->inputs, n, server->input_size,
+                              server->outputs, server->output_size);
+    const char* message = ret == 0 ? NULL : get_model_error();
+    QrmeErrorCode code = qrme_last_error();
+    TRACE_DEBUG(TRACE_CAT_SERVER, "Ran a batch of %zu requests", n);
+    stat_add(&server->stats.batches, 1);
+    if (n > __atomic_load_n(&server->stats.largest_batch, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&server->stats.largest_batch, n, __ATOMIC_RELAXED);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        Connection* conn = server->owners[i];
+        conn->queued--;
+        if (conn->dead) {
+            continue;
+        }
+        if (ret == 0) {
+            send_response(server, conn, server->outputs + i * server->output_size);
+        } else {
+            send_error_frame(server, conn, code, message);
+        }
+    }
+
+    secure_zero(server->inputs, n * server->input_size * sizeof(float));
+    secure_zero(server->outputs, n * server->output_size * sizeof(float));
+    server->batch_count = 0;
+}
+
+// Answer everything queued by conn before sending it anything else, so
+// responses keep request order
+static void send_request_error(QrmeServer* server, Connection* conn, QrmeErrorCode code, const char* message) {
+    if (conn->queued) {
+        run_batch(server);
+    }
+    send_error_frame(server, conn, code, message);
+}
+
+static void fail_connection(QrmeServer* server, Connection* conn, QrmeErrorCode code, const char* message) {
+    TRACE_WARN(TRACE_CAT_SERVER, "Closing connection %d: %s", conn->fd, message);
+    send_request_error(server, conn, code, message);
+    conn->closing = 1;
+    if (conn->out.start == conn->out.len) {
+        conn->dead = 1;
+    }
+}
+
+static void handle_hello(QrmeServer* server, Connection* conn, const uint8_t* payload, size_t len) {
+    if (conn->session) {
+        fail_connection(server, conn, QRME_ERR_STATE, "Session already established");
+        return;
+    }
+    if (session_accept(server->secret_key, server->secret_key_len, payload, len, &conn->session) != 0) {
+        fail_connection(server, conn, qrme_last_error(), get_session_error());
+        return;
+    }
+    uint8_t ready[8];
+    put_le32(ready, (uint32_t)server->input_size);
+    put_le32(ready + 4, (uint32_t)server->output_size);
+    queue_frame(server, conn, SERVER_FRAME_READY, ready, sizeof(ready));
+}
+
+static void handle_request(QrmeServer* server, Connection* conn, const uint8_t* payload, size_t len) {
+    if (!conn->session) {
+        fail_connection(server, conn, QRME_ERR_STATE, "Request before session hello");
+        return;
+    }
+    uint8_t* plaintext = NULL;
+    size_t plaintext_len;
+    if (session_decrypt(conn->session, payload, len, &plaintext, &plaintext_len) != 0) {
+        // The session can no longer be trusted
+        fail_connection(server, conn, qrme_last_error(), get_session_error());
+        return;
+    }
+    if (plaintext_len != server->input_size * sizeof(float)) {
+        cleanup((void**)&plaintext);
+        send_request_error(server, conn, QRME_ERR_INVALID_ARGUMENT, "Input size mismatch");
+        return;
+    }
+
+    size_t slot = server->batch_count++;
+    server->owners[slot] = conn;
+    memcpy(server->inputs + slot * server->input_size, plaintext, plaintext_len);
+    cleanup((void**)&plaintext);
+    float_array_from_le(server->inputs + slot * server->input_size, server->input_size);
+    conn->queued++;
+
+    if (server->batch_count == server->config.max_batch_size) {
+        run_batch(server);
+    } else if (slot == 0 && server->config.max_wait_us > 0) {
+        arm_timer(server, server->config.max_wait_us);
+    }
+}
+
+// Handle every complete frame in the input buffer
+static void process_frames(QrmeServer* server, Connection* conn) {
+    Buffer* in = &conn->in;
+    while (!conn->dead && !conn->closing && in->len - in->start >= SERVER_FRAME_HEADER_SIZE) {
+        const uint8_t* frame = in->data + in->start;
+        size_t len = get_le32(frame);
+        uint8_t type = frame[4];
+        if (len > server->config.max_frame_bytes) {
+            fail_connection(server, conn, QRME_ERR_INVALID_ARGUMENT, "Frame too large");
+            return;
+        }
+        if (in->len - in->start < SERVER_FRAME_HEADER_SIZE + len) {
+            return;
+        }
+        in->start += SERVER_FRAME_HEADER_SIZE + len;
+
+        const uint8_t* payload = frame + SERVER_FRAME_HEADER_SIZE;
+        if (type == SERVER_FRAME_HELLO) {
+            handle_hello(server, conn, payload, len);
+        } else if (type == SERVER_FRAME_REQUEST) {
+            handle_request(server, conn, payload, len);
+        } else {
+            fail_connection(server, conn, QRME_ERR_FORMAT, "Unknown frame type");
+        }
+    }
+}
+
+static void connection_read(QrmeServer* server, Connection* conn) {
+    while (!conn->dead && !conn->closing) {
+        if (buffer_reserve(&conn->in, READ_CHUNK_SIZE) != 0) {
+            conn->dead = 1;
+            return;
+        }
+        ssize_t n = recv(conn->fd, conn->in.data + conn->in.len, READ_CHUNK_SIZE, 0);
+        if (n > 0) {
+            conn->in.len += (size_t)n;
+            process_frames(server, conn);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        } else {
+            conn->dead = 1;
+        }
+    }
+}
+
+static void accept_connections(QrmeServer* server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (server->num_connections >= server->config.max_connections) {
+            TRACE_WARN(TRACE_CAT_SERVER, "Refusing connection: %zu already open", server->num_connections);
+            close(fd);
+            continue;
+        }
+
+        Connection* conn = calloc(1, sizeof(Connection));
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (!conn || (conn->fd = fd, epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->next = server->connections;
+        server->connections = conn;
+        server->num_connections++;
+        __atomic_store_n(&server->stats.connections, server->num_connections, __ATOMIC_RELAXED);
+        TRACE_DEBUG(TRACE_CAT_SERVER, "Accepted connection %d", fd);
+    }
+}
+
+// Drop a connection's requests from the current batch
+static void unqueue_connection(QrmeServer* server, Connection* conn) {
+    size_t kept = 0;
+    for (size_t i = 0; i < server->batch_count; i++) {
+        if (server->owners[i] == conn) {
+            continue;
+        }
+        if (kept != i) {
+            server->owners[kept] = server->owners[i];
+            memcpy(server->inputs + kept * server->input_size, server->inputs + i * server->input_size,
+                   server->input_size * sizeof(float));
+        }
+        kept++;
+    }
+    secure_zero(server->inputs + kept * server->input_size,
+                (server->batch_count - kept) * server->input_size * sizeof(float));
+    server->batch_count = kept;
+    conn->queued = 0;
+    if (kept == 0) {
+        arm_timer(server, 0);
+    }
+}
+
+static void destroy_connection(QrmeServer* server, Connection* conn) {
+    if (conn->queued) {
+        unqueue_connection(server, conn);
+    }
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free_session(conn->session);
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+// Connections are only freed here, after a loop iteration, so pointers
+// held by the batch and by pending events stay valid while it runs
+static void reap_connections(QrmeServer* server) {
+    Connection** link = &server->connections;
+    while (*link) {
+        Connection* conn = *link;
+        if (conn->dead) {
+            *link = conn->next;
+            TRACE_DEBUG(TRACE_CAT_SERVER, "Closed connection %d", conn->fd);
+            destroy_connection(server, conn);
+            server->num_connections--;
+        } else {
+            link = &conn->next;
+        }
+    }
+    __atomic_store_n(&server->stats.connections, server->num_connections, __ATOMIC_RELAXED);
+}
+
+static int add_to_epoll(int epoll_fd, int fd, void* tag) {
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+QrmeServer* create_server(const ServerConfig* config, const Model* model,
+                          const uint8_t* secret_key, size_t secret_key_len) {
+    struct sockaddr_un address;
+    if (!config || !model || !secret_key || secret_key_len == 0 || config->max_batch_size == 0 ||
+        config->max_connections == 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for create_server");
+        return NULL;
+    }
+    if (fill_socket_address(&address, config->socket_path) != 0) {
+        return NULL;
+    }
+    if (!model->plan.valid) {
+        set_error(QRME_ERR_STATE, "Model has no valid execution plan");
+        return NULL;
+    }
+    size_t max_width = model->plan.input_size > model->plan.output_size ?
+                       model->plan.input_size : model->plan.output_size;
+    if (max_width > SIZE_MAX / sizeof(float) / config->max_batch_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Batch too large");
+        return NULL;
+    }
+
+    QrmeServer* server = calloc(1, sizeof(QrmeServer));
+    if (!server) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for server");
+        return NULL;
+    }
+    server->listen_fd = server->epoll_fd = server->timer_fd = server->stop_fd = -1;
+    server->model = model;
+    server->config = *config;
+    server->input_size = model->plan.input_size;
+    server->output_size = model->plan.output_size;
+
+    size_t batch = config->max_batch_size;
+    server->socket_path = malloc(strlen(config->socket_path) + 1);
+    server->owners = calloc(batch, sizeof(Connection*));
+    server->inputs = secure_realloc(NULL, batch * server->input_size * sizeof(float));
+    server->outputs = secure_realloc(NULL, batch * server->output_size * sizeof(float));
+    // The key is held for the server's lifetime, so keep it in locked memory
+    server->secret_key = secure_key_alloc(secret_key_len);
+    server->secret_key_len = secret_key_len;
+    if (!server->socket_path || !server->owners || !server->inputs || !server->outputs ||
+        !server->secret_key) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for server");
+        goto fail;
+    }
+    strcpy(server->socket_path, config->socket_path);
+    server->config.socket_path = server->socket_path;
+    memcpy(server->secret_key, secret_key, secret_key_len);
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->epoll_fd < 0 || server->timer_fd < 0 || server->stop_fd < 0 || server->listen_fd < 0) {
+        set_error(QRME_ERR_RESOURCE, "Failed to create server descriptors");
+        goto fail;
+    }
+
+    unlink(server->socket_path);
+    if (bind(server->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listen_fd, SOMAXCONN) != 0) {
+        set_error(QRME_ERR_IO, "Failed to listen on socket path");
+        goto fail;
+    }
+    if (add_to_epoll(server->epoll_fd, server->listen_fd, &listener_tag) != 0 ||
+        add_to_epoll(server->epoll_fd, server->timer_fd, &timer_tag) != 0 ||
+        add_to_epoll(server->epoll_fd, server->stop_fd, &stop_tag) != 0) {
+        set_error(QRME_ERR_RESOURCE, "Failed to register server descriptors");
+        goto fail;
+    }
+
+    TRACE_INFO(TRACE_CAT_SERVER, "Listening on %s (batch %zu, wait %u us)",
+               server->socket_path, batch, config->max_wait_us);
+    return server;
+
+fail:
+    free_server(server);
+    return NULL;
+}
+
+int server_run(QrmeServer* server) {
+    if (!server) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid server");
+        return -1;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    int stopping = 0;
+    while (!stopping) {
+        int n = epoll_wait(server->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(QRME_ERR_RESOURCE, "Failed to wait for server events");
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            void* tag = events[i].data.ptr;
+            uint64_t count;
+            if (tag == &listener_tag) {
+                accept_connections(server);
+            } else if (tag == &timer_tag) {
+                if (read(server->timer_fd, &count, sizeof(count)) == sizeof(count)) {
+                    run_batch(server);
+                }
+            } else if (tag == &stop_tag) {
+                stopping = 1;
+            } else {
+                Connection* conn = tag;
+                if (conn->dead) {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    connection_write(server, conn);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    connection_read(server, conn);
+                }
+            }
+        }
+
+        // Without a wait, whatever arrived together forms the batch
+        if (server->config.max_wait_us == 0) {
+            run_batch(server);
+        }
+        reap_connections(server);
+    }
+
+    // Answer what is already queued before returning
+    run_batch(server);
+    reap_connections(server);
+    uint64_t count;
+    while (read(server->stop_fd, &count, sizeof(count)) == sizeof(count)) {
+    }
+    TRACE_INFO(TRACE_CAT_SERVER, "Stopped");
+    return 0;
+}
+
+void server_stop(QrmeServer* server) {
+    if (server && server->stop_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(server->stop_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void get_server_stats(const QrmeServer* server, ServerStats* stats) {
+    if (!server || !stats) {
+        return;
+    }
+    stats->connections = __atomic_load_n(&server->stats.connections, __ATOMIC_RELAXED);
+    stats->requests = __atomic_load_n(&server->stats.requests, __ATOMIC_RELAXED);
+    stats->errors = __atomic_load_n(&server->stats.errors, __ATOMIC_RELAXED);
+    stats->batches = __atomic_load_n(&server->stats.batches, __ATOMIC_RELAXED);
+    stats->largest_batch = __atomic_load_n(&server->stats.largest_batch, __ATOMIC_RELAXED);
+}
+
+void free_server(QrmeServer* server) {
+    if (!server) {
+        return;
+    }
+    while (server->connections) {
+        Connection* conn = server->connections;
+        server->connections = conn->next;
+        destroy_connection(server, conn);
+    }
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        unlink(server->socket_path);
+    }
+    if (server->epoll_fd >= 0) close(server->epoll_fd);
+    if (server->timer_fd >= 0) close(server->timer_fd);
+    if (server->stop_fd >= 0) close(server->stop_fd);
+    secure_key_free((void**)&server->secret_key, server->secret_key_len);
+    if (server->inputs) secure_free((void**)&server->inputs);
+    if (server->outputs) secure_free((void**)&server->outputs);
+    free(server->owners);
+    free(server->socket_path);
+    free(server);
+}
+
+#else
+
+QrmeServer* create_server(const ServerConfig* config, const Model* model,
+                          const uint8_t* secret_key, size_t secret_key_len) {
+    (void)config;
+    (void)model;
+    (void)secret_key;
+    (void)secret_key_len;
+    set_error(QRME_ERR_UNSUPPORTED, "The inference server requires Linux");
+    return NULL;
+}
+
+int server_run(QrmeServer* server) {
+    (void)server;
+    set_error(QRME_ERR_UNSUPPORTED, "The inference server requires Linux");
+    return -1;
+}
+
+void server_stop(QrmeServer* server) {
+    (void)server;
+}
+
+void get_server_stats(const QrmeServer* server, ServerStats* stats) {
+    (void)server;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void free_server(QrmeServer* server) {
+    (void)server;
+}
+
+#endif /* __linux__ */
+
+struct QrmeClient {
+    int fd;
+    QrmeSession* session;
+    size_t input_size;
+    size_t output_size;
+};
+
+static int write_all(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            set_error(QRME_ERR_IO, "Failed to write to server");
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            set_error(QRME_ERR_IO, "Failed to read from server");
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_frame(int fd, uint8_t type, const uint8_t* payload, size_t len) {
+    uint8_t header[SERVER_FRAME_HEADER_SIZE];
+    if (len > UINT32_MAX) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Frame too large");
+        return -1;
+    }
+    put_le32(header, (uint32_t)len);
+    header[4] = type;
+    if (write_all(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    return write_all(fd, payload, len);
+}
+
+// Read one frame; an error frame is turned into this thread's error
+static int read_frame(int fd, uint8_t* type, uint8_t** payload, size_t* len) {
+    uint8_t header[SERVER_FRAME_HEADER_SIZE];
+    if (read_all(fd, header, sizeof(header)) != 0) {
+        return -1;
+    }
+    *len = get_le32(header);
+    *type = header[4];
+    *payload = malloc(*len ? *len : 1);
+    if (!*payload) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for frame");
+        return -1;
+    }
+    if (read_all(fd, *payload, *len) != 0) {
+        free(*payload);
+        *payload = NULL;
+        return -1;
+    }
+
+    if (*type == SERVER_FRAME_ERROR) {
+        char message[257];
+        size_t message_len = *len > 4 ? *len - 4 : 0;
+        if (message_len > 256) {
+            message_len = 256;
+        }
+        memcpy(message, *payload + 4, message_len);
+        message[message_len] = '\0';
+        QrmeErrorCode code = *len >= 4 ? (QrmeErrorCode)get_le32(*payload) : QRME_ERR_FORMAT;
+        set_error(code, message);
+        free(*payload);
+        *payload = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+QrmeClient* client_connect(const char* socket_path, const uint8_t* public_key, size_t public_key_len) {
+    struct sockaddr_un address;
+    uint8_t* kem_ciphertext = NULL;
+    size_t kem_ciphertext_len;
+    uint8_t* payload = NULL;
+    size_t len;
+    uint8_t type;
+
+    if (!public_key || fill_socket_address(&address, socket_path) != 0) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for client_connect");
+        return NULL;
+    }
+    QrmeClient* client = calloc(1, sizeof(QrmeClient));
+    if (!client) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for client");
+        return NULL;
+    }
+
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        set_error(QRME_ERR_IO, "Failed to connect to server");
+        goto fail;
+    }
+
+    if (session_initiate(public_key, public_key_len, &client->session,
+                         &kem_ciphertext, &kem_ciphertext_len) != 0) {
+        set_error(qrme_last_error(), get_session_error());
+        goto fail;
+    }
+    if (write_frame(client->fd, SERVER_FRAME_HELLO, kem_ciphertext, kem_ciphertext_len) != 0 ||
+        read_frame(client->fd, &type, &payload, &len) != 0) {
+        goto fail;
+    }
+    if (type != SERVER_FRAME_READY || len != 8) {
+        set_error(QRME_ERR_FORMAT, "Unexpected reply to session hello");
+        goto fail;
+    }
+    client->input_size = get_le32(payload);
+    client->output_size = get_le32(payload + 4);
+    free(payload);
+    cleanup((void**)&kem_ciphertext);
+    return client;
+
+fail:
+    free(payload);
+    cleanup((void**)&kem_ciphertext);
+    client_close(client);
+    return NULL;
+}
+
+void client_model_sizes(const QrmeClient* client, size_t* input_size, size_t* output_size) {
+    if (input_size) {
+        *input_size = client ? client->input_size : 0;
+    }
+    if (output_size) {
+        *output_size = client ? client->output_size : 0;
+    }
+}
+
+int client_submit(QrmeClient* client, const float* input, size_t input_size) {
+    if (!client || !input || input_size != client->input_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for client_submit");
+        return -1;
+    }
+    uint8_t* ciphertext = NULL;
+    size_t ciphertext_len;
+#if QRME_HOST_BIG_ENDIAN
+    // The encoding differs from the in-memory layout, so swap into scratch
+    float* encoded = secure_alloc(input_size * sizeof(float));
+    if (!encoded) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for float encoding");
+        return -1;
+    }
+    memcpy(encoded, input, input_size * sizeof(float));
+    float_array_to_le(encoded, input_size);
+    input = encoded;
+#endif
+    int encrypted = session_encrypt(client->session, (const uint8_t*)input, input_size * sizeof(float),
+                                    &ciphertext, &ciphertext_len) == 0;
+#if QRME_HOST_BIG_ENDIAN
+    secure_free((void**)&encoded);
+#endif
+    if (!encrypted) {
+        set_error(qrme_last_error(), get_session_error());
+        return -1;
+    }
+    int ret = write_frame(client->fd, SERVER_FRAME_REQUEST, ciphertext, ciphertext_len);
+    cleanup((void**)&ciphertext);
+    return ret;
+}
+
+int client_receive(QrmeClient* client, float* output, size_t output_size) {
+    if (!client || !output || output_size != client->output_size) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for client_receive");
+        return -1;
+    }
+    uint8_t* payload = NULL;
+    size_t len;
+    uint8_t type;
+    if (read_frame(client->fd, &type, &payload, &len) != 0) {
+        return -1;
+    }
+    if (type != SERVER_FRAME_RESPONSE) {
+        free(payload);
+        set_error(QRME_ERR_FORMAT, "Unexpected frame from server");
+        return -1;
+    }
+
+    uint8_t* plaintext = NULL;
+    size_t plaintext_len;
+    int ret = session_decrypt(client->session, payload, len, &plaintext, &plaintext_len);
+    free(payload);
+    if (ret != 0) {
+        set_error(qrme_last_error(), get_session_error());
+        return -1;
+    }
+    if (plaintext_len != output_size * sizeof(float)) {
+        cleanup((void**)&plaintext);
+        set_error(QRME_ERR_FORMAT, "Output size mismatch");
+        return -1;
+    }
+    memcpy(output, plaintext, plaintext_len);
+    cleanup((void**)&plaintext);
+    float_array_from_le(output, output_size);
+    return 0;
+}
+
+int client_infer(QrmeClient* client, const float* input, size_t input_size,
+                 float* output, size_t output_size) {
+    if (client_submit(client, input, input_size) != 0) {
+        return -1;
+    }
+    return client_receive(client, output, output_size);
+}
+
+void client_close(QrmeClient* client) {
+    if (!client) {
+        return;
+    }
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+    free_session(client->session);
+    free(client);
+}
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <oqs/oqs.h>
+#include <openssl/evp.h>
+#include "../include/encryption.h"
+#include "../include/session.h"
+#include "../include/error.h"
+#include "../include/utils.h"
+
+#define AES_256_KEY_SIZE 32
+#define GCM_IV_SIZE 12
+#define GCM_TAG_SIZE 16
+#define NONCE_PREFIX_SIZE 4
+#define SEQ_SIZE 8
+#define SESSION_INFO "qrme session v1"
+
+// Key material produced by HKDF: two directional keys and nonce prefixes
+#define SESSION_KEY_MATERIAL_SIZE (2 * (AES_256_KEY_SIZE + NONCE_PREFIX_SIZE))
+
+struct QrmeSession {
+    EVP_CIPHER_CTX* tx;
+    EVP_CIPHER_CTX* rx;
+    uint8_t tx_prefix[NONCE_PREFIX_SIZE];
+    uint8_t rx_prefix[NONCE_PREFIX_SIZE];
+    uint64_t tx_seq;            // next sequence number to send
+    uint64_t rx_seq;            // lowest sequence number still acceptable
+};
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_SESSION, code, message);
+}
+
+const char* get_session_error(void) {
+    return qrme_module_error(QRME_MODULE_SESSION);
+}
+
+static void store_be64(uint8_t* out, uint64_t value) {
+    for (int i = SEQ_SIZE - 1; i >= 0; i--) {
+        out[i] = (uint8_t)value;
+        value >>= 8;
+    }
+}
+
+static uint64_t load_be64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < SEQ_SIZE; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// The initiator sends with the first key and receives with the second; the
+// acceptor does the opposite
+static QrmeSession* create_session(const uint8_t* key_material, int is_initiator) {
+    const uint8_t* first = key_material;
+    const uint8_t* second = key_material + AES_256_KEY_SIZE + NONCE_PREFIX_SIZE;
+    const uint8_t* tx = is_initiator ? first : second;
+    const uint8_t* rx = is_initiator ? second : first;
+
+    QrmeSession* session = secure_realloc(NULL, sizeof(QrmeSession));
+    if (!session) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for session");
+        return NULL;
+    }
+    memset(session, 0, sizeof(QrmeSession));
+
+    session->tx = EVP_CIPHER_CTX_new();
+    session->rx = EVP_CIPHER_CTX_new();
+    if (!session->tx || !session->rx) {
+        set_error(QRME_ERR_CRYPTO, "Error creating cipher context");
+        goto fail;
+    }
+
+    // Bind the keys once; each message only supplies a fresh nonce
+    if (EVP_EncryptInit_ex(session->tx, EVP_aes_256_gcm(), NULL, tx, NULL) != 1 ||
+        EVP_DecryptInit_ex(session->rx, EVP_aes_256_gcm(), NULL, rx, NULL) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error initializing session ciphers");
+        goto fail;
+    }
+
+    memcpy(session->tx_prefix, tx + AES_256_KEY_SIZE, NONCE_PREFIX_SIZE);
+    memcpy(session->rx_prefix, rx + AES_256_KEY_SIZE, NONCE_PREFIX_SIZE);
+    return session;
+
+fail:
+    free_session(session);
+    return NULL;
+}
+
+int session_initiate(const uint8_t* public_key, size_t public_key_len,
+                     QrmeSession** session,
+                     uint8_t** kem_ciphertext, size_t* kem_ciphertext_len) {
+    OQS_KEM* kem = NULL;
+    uint8_t* shared_secret = NULL;
+    uint8_t key_material[SESSION_KEY_MATERIAL_SIZE];
+    int ret = -1;
+
+    if (!public_key || !session || !kem_ciphertext || !kem_ciphertext_len) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for session_initiate");
+        return ret;
+    }
+    *session = NULL;
+    *kem_ciphertext = NULL;
+
+    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    if (kem == NULL) {
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
+        return ret;
+    }
+
+    if (public_key_len != kem->length_public_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid public key length");
+        goto cleanup;
+    }
+
+    *kem_ciphertext = secure_realloc(NULL, kem->length_ciphertext);
+    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
+    if (!*kem_ciphertext || !shared_secret) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory");
+        goto cleanup;
+    }
+
+    if (OQS_KEM_encaps(kem, *kem_ciphertext, shared_secret, public_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM encapsulation");
+        goto cleanup;
+    }
+
+    // Salt with the KEM ciphertext so the keys are bound to this encapsulation
+    if (hkdf_sha256(shared_secret, kem->length_shared_secret,
+                    *kem_ciphertext, kem->length_ciphertext, SESSION_INFO,
+                    key_material, sizeof(key_material)) != 0) {
+        set_error(QRME_ERR_CRYPTO, "Error deriving session keys");
+        goto cleanup;
+    }
+
+    *session = create_session(key_material, 1);
+    if (!*session) {
+        goto cleanup;
+    }
+    *kem_ciphertext_len = kem->length_ciphertext;
+
+    ret = 0;  // Success
+
+cleanup:
+    OQS_MEM_cleanse(key_material, sizeof(key_material));
+    secure_free((void**)&shared_secret);
+    if (ret != 0 && *kem_ciphertext) {
+        secure_free((void**)kem_ciphertext);
+        *kem_ciphertext = NULL;
+    }
+    OQS_KEM_free(kem);
+    return ret;
+}
+
+int session_accept(const uint8_t* secret_key, size_t secret_key_len,
+                   const uint8_t* kem_ciphertext, size_t kem_ciphertext_len,
+                   QrmeSession** session) {
+    OQS_KEM* kem = NULL;
+    uint8_t* shared_secret = NULL;
+    uint8_t key_material[SESSION_KEY_MATERIAL_SIZE];
+    int ret = -1;
+
+    if (!secret_key || !kem_ciphertext || !session) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for session_accept");
+        return ret;
+    }
+    *session = NULL;
+
+    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    if (kem == NULL) {
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
+        return ret;
+    }
+
+    if (secret_key_len != kem->length_secret_key ||
+        kem_ciphertext_len != kem->length_ciphertext) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid key or KEM ciphertext length");
+        goto cleanup;
+    }
+
+    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
+    if (!shared_secret) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory");
+        goto cleanup;
+    }
+
+    if (OQS_KEM_decaps(kem, shared_secret, kem_ciphertext, secret_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM decapsulation");
+        goto cleanup;
+    }
+
+    if (hkdf_sha256(shared_secret, kem->length_shared_secret,
+                    kem_ciphertext, kem_ciphertext_len, SESSION_INFO,
+                    key_material, sizeof(key_material)) != 0) {
+        set_error(QRME_ERR_CRYPTO, "Error deriving session keys");
+        goto cleanup;
+    }
+
+    *session = create_session(key_material, 0);
+    if (!*session) {
+        goto cleanup;
+    }
+
+    ret = 0;  // Success
+
+cleanup:
+    OQS_MEM_cleanse(key_material, sizeof(key_material));
+    secure_free((void**)&shared_secret);
+    OQS_KEM_free(kem);
+    return ret;
+}
+
+int session_encrypt(QrmeSession* session,
+                    const uint8_t* plaintext, size_t plaintext_len,
+                    uint8_t** ciphertext, size_t* ciphertext_len) {
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t* out;
+    int len;
+
+    if (!session || (!plaintext && plaintext_len) || !ciphertext || !ciphertext_len) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for session_encrypt");
+        return -1;
+    }
+    if (plaintext_len > INT_MAX) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Plaintext too large");
+        return -1;
+    }
+    if (session->tx_seq == UINT64_MAX) {
+        set_error(QRME_ERR_STATE, "Session sequence numbers exhausted");
+        return -1;
+    }
+
+    // Message layout: sequence number + AES ciphertext + tag
+    *ciphertext_len = SEQ_SIZE + plaintext_len + GCM_TAG_SIZE;
+    out = secure_realloc(NULL, *ciphertext_len);
+    if (!out) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for ciphertext");
+        return -1;
+    }
+
+    store_be64(out, session->tx_seq);
+    memcpy(iv, session->tx_prefix, NONCE_PREFIX_SIZE);
+    memcpy(iv + NONCE_PREFIX_SIZE, out, SEQ_SIZE);
+
+    if (EVP_EncryptInit_ex(session->tx, NULL, NULL, NULL, iv) != 1 ||
+        EVP_EncryptUpdate(session->tx, NULL, &len, out, SEQ_SIZE) != 1 ||
+        EVP_EncryptUpdate(session->tx, out + SEQ_SIZE, &len, plaintext, (int)plaintext_len) != 1 ||
+        EVP_EncryptFinal_ex(session->tx, out + SEQ_SIZE + len, &len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(session->tx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE,
+                            out + SEQ_SIZE + plaintext_len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error encrypting session message");
+        secure_free((void**)&out);
+        return -1;
+    }
+
+    session->tx_seq++;
+    *ciphertext = out;
+    return 0;
+}
+
+int session_decrypt(QrmeSession* session,
+                    const uint8_t* ciphertext, size_t ciphertext_len,
+                    uint8_t** plaintext, size_t* plaintext_len) {
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t tag[GCM_TAG_SIZE];
+    uint64_t seq;
+    size_t body_len;
+    int len;
+
+    if (!session || !ciphertext || !plaintext || !plaintext_len) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for session_decrypt");
+        return -1;
+    }
+    *plaintext = NULL;
+
+    if (ciphertext_len < SEQ_SIZE + GCM_TAG_SIZE || ciphertext_len - SEQ_SIZE - GCM_TAG_SIZE > INT_MAX) {
+        set_error(QRME_ERR_FORMAT, "Invalid session message length");
+        return -1;
+    }
+    body_len = ciphertext_len - SEQ_SIZE - GCM_TAG_SIZE;
+
+    seq = load_be64(ciphertext);
+    if (seq < session->rx_seq) {
+        set_error(QRME_ERR_AUTH, "Replayed or out-of-order session message");
+        return -1;
+    }
+
+    memcpy(iv, session->rx_prefix, NONCE_PREFIX_SIZE);
+    memcpy(iv + NONCE_PREFIX_SIZE, ciphertext, SEQ_SIZE);
+    memcpy(tag, ciphertext + ciphertext_len - GCM_TAG_SIZE, GCM_TAG_SIZE);
+
+    // Always allocate at least one byte so empty messages still get a buffer
+    *plaintext = secure_realloc(NULL, body_len ? body_len : 1);
+    if (!*plaintext) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for plaintext");
+        return -1;
+    }
+
+    if (EVP_DecryptInit_ex(session->rx, NULL, NULL, NULL, iv) != 1 ||
+        EVP_DecryptUpdate(session->rx, NULL, &len, ciphertext, SEQ_SIZE) != 1 ||
+        EVP_DecryptUpdate(session->rx, *plaintext, &len, ciphertext + SEQ_SIZE, (int)body_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(session->rx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, tag) != 1 ||
+        EVP_DecryptFinal_ex(session->rx, *plaintext + len, &len) != 1) {
+        set_error(QRME_ERR_AUTH, "Error decrypting session message");
+        secure_free((void**)plaintext);
+        *plaintext = NULL;
+        return -1;
+    }
+
+    // Only advance the window once the message has authenticated
+    session->rx_seq = seq + 1;
+    *plaintext_len = body_len;
+    return 0;
+}
+
+void free_session(QrmeSession* session) {
+    if (!session) {
+        return;
+    }
+    // EVP_CIPHER_CTX_free() wipes the expanded key schedules
+    if (session->tx) EVP_CIPHER_CTX_free(session->tx);
+    if (session->rx) EVP_CIPHER_CTX_free(session->rx);
+    OQS_MEM_cleanse(session, sizeof(QrmeSession));
+    secure_free((void**)&session);
+}
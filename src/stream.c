@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <oqs/oqs.h>
+#include <openssl/evp.h>
+#include "../include/encryption.h"
+#include "../include/stream.h"
+#include "../include/error.h"
+#include "../include/utils.h"
+
+#define AES_256_KEY_SIZE 32
+#define GCM_IV_SIZE 12
+#define NONCE_PREFIX_SIZE 4
+#define STREAM_MAGIC "QRS1"
+#define STREAM_MAGIC_SIZE 4
+#define STREAM_PREAMBLE_SIZE (STREAM_MAGIC_SIZE + 4)  // magic + chunk size
+#define STREAM_AAD_SIZE 9                             // chunk index + final flag
+#define STREAM_INFO "qrme stream v1"
+
+struct QrmeStream {
+    EVP_CIPHER_CTX* cipher;
+    uint8_t nonce_prefix[NONCE_PREFIX_SIZE];
+    size_t chunk_size;
+    uint64_t index;             // index of the next chunk
+    int finished;               // set once the final chunk has been processed
+};
+
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_STREAM, code, message);
+}
+
+const char* get_stream_error(void) {
+    return qrme_module_error(QRME_MODULE_STREAM);
+}
+
+static void build_nonce_and_aad(const QrmeStream* stream, int is_final,
+                                uint8_t* iv, uint8_t* aad) {
+    uint64_t index = stream->index;
+    for (int i = 7; i >= 0; i--) {
+        aad[i] = (uint8_t)index;
+        index >>= 8;
+    }
+    aad[8] = is_final ? 1 : 0;
+    memcpy(iv, stream->nonce_prefix, NONCE_PREFIX_SIZE);
+    memcpy(iv + NONCE_PREFIX_SIZE, aad, 8);
+}
+
+// Derive the chunk key from the shared secret, salted with the whole header
+// so that tampering with the magic or chunk size breaks every chunk
+static QrmeStream* create_stream(const uint8_t* shared_secret, size_t shared_secret_len,
+                                 const uint8_t* header, size_t header_len,
+                                 size_t chunk_size, int enc) {
+    uint8_t key_material[AES_256_KEY_SIZE + NONCE_PREFIX_SIZE];
+    QrmeStream* stream = secure_realloc(NULL, sizeof(QrmeStream));
+    if (!stream) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for stream");
+        return NULL;
+    }
+    memset(stream, 0, sizeof(QrmeStream));
+    stream->chunk_size = chunk_size;
+
+    if (hkdf_sha256(shared_secret, shared_secret_len, header, header_len, STREAM_INFO,
+                    key_material, sizeof(key_material)) != 0) {
+        set_error(QRME_ERR_CRYPTO, "Error deriving stream key");
+        goto fail;
+    }
+
+    if (!(stream->cipher = EVP_CIPHER_CTX_new())) {
+        set_error(QRME_ERR_CRYPTO, "Error creating cipher context");
+        goto fail;
+    }
+
+    if (EVP_CipherInit_ex(stream->cipher, EVP_aes_256_gcm(), NULL, key_material, NULL, enc) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error initializing stream cipher");
+        goto fail;
+    }
+    memcpy(stream->nonce_prefix, key_material + AES_256_KEY_SIZE, NONCE_PREFIX_SIZE);
+
+    OQS_MEM_cleanse(key_material, sizeof(key_material));
+    return stream;
+
+fail:
+    OQS_MEM_cleanse(key_material, sizeof(key_material));
+    free_stream(stream);
+    return NULL;
+}
+
+size_t stream_header_size(void) {
+    OQS_KEM* kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    size_t size = 0;
+    if (kem) {
+        size = STREAM_PREAMBLE_SIZE + kem->length_ciphertext;
+        OQS_KEM_free(kem);
+    }
+    return size;
+}
+
+int stream_encrypt_init(const uint8_t* public_key, size_t public_key_len,
+                        size_t chunk_size, QrmeStream** stream, uint8_t* header) {
+    OQS_KEM* kem = NULL;
+    uint8_t* shared_secret = NULL;
+    int ret = -1;
+
+    if (!public_key || !stream || !header) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for stream_encrypt_init");
+        return ret;
+    }
+    *stream = NULL;
+
+    if (chunk_size == 0) {
+        chunk_size = STREAM_DEFAULT_CHUNK_SIZE;
+    }
+    if (chunk_size > STREAM_MAX_CHUNK_SIZE) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid stream chunk size");
+        return ret;
+    }
+
+    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    if (kem == NULL) {
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
+        return ret;
+    }
+
+    if (public_key_len != kem->length_public_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid public key length");
+        goto cleanup;
+    }
+
+    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
+    if (!shared_secret) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory");
+        goto cleanup;
+    }
+
+    // Header: magic + little-endian chunk size + KEM ciphertext
+    memcpy(header, STREAM_MAGIC, STREAM_MAGIC_SIZE);
+    for (int i = 0; i < 4; i++) {
+        header[STREAM_MAGIC_SIZE + i] = (uint8_t)(chunk_size >> (8 * i));
+    }
+
+    if (OQS_KEM_encaps(kem, header + STREAM_PREAMBLE_SIZE, shared_secret, public_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM encapsulation");
+        goto cleanup;
+    }
+
+    *stream = create_stream(shared_secret, kem->length_shared_secret, header,
+                            STREAM_PREAMBLE_SIZE + kem->length_ciphertext, chunk_size, 1);
+    if (*stream) {
+        ret = 0;  // Success
+    }
+
+cleanup:
+    secure_free((void**)&shared_secret);
+    OQS_KEM_free(kem);
+    return ret;
+}
+
+int stream_decrypt_init(const uint8_t* secret_key, size_t secret_key_len,
+                        const uint8_t* header, QrmeStream** stream) {
+    OQS_KEM* kem = NULL;
+    uint8_t* shared_secret = NULL;
+    size_t chunk_size = 0;
+    int ret = -1;
+
+    if (!secret_key || !header || !stream) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for stream_decrypt_init");
+        return ret;
+    }
+    *stream = NULL;
+
+    if (memcmp(header, STREAM_MAGIC, STREAM_MAGIC_SIZE) != 0) {
+        set_error(QRME_ERR_FORMAT, "Invalid stream header");
+        return ret;
+    }
+    for (int i = 0; i < 4; i++) {
+        chunk_size |= (size_t)header[STREAM_MAGIC_SIZE + i] << (8 * i);
+    }
+    if (chunk_size == 0 || chunk_size > STREAM_MAX_CHUNK_SIZE) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid stream chunk size");
+        return ret;
+    }
+
+    kem = OQS_KEM_new(OQS_KEM_alg_kyber_768);
+    if (kem == NULL) {
+        set_error(QRME_ERR_CRYPTO, "Error creating KEM instance");
+        return ret;
+    }
+
+    if (secret_key_len != kem->length_secret_key) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid secret key length");
+        goto cleanup;
+    }
+
+    shared_secret = secure_realloc(NULL, kem->length_shared_secret);
+    if (!shared_secret) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory");
+        goto cleanup;
+    }
+
+    if (OQS_KEM_decaps(kem, shared_secret, header + STREAM_PREAMBLE_SIZE, secret_key) != OQS_SUCCESS) {
+        set_error(QRME_ERR_CRYPTO, "Error in KEM decapsulation");
+        goto cleanup;
+    }
+
+    *stream = create_stream(shared_secret, kem->length_shared_secret, header,
+                            STREAM_PREAMBLE_SIZE + kem->length_ciphertext, chunk_size, 0);
+    if (*stream) {
+        ret = 0;  // Success
+    }
+
+cleanup:
+    secure_free((void**)&shared_secret);
+    OQS_KEM_free(kem);
+    return ret;
+}
+
+int stream_encrypt_chunk(QrmeStream* stream, const uint8_t* chunk, size_t chunk_len,
+                         int is_final, uint8_t* record, size_t* record_len) {
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t aad[STREAM_AAD_SIZE];
+    int len;
+
+    if (!stream || (!chunk && chunk_len) || !record || !record_len) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for stream_encrypt_chunk");
+        return -1;
+    }
+    if (stream->finished) {
+        set_error(QRME_ERR_STATE, "Stream already finished");
+        return -1;
+    }
+    if (is_final ? chunk_len >= stream->chunk_size : chunk_len != stream->chunk_size) {
+        set_error(QRME_ERR_FORMAT, "Invalid stream chunk length");
+        return -1;
+    }
+
+    build_nonce_and_aad(stream, is_final, iv, aad);
+
+    if (EVP_EncryptInit_ex(stream->cipher, NULL, NULL, NULL, iv) != 1 ||
+        EVP_EncryptUpdate(stream->cipher, NULL, &len, aad, STREAM_AAD_SIZE) != 1 ||
+        EVP_EncryptUpdate(stream->cipher, record, &len, chunk, (int)chunk_len) != 1 ||
+        EVP_EncryptFinal_ex(stream->cipher, record + len, &len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(stream->cipher, EVP_CTRL_GCM_GET_TAG, STREAM_TAG_SIZE,
+                            record + chunk_len) != 1) {
+        set_error(QRME_ERR_CRYPTO, "Error encrypting stream chunk");
+        return -1;
+    }
+
+    *record_len = chunk_len + STREAM_TAG_SIZE;
+    stream->index++;
+    stream->finished = is_final;
+    return 0;
+}
+
+int stream_decrypt_chunk(QrmeStream* stream, const uint8_t* record, size_t record_len,
+                         uint8_t* chunk, size_t* chunk_len, int* is_final) {
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t aad[STREAM_AAD_SIZE];
+    uint8_t tag[STREAM_TAG_SIZE];
+    size_t body_len;
+    int final_chunk;
+    int len;
+
+    if (!stream || !record || !chunk_len || !is_final || (!chunk && record_len > STREAM_TAG_SIZE)) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for stream_decrypt_chunk");
+        return -1;
+    }
+    if (stream->finished) {
+        set_error(QRME_ERR_FORMAT, "Data after the final stream chunk");
+        return -1;
+    }
+    if (record_len < STREAM_TAG_SIZE || record_len > stream->chunk_size + STREAM_TAG_SIZE) {
+        set_error(QRME_ERR_FORMAT, "Invalid stream record length");
+        return -1;
+    }
+
+    body_len = record_len - STREAM_TAG_SIZE;
+    final_chunk = body_len < stream->chunk_size;
+    build_nonce_and_aad(stream, final_chunk, iv, aad);
+    memcpy(tag, record + body_len, STREAM_TAG_SIZE);
+
+    if (EVP_DecryptInit_ex(stream->cipher, NULL, NULL, NULL, iv) != 1 ||
+        EVP_DecryptUpdate(stream->cipher, NULL, &len, aad, STREAM_AAD_SIZE) != 1 ||
+        EVP_DecryptUpdate(stream->cipher, chunk, &len, record, (int)body_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(stream->cipher, EVP_CTRL_GCM_SET_TAG, STREAM_TAG_SIZE, tag) != 1 ||
+        EVP_DecryptFinal_ex(stream->cipher, chunk + len, &len) != 1) {
+        // Never hand back unauthenticated plaintext
+        if (chunk) OQS_MEM_cleanse(chunk, body_len);
+        set_error(QRME_ERR_AUTH, "Error authenticating stream chunk");
+        return -1;
+    }
+
+    *chunk_len = body_len;
+    *is_final = final_chunk;
+    stream->index++;
+    stream->finished = final_chunk;
+    return 0;
+}
+
+size_t stream_chunk_size(const QrmeStream* stream) {
+    return stream ? stream->chunk_size : 0;
+}
+
+void free_stream(QrmeStream* stream) {
+    if (!stream) {
+        return;
+    }
+    if (stream->cipher) EVP_CIPHER_CTX_free(stream->cipher);
+    OQS_MEM_cleanse(stream, sizeof(QrmeStream));
+    secure_free((void**)&stream);
+}
+
+int encrypt_stream_file(const uint8_t* public_key, size_t public_key_len,
+                        FILE* in, FILE* out, size_t chunk_size) {
+    QrmeStream* stream = NULL;
+    uint8_t* header = NULL;
+    uint8_t* chunk = NULL;
+    uint8_t* record = NULL;
+    size_t header_len = stream_header_size();
+    size_t chunk_len, record_len;
+    int ret = -1;
+
+    if (!in || !out) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for encrypt_stream_file");
+        return ret;
+    }
+
+    header = secure_realloc(NULL, header_len);
+    if (!header || stream_encrypt_init(public_key, public_key_len, chunk_size, &stream, header) != 0) {
+        if (!header) set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for stream header");
+        goto cleanup;
+    }
+
+    if (fwrite(header, 1, header_len, out) != header_len) {
+        set_error(QRME_ERR_IO, "Failed to write stream header");
+        goto cleanup;
+    }
+
+    chunk_size = stream_chunk_size(stream);
+    chunk = secure_realloc(NULL, chunk_size);
+    record = secure_realloc(NULL, chunk_size + STREAM_TAG_SIZE);
+    if (!chunk || !record) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for stream buffers");
+        goto cleanup;
+    }
+
+    // A short read marks the final chunk; an input that is an exact multiple
+    // of the chunk size ends with an empty final chunk
+    do {
+        chunk_len = fread(chunk, 1, chunk_size, in);
+        if (chunk_len < chunk_size && ferror(in)) {
+            set_error(QRME_ERR_IO, "Failed to read stream input");
+            goto cleanup;
+        }
+        if (stream_encrypt_chunk(stream, chunk, chunk_len, chunk_len < chunk_size,
+                                 record, &record_len) != 0) {
+            goto cleanup;
+        }
+        if (fwrite(record, 1, record_len, out) != record_len) {
+            set_error(QRME_ERR_IO, "Failed to write stream record");
+            goto cleanup;
+        }
+    } while (chunk_len == chunk_size);
+
+    ret = 0;  // Success
+
+cleanup:
+    free_stream(stream);
+    secure_free((void**)&header);
+    secure_free((void**)&chunk);
+    secure_free((void**)&record);
+    return ret;
+}
+
+int decrypt_stream_file(const uint8_t* secret_key, size_t secret_key_len,
+                        FILE* in, FILE* out) {
+    QrmeStream* stream = NULL;
+    uint8_t* header = NULL;
+    uint8_t* chunk = NULL;
+    uint8_t* record = NULL;
+    size_t header_len = stream_header_size();
+    size_t record_size, record_len, chunk_len;
+    int is_final = 0;
+    int ret = -1;
+
+    if (!in || !out) {
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Invalid parameters for decrypt_stream_file");
+        return ret;
+    }
+
+    header = secure_realloc(NULL, header_len);
+    if (!header) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for stream header");
+        goto cleanup;
+    }
+
+    if (fread(header, 1, header_len, in) != header_len) {
+        set_error(QRME_ERR_IO, "Failed to read stream header");
+        goto cleanup;
+    }
+
+    if (stream_decrypt_init(secret_key, secret_key_len, header, &stream) != 0) {
+        goto cleanup;
+    }
+
+    record_size = stream_chunk_size(stream) + STREAM_TAG_SIZE;
+    chunk = secure_realloc(NULL, stream_chunk_size(stream));
+    record = secure_realloc(NULL, record_size);
+    if (!chunk || !record) {
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Error allocating memory for stream buffers");
+        goto cleanup;
+    }
+
+    while (!is_final) {
+        record_len = fread(record, 1, record_size, in);
+        if (record_len < record_size && ferror(in)) {
+            set_error(QRME_ERR_IO, "Failed to read stream record");
+            goto cleanup;
+        }
+        if (record_len == 0) {
+            set_error(QRME_ERR_FORMAT, "Truncated stream: missing final chunk");
+            goto cleanup;
+        }
+        if (stream_decrypt_chunk(stream, record, record_len, chunk, &chunk_len, &is_final) != 0) {
+            goto cleanup;
+        }
+        if (chunk_len && fwrite(chunk, 1, chunk_len, out) != chunk_len) {
+            set_error(QRME_ERR_IO, "Failed to write stream output");
+            goto cleanup;
+        }
+    }
+
+    if (fgetc(in) != EOF) {
+        set_error(QRME_ERR_FORMAT, "Data after the final stream chunk");
+        goto cleanup;
+    }
+
+    ret = 0;  // Success
+
+cleanup:
+    free_stream(stream);
+    secure_free((void**)&header);
+    secure_free((void**)&chunk);
+    secure_free((void**)&record);
+    return ret;
+}
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "../include/threadpool.h"
+#include "../include/trace.h"
+
+#define INITIAL_QUEUE_CAPACITY 64
+
+typedef struct {
+    ThreadPoolTask task;
+    void* arg;
+} QueuedTask;
+
+// State shared by the chunks of one thread_pool_parallel_for() call; it
+// lives on the caller's stack until every submitted helper has finished
+typedef struct {
+    ThreadPool* pool;
+    ThreadPoolRangeTask task;
+    void* arg;
+    size_t n;
+    size_t parts;
+    size_t next_part;           // atomic: next chunk to claim
+    size_t helpers_finished;    // guarded by pool->lock
+} ParallelFor;
+
+struct ThreadPool {
+    pthread_t* threads;
+    size_t num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+    pthread_cond_t work_done;
+    QueuedTask* queue;          // ring buffer
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t active;              // tasks currently running
+    int shutting_down;
+};
+
+static void* worker_main(void* arg) {
+    ThreadPool* pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->count == 0 && !pool->shutting_down) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        if (pool->count == 0) {
+            break;  // shutting down with an empty queue
+        }
+
+        QueuedTask item = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        item.task(item.arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (pool->count == 0 && pool->active == 0) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+size_t resolve_thread_count(size_t num_threads) {
+    if (num_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = online > 0 ? (size_t)online : 1;
+    }
+    return num_threads;
+}
+
+ThreadPool* create_thread_pool(size_t num_threads) {
+    return create_thread_pool_ex(num_threads, NULL, 0);
+}
+
+ThreadPool* create_thread_pool_ex(size_t num_threads, const int* cpus, size_t num_cpus) {
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    num_threads = resolve_thread_count(num_threads);
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->queue = malloc(INITIAL_QUEUE_CAPACITY * sizeof(QueuedTask));
+    if (!pool->threads || !pool->queue) {
+        free(pool->threads);
+        free(pool->queue);
+        free(pool);
+        return NULL;
+    }
+    pool->capacity = INITIAL_QUEUE_CAPACITY;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+#ifdef __linux__
+        if (cpus && num_cpus > 0 && cpus[i % num_cpus] >= 0 && cpus[i % num_cpus] < CPU_SETSIZE) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % num_cpus], &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+#else
+        (void)cpus;
+        (void)num_cpus;
+#endif
+        int rc = pthread_create(&pool->threads[i], &attr, worker_main, pool);
+        if (rc != 0 && cpus) {
+            // The CPU may be offline or outside our cpuset; run unpinned
+            TRACE_WARN(TRACE_CAT_POOL, "Could not pin worker %zu, running it unpinned", i);
+            rc = pthread_create(&pool->threads[i], NULL, worker_main, pool);
+        }
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            break;
+        }
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        free_thread_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int thread_pool_submit(ThreadPool* pool, ThreadPoolTask task, void* arg) {
+    if (!pool || !task) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity) {
+        // Grow the ring, unwrapping it into the new buffer
+        size_t new_capacity = pool->capacity * 2;
+        QueuedTask* queue = malloc(new_capacity * sizeof(QueuedTask));
+        if (!queue) {
+            pthread_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < pool->count; i++) {
+            queue[i] = pool->queue[(pool->head + i) % pool->capacity];
+        }
+        free(pool->queue);
+        pool->queue = queue;
+        pool->capacity = new_capacity;
+        pool->head = 0;
+    }
+
+    pool->queue[(pool->head + pool->count) % pool->capacity] = (QueuedTask){task, arg};
+    pool->count++;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void thread_pool_wait(ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void run_parallel_parts(ParallelFor* pf) {
+    for (;;) {
+        size_t part = __atomic_fetch_add(&pf->next_part, 1, __ATOMIC_RELAXED);
+        if (part >= pf->parts) {
+            break;
+        }
+        size_t begin = pf->n * part / pf->parts;
+        size_t end = pf->n * (part + 1) / pf->parts;
+        pf->task(pf->arg, begin, end);
+    }
+}
+
+static void parallel_for_helper(void* arg) {
+    ParallelFor* pf = arg;
+    ThreadPool* pool = pf->pool;
+
+    run_parallel_parts(pf);
+
+    pthread_mutex_lock(&pool->lock);
+    pf->helpers_finished++;
+    pthread_cond_broadcast(&pool->work_done);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_parallel_for(ThreadPool* pool, size_t n, size_t grain,
+                              ThreadPoolRangeTask task, void* arg) {
+    if (!task || n == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    size_t parts = (n + grain - 1) / grain;
+    size_t max_parts = pool ? pool->num_threads + 1 : 1;
+    if (parts > max_parts) {
+        parts = max_parts;
+    }
+    if (parts == 1) {
+        task(arg, 0, n);
+        return;
+    }
+
+    ParallelFor pf = {pool, task, arg, n, parts, 0, 0};
+    size_t helpers = 0;
+    for (size_t i = 0; i < parts - 1; i++) {
+        if (thread_pool_submit(pool, parallel_for_helper, &pf) != 0) {
+            break;  // the caller picks up any unclaimed chunks
+        }
+        helpers++;
+    }
+
+    run_parallel_parts(&pf);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pf.helpers_finished < helpers) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+size_t thread_pool_size(const ThreadPool* pool) {
+    return pool ? pool->num_threads : 0;
+}
+
+void free_thread_pool(ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->threads);
+    free(pool->queue);
+    free(pool);
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "../include/trace.h"
+
+int trace_runtime_level = TRACE_LEVEL_WARN;
+unsigned trace_runtime_categories = TRACE_CAT_ALL;
+
+static int trace_sink = TRACE_SINK_STDERR;
+
+// A ring slot is a seqlock: state is odd while the record is being
+// written and 2 * sequence + 2 once it is complete, so readers can tell
+// a finished record from one that is torn or has been overwritten. The
+// record is copied in and out a word at a time with relaxed atomics so a
+// reader racing a writer sees a stale word rather than undefined behaviour
+#define RECORD_WORDS (sizeof(TraceRecord) / sizeof(uint64_t))
+
+_Static_assert(sizeof(TraceRecord) % sizeof(uint64_t) == 0,
+               "trace records must be a whole number of words");
+
+typedef struct {
+    uint64_t state;
+    uint64_t words[RECORD_WORDS];
+} RingSlot;
+
+static RingSlot ring[TRACE_RING_CAPACITY];
+static uint64_t ring_head;      // atomic: next sequence number
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void ring_write(TraceLevel level, TraceCategory category, const char* message) {
+    uint64_t sequence = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    RingSlot* slot = &ring[sequence % TRACE_RING_CAPACITY];
+
+    TraceRecord record;
+    record.sequence = sequence;
+    record.timestamp_ns = now_ns();
+    record.level = level;
+    record.category = category;
+    memcpy(record.message, message, TRACE_MESSAGE_SIZE);
+    uint64_t words[RECORD_WORDS];
+    memcpy(words, &record, sizeof(record));
+
+    // Claim the slot. Only a writer a full lap behind can meet another
+    // here: it waits out a write in progress and gives up to a newer one
+    uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+    for (;;) {
+        if (state & 1) {
+            state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (state >= 2 * sequence + 2) {
+            return;
+        }
+        if (__atomic_compare_exchange_n(&slot->state, &state, 2 * sequence + 1, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < RECORD_WORDS; i++) {
+        __atomic_store_n(&slot->words[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->state, 2 * sequence + 2, __ATOMIC_RELEASE);
+}
+
+void trace_emit(TraceLevel level, TraceCategory category, const char* format, ...) {
+    char message[TRACE_MESSAGE_SIZE] = {0};
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (__atomic_load_n(&trace_sink, __ATOMIC_RELAXED) == TRACE_SINK_RING) {
+        ring_write(level, category, message);
+    } else {
+        fprintf(stderr, "[qrme %s %s] %s\n", trace_level_name(level),
+                trace_category_name(category), message);
+    }
+}
+
+void trace_set_level(TraceLevel level) {
+    __atomic_store_n(&trace_runtime_level, (int)level, __ATOMIC_RELAXED);
+}
+
+void trace_set_categories(unsigned categories) {
+    __atomic_store_n(&trace_runtime_categories, categories, __ATOMIC_RELAXED);
+}
+
+void trace_set_sink(TraceSink sink) {
+    __atomic_store_n(&trace_sink, (int)sink, __ATOMIC_RELAXED);
+}
+
+size_t trace_ring_read(TraceRecord* records, size_t max) {
+    if (!records || max == 0) {
+        return 0;
+    }
+
+    uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+    if (head - first > max) {
+        first = head - max;
+    }
+
+    size_t count = 0;
+    for (uint64_t sequence = first; sequence < head; sequence++) {
+        const RingSlot* slot = &ring[sequence % TRACE_RING_CAPACITY];
+        uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        if (state != 2 * sequence + 2) {
+            continue;
+        }
+        uint64_t words[RECORD_WORDS];
+        for (size_t i = 0; i < RECORD_WORDS; i++) {
+            words[i] = __atomic_load_n(&slot->words[i], __ATOMIC_RELAXED);
+        }
+        memcpy(&records[count], words, sizeof(words));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->state, __ATOMIC_RELAXED) == state) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void trace_ring_clear(void) {
+    for (size_t i = 0; i < TRACE_RING_CAPACITY; i++) {
+        __atomic_store_n(&ring[i].state, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ring_head, 0, __ATOMIC_RELEASE);
+}
+
+const char* trace_level_name(TraceLevel level) {
+    switch (level) {
+    case TRACE_LEVEL_ERROR: return "error";
+    case TRACE_LEVEL_WARN: return "warn";
+    case TRACE_LEVEL_INFO: return "info";
+    case TRACE_LEVEL_DEBUG: return "debug";
+    default: return "off";
+    }
+}
+
+const char* trace_category_name(TraceCategory category) {
+    switch (category) {
+    case TRACE_CAT_CRYPTO: return "crypto";
+    case TRACE_CAT_MODEL: return "model";
+    case TRACE_CAT_ALLOC: return "alloc";
+    case TRACE_CAT_KERNEL: return "kernel";
+    case TRACE_CAT_POOL: return "pool";
+    case TRACE_CAT_FORMAT: return "format";
+    case TRACE_CAT_SERVER: return "server";
+    case TRACE_CAT_PIPELINE: return "pipeline";
+    default: return "all";
+    }
+}
@@ -3,83 +3,58 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
 #include "../include/utils.h"
+#include "../include/error.h"
 
-#define MAX_ERROR_LENGTH 256
 
-// Global error state
-static char error_message[MAX_ERROR_LENGTH] = {0};
-
-// Function to set error message
-void set_utils_error(const char* message) {
-    strncpy(error_message, message, MAX_ERROR_LENGTH - 1);
-    error_message[MAX_ERROR_LENGTH - 1] = '\0';
+static void set_error(QrmeErrorCode code, const char* message) {
+    qrme_set_error(QRME_MODULE_UTILS, code, message);
 }
 
-// Function to get error message
-const char* get_utils_error() {
-    return error_message;
+const char* get_utils_error(void) {
+    return qrme_module_error(QRME_MODULE_UTILS);
 }
 
-typedef struct {
-    size_t size;
-    char data[];
-} secure_alloc_t;
-
-void* secure_realloc(void* ptr, size_t size) {
-    if (ptr == NULL) {
-        secure_alloc_t* alloc = realloc(NULL, sizeof(secure_alloc_t) + size);
-        if (alloc) {
-            alloc->size = size;
-            memset(alloc->data, 0, size);
-            printf("secure_realloc: Allocated %zu bytes at %p (returned %p)\n", size, (void*)alloc, (void*)alloc->data);
-            return alloc->data;
-        }
-    } else {
-        secure_alloc_t* old_alloc = (secure_alloc_t*)((char*)ptr - offsetof(secure_alloc_t, data));
-        secure_alloc_t* new_alloc = realloc(old_alloc, sizeof(secure_alloc_t) + size);
-        if (new_alloc) {
-            if (size > new_alloc->size) {
-                memset((char*)new_alloc->data + new_alloc->size, 0, size - new_alloc->size);
-            }
-            new_alloc->size = size;
-            printf("secure_realloc: Reallocated %zu bytes at %p (returned %p)\n", size, (void*)new_alloc, (void*)new_alloc->data);
-            return new_alloc->data;
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void init_crc32_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
         }
+        crc32_table[i] = c;
     }
-    set_utils_error("Failed to allocate memory");
-    return NULL;
 }
 
-void secure_free(void** ptr) {
-    if (ptr != NULL && *ptr != NULL) {
-        // Check if the pointer is aligned correctly
-        if ((uintptr_t)*ptr % sizeof(void*) != 0) {
-            printf("secure_free: Warning - misaligned pointer %p\n", (void*)*ptr);
-            return;
-        }
-
-        // Check if we can safely access the memory
-        if (((char*)*ptr - sizeof(size_t)) < (char*)*ptr) {
-            printf("secure_free: Warning - cannot access memory before %p\n", (void*)*ptr);
-            return;
-        }
-
-        secure_alloc_t* alloc = (secure_alloc_t*)((char*)*ptr - offsetof(secure_alloc_t, data));
-
-        // Check if the size field looks reasonable
-        if (alloc->size == 0 || alloc->size > 1000000000) { // 1GB as an arbitrary large size
-            printf("secure_free: Warning - suspicious size %zu for pointer %p\n", alloc->size, (void*)*ptr);
-            return;
-        }
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+    pthread_once(&crc32_once, init_crc32_table);
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
 
-        printf("secure_free: Freeing %zu bytes at %p (original pointer %p)\n", alloc->size, (void*)alloc, (void*)*ptr);
-        memset(alloc->data, 0, alloc->size);
-        free(alloc);
-        *ptr = NULL;
-    } else {
-        printf("secure_free: Nothing to free (ptr is NULL or *ptr is NULL)\n");
+void float_array_to_le(float* values, size_t len) {
+#if QRME_HOST_BIG_ENDIAN
+    for (size_t i = 0; i < len; i++) {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        bits = __builtin_bswap32(bits);
+        memcpy(&values[i], &bits, sizeof(bits));
     }
+#else
+    (void)values;
+    (void)len;
+#endif
+}
+
+void float_array_from_le(float* values, size_t len) {
+    // The byte swap is its own inverse
+    float_array_to_le(values, len);
 }
 
 int float_to_byte_array(const float* float_array, size_t float_array_len,
@@ -87,33 +62,35 @@ int float_to_byte_array(const float* float_array, size_t float_array_len,
     *byte_array_len = float_array_len * sizeof(float);
     *byte_array = secure_realloc(NULL, *byte_array_len);
     if (!*byte_array) {
-        set_utils_error("Failed to allocate memory for byte array");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for byte array");
         return -1;
     }
     memcpy(*byte_array, float_array, *byte_array_len);
+    float_array_to_le((float*)*byte_array, float_array_len);
     return 0;
 }
 
 int byte_to_float_array(const uint8_t* byte_array, size_t byte_array_len,
                         float** float_array, size_t* float_array_len) {
     if (byte_array_len % sizeof(float) != 0) {
-        set_utils_error("Byte array length is not a multiple of sizeof(float)");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Byte array length is not a multiple of sizeof(float)");
         return -1;
     }
     *float_array_len = byte_array_len / sizeof(float);
     *float_array = secure_realloc(NULL, byte_array_len);
     if (!*float_array) {
-        set_utils_error("Failed to allocate memory for float array");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for float array");
         return -1;
     }
     memcpy(*float_array, byte_array, byte_array_len);
+    float_array_from_le(*float_array, *float_array_len);
     return 0;
 }
 
 float* generate_random_float_array(size_t len, float min, float max) {
     float* array = (float*)secure_realloc(NULL, len * sizeof(float));
     if (!array) {
-        set_utils_error("Failed to allocate memory for random float array");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for random float array");
         return NULL;
     }
 
@@ -155,7 +132,7 @@ float l2_norm(const float* a, size_t len) {
 void normalize(const float* a, float* result, size_t len) {
     float norm = l2_norm(a, len);
     if (norm == 0) {
-        set_utils_error("Cannot normalize zero vector");
+        set_error(QRME_ERR_INVALID_ARGUMENT, "Cannot normalize zero vector");
         return;
     }
     for (size_t i = 0; i < len; i++) {
@@ -196,13 +173,13 @@ void print_float_array(const float* array, size_t len, const char* name) {
 int save_float_array(const char* filename, const float* array, size_t len) {
     FILE* file = fopen(filename, "wb");
     if (!file) {
-        set_utils_error("Failed to open file for writing");
+        set_error(QRME_ERR_IO, "Failed to open file for writing");
         return -1;
     }
 
     size_t written = fwrite(array, sizeof(float), len, file);
     if (written != len) {
-        set_utils_error("Failed to write entire array to file");
+        set_error(QRME_ERR_IO, "Failed to write entire array to file");
         fclose(file);
         return -1;
     }
@@ -214,7 +191,7 @@ int save_float_array(const char* filename, const float* array, size_t len) {
 int load_float_array(const char* filename, float** array, size_t* len) {
     FILE* file = fopen(filename, "rb");
     if (!file) {
-        set_utils_error("Failed to open file for reading");
+        set_error(QRME_ERR_IO, "Failed to open file for reading");
         return -1;
     }
 
@@ -223,7 +200,7 @@ int load_float_array(const char* filename, float** array, size_t* len) {
     fseek(file, 0, SEEK_SET);
 
     if (file_size % sizeof(float) != 0) {
-        set_utils_error("File size is not a multiple of sizeof(float)");
+        set_error(QRME_ERR_FORMAT, "File size is not a multiple of sizeof(float)");
         fclose(file);
         return -1;
     }
@@ -231,14 +208,14 @@ int load_float_array(const char* filename, float** array, size_t* len) {
     *len = file_size / sizeof(float);
     *array = secure_realloc(NULL, file_size);
     if (!*array) {
-        set_utils_error("Failed to allocate memory for loaded array");
+        set_error(QRME_ERR_OUT_OF_MEMORY, "Failed to allocate memory for loaded array");
         fclose(file);
         return -1;
     }
 
     size_t read = fread(*array, sizeof(float), *len, file);
     if (read != *len) {
-        set_utils_error("Failed to read entire array from file");
+        set_error(QRME_ERR_IO, "Failed to read entire array from file");
         secure_free((void**)array);
         fclose(file);
         return -1;
@@ -2,9 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <math.h>
+#include <stdint.h>
 #include "../include/encryption.h"
+#include "../include/error.h"
+#include "../include/format.h"
+#include "../include/kernels.h"
 #include "../include/model.h"
+#include "../include/pipeline.h"
+#include "../include/secure_arena.h"
+#include "../include/server.h"
+#include "../include/session.h"
+#include "../include/stream.h"
+#include "../include/trace.h"
 #include "../include/utils.h"
 
 #define TEST_MESSAGE "Hello, LLM and Quantum World!"
@@ -55,6 +67,493 @@ static void test_encryption_decryption(void) {
     cleanup((void**)&decrypted);
 }
 
+static void test_crypto_ctx_reuse(void) {
+    uint8_t *public_key = NULL, *secret_key = NULL, *ciphertext = NULL, *decrypted = NULL;
+    size_t public_key_len, secret_key_len, ciphertext_len, decrypted_len;
+    const uint8_t *plaintext = (const uint8_t *)TEST_MESSAGE;
+    size_t plaintext_len = strlen(TEST_MESSAGE);
+    QrmeCryptoCtx *ctx = create_crypto_ctx();
+
+    assert(ctx != NULL);
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        assert(encrypt_ctx(ctx, public_key, public_key_len, plaintext, plaintext_len,
+                           &ciphertext, &ciphertext_len) == 0);
+        // Contexts interoperate with the plain wrappers
+        assert(decrypt(secret_key, secret_key_len, ciphertext, ciphertext_len,
+                       &decrypted, &decrypted_len) == 0);
+        assert(decrypted_len == plaintext_len && memcmp(plaintext, decrypted, plaintext_len) == 0);
+        cleanup((void**)&decrypted);
+
+        assert(decrypt_ctx(ctx, secret_key, secret_key_len, ciphertext, ciphertext_len,
+                           &decrypted, &decrypted_len) == 0);
+        assert(decrypted_len == plaintext_len && memcmp(plaintext, decrypted, plaintext_len) == 0);
+        cleanup((void**)&decrypted);
+
+        // A tampered tag must be rejected
+        ciphertext[ciphertext_len - 1] ^= 0x01;
+        assert(decrypt_ctx(ctx, secret_key, secret_key_len, ciphertext, ciphertext_len,
+                           &decrypted, &decrypted_len) != 0);
+        assert(decrypted == NULL);
+        cleanup((void**)&ciphertext);
+    }
+
+    free_crypto_ctx(ctx);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+}
+
+static void test_session(void) {
+    uint8_t *public_key = NULL, *secret_key = NULL, *kem_ciphertext = NULL;
+    uint8_t *message = NULL, *replayed = NULL, *decrypted = NULL;
+    size_t public_key_len, secret_key_len, kem_ciphertext_len, message_len, replayed_len, decrypted_len;
+    const uint8_t *plaintext = (const uint8_t *)TEST_MESSAGE;
+    size_t plaintext_len = strlen(TEST_MESSAGE);
+    QrmeSession *client = NULL, *server = NULL;
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(session_initiate(public_key, public_key_len, &client, &kem_ciphertext, &kem_ciphertext_len) == 0);
+    assert(session_accept(secret_key, secret_key_len, kem_ciphertext, kem_ciphertext_len, &server) == 0);
+
+    for (int i = 0; i < 3; i++) {
+        assert(session_encrypt(client, plaintext, plaintext_len, &message, &message_len) == 0);
+        assert(message_len == plaintext_len + SESSION_MESSAGE_OVERHEAD);
+        assert(session_decrypt(server, message, message_len, &decrypted, &decrypted_len) == 0);
+        assert(decrypted_len == plaintext_len && memcmp(plaintext, decrypted, plaintext_len) == 0);
+        cleanup((void**)&decrypted);
+
+        // Keep the first request around to replay it later
+        if (i == 0) {
+            replayed = message;
+            replayed_len = message_len;
+        } else {
+            cleanup((void**)&message);
+        }
+
+        assert(session_encrypt(server, plaintext, plaintext_len, &message, &message_len) == 0);
+        assert(session_decrypt(client, message, message_len, &decrypted, &decrypted_len) == 0);
+        assert(decrypted_len == plaintext_len && memcmp(plaintext, decrypted, plaintext_len) == 0);
+        cleanup((void**)&decrypted);
+        cleanup((void**)&message);
+    }
+
+    // Replays are rejected, and a client cannot read its own messages
+    assert(session_decrypt(server, replayed, replayed_len, &decrypted, &decrypted_len) != 0);
+    assert(session_encrypt(client, plaintext, plaintext_len, &message, &message_len) == 0);
+    assert(session_decrypt(client, message, message_len, &decrypted, &decrypted_len) != 0);
+
+    cleanup((void**)&message);
+    cleanup((void**)&replayed);
+    cleanup((void**)&kem_ciphertext);
+    free_session(client);
+    free_session(server);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+}
+
+static void test_stream(void) {
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    const size_t chunk_size = 64;
+    const size_t lengths[] = {0, 10, 64, 160, 192};
+    uint8_t data[192];
+    uint8_t result[256];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+
+    for (size_t t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++) {
+        FILE *plain = tmpfile(), *encrypted = tmpfile(), *decrypted = tmpfile();
+        assert(plain && encrypted && decrypted);
+        fwrite(data, 1, lengths[t], plain);
+        rewind(plain);
+
+        assert(encrypt_stream_file(public_key, public_key_len, plain, encrypted, chunk_size) == 0);
+        rewind(encrypted);
+        assert(decrypt_stream_file(secret_key, secret_key_len, encrypted, decrypted) == 0);
+        rewind(decrypted);
+        assert(fread(result, 1, sizeof(result), decrypted) == lengths[t]);
+        assert(memcmp(result, data, lengths[t]) == 0);
+
+        // Dropping the final record must be detected as truncation
+        long encrypted_len;
+        fseek(encrypted, 0, SEEK_END);
+        encrypted_len = ftell(encrypted);
+        FILE *truncated = tmpfile(), *sink = tmpfile();
+        uint8_t *copy = malloc(encrypted_len);
+        rewind(encrypted);
+        assert(fread(copy, 1, encrypted_len, encrypted) == (size_t)encrypted_len);
+        fwrite(copy, 1, encrypted_len - (lengths[t] % chunk_size) - STREAM_TAG_SIZE, truncated);
+        rewind(truncated);
+        assert(decrypt_stream_file(secret_key, secret_key_len, truncated, sink) != 0);
+
+        free(copy);
+        fclose(truncated);
+        fclose(sink);
+        fclose(plain);
+        fclose(encrypted);
+        fclose(decrypted);
+    }
+
+    // An oversized chunk size in a header is refused before any buffer
+    // is sized from it
+    QrmeStream* stream = NULL;
+    uint8_t* header = malloc(stream_header_size());
+    assert(header != NULL);
+    assert(stream_encrypt_init(public_key, public_key_len, STREAM_MAX_CHUNK_SIZE + 1,
+                               &stream, header) == -1);
+    assert(stream_encrypt_init(public_key, public_key_len, chunk_size, &stream, header) == 0);
+    free_stream(stream);
+    header[4] = 0xef;
+    header[5] = 0xff;
+    header[6] = 0xff;
+    header[7] = 0x7f;
+    assert(stream_decrypt_init(secret_key, secret_key_len, header, &stream) == -1);
+    assert(stream == NULL);
+    FILE *tampered = tmpfile(), *sink = tmpfile();
+    assert(tampered && sink);
+    fwrite(header, 1, stream_header_size(), tampered);
+    rewind(tampered);
+    assert(decrypt_stream_file(secret_key, secret_key_len, tampered, sink) != 0);
+    fclose(tampered);
+    fclose(sink);
+    free(header);
+
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+}
+
+static void churn_secure_blocks(void* arg, size_t begin, size_t end) {
+    (void)arg;
+    for (size_t i = begin; i < end; i++) {
+        size_t size = 1 + (i * 37) % 3000;
+        unsigned char* block = secure_alloc(size);
+        assert(block != NULL && ((uintptr_t)block % SECURE_ALLOC_ALIGNMENT) == 0);
+        for (size_t k = 0; k < size; k++) {
+            assert(block[k] == 0);
+        }
+        memset(block, 0xa5, size);
+        secure_free((void**)&block);
+    }
+}
+
+static void test_secure_alloc(void) {
+    static const size_t sizes[] = {0, 1, 32, 64, 65, 1000, 4096, 4097, 100000};
+    SecureAllocStats before, after;
+    get_secure_alloc_stats(&before);
+
+    // Aligned and zero-filled at every size, pooled or not
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        unsigned char* block = secure_alloc(sizes[i]);
+        assert(block != NULL && ((uintptr_t)block % SECURE_ALLOC_ALIGNMENT) == 0);
+        for (size_t k = 0; k < sizes[i]; k++) {
+            assert(block[k] == 0);
+        }
+        memset(block, 0x5a, sizes[i]);
+        secure_free((void**)&block);
+        assert(block == NULL);
+    }
+
+    // A freed small block is wiped and reused for the next request
+    unsigned char* first = secure_alloc(100);
+    memset(first, 0xff, 100);
+    unsigned char* stale = first;
+    secure_free((void**)&first);
+    unsigned char* second = secure_alloc(120);
+    assert(second == stale);
+    for (size_t k = 0; k < 120; k++) {
+        assert(second[k] == 0);
+    }
+
+    // Growing keeps the contents and zero-fills; shrinking wipes the tail
+    memset(second, 7, 120);
+    unsigned char* grown = secure_realloc(second, 10000);
+    assert(grown != NULL && grown[0] == 7 && grown[119] == 7 && grown[120] == 0 && grown[9999] == 0);
+    grown = secure_realloc(grown, 8);
+    assert(grown != NULL && grown[7] == 7);
+    grown = secure_realloc(grown, 16);
+    assert(grown[7] == 7 && grown[8] == 0 && grown[15] == 0);
+
+    secure_free((void**)&grown);
+
+    // A second free of a pooled block is refused
+    unsigned char* small = secure_alloc(16);
+    unsigned char* again = small;
+    secure_free((void**)&small);
+    secure_free((void**)&again);
+    assert(again != NULL);
+    assert(strcmp(get_secure_alloc_error(), "Secure block freed twice") == 0);
+
+    get_secure_alloc_stats(&after);
+    assert(after.allocations - before.allocations == 12);
+    assert(after.frees - before.frees == 12);
+    assert(after.pool_hits > before.pool_hits);
+    assert(after.large_allocations - before.large_allocations >= 2);
+    assert(after.peak_bytes_in_use >= 100000);
+
+    // Blocks allocated and freed across threads
+    ThreadPool* pool = create_thread_pool(4);
+    assert(pool != NULL);
+    for (int round = 0; round < 20; round++) {
+        thread_pool_parallel_for(pool, 2000, 50, churn_secure_blocks, NULL);
+    }
+    free_thread_pool(pool);
+
+    get_secure_alloc_stats(&after);
+    assert(after.allocations - before.allocations == 12 + 20 * 2000);
+    assert(after.frees - before.frees == 12 + 20 * 2000);
+    assert(after.bytes_in_use == before.bytes_in_use);
+    secure_alloc_trim();
+}
+
+static void claim_arena_blocks(void* arg, size_t begin, size_t end) {
+    SecureArena* arena = arg;
+    for (size_t i = begin; i < end; i++) {
+        uint32_t* block = secure_arena_alloc(arena, 100);
+        assert(block != NULL && ((uintptr_t)block % 64) == 0 && block[0] == 0);
+        block[0] = (uint32_t)i + 1;
+    }
+}
+
+static void test_secure_arena(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    SecureArena* arena = create_secure_arena(10000);
+    assert(arena != NULL);
+    assert(secure_arena_capacity(arena) >= 10000 && secure_arena_capacity(arena) % (size_t)page == 0);
+    printf("Secure arena locked: %d\n", secure_arena_is_locked(arena));
+
+    unsigned char* a = secure_arena_alloc(arena, 10);
+    unsigned char* b = secure_arena_alloc(arena, 1);
+    assert(a && b && ((uintptr_t)a % 64) == 0 && ((uintptr_t)b % 64) == 0 && b == a + 64);
+    assert(a[0] == 0 && a[9] == 0);
+    memset(a, 0xcc, 10);
+    assert(secure_arena_alloc(arena, secure_arena_capacity(arena)) == NULL);
+    assert(strcmp(get_secure_arena_error(), "Secure arena exhausted") == 0);
+
+    // Touching the page before the arena faults
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        volatile unsigned char* before = a - 1;
+        *before = 1;
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    // Sanitizers catch the fault and exit instead of dying by the signal
+    assert(WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0));
+
+    // Reset wipes and reuses the whole arena
+    secure_arena_reset(arena);
+    assert(secure_arena_used(arena) == 0 && a[0] == 0);
+
+    // Concurrent allocations never overlap
+    ThreadPool* pool = create_thread_pool(4);
+    thread_pool_parallel_for(pool, 64, 4, claim_arena_blocks, arena);
+    free_thread_pool(pool);
+    assert(secure_arena_used(arena) == 63 * 128 + 100);
+    unsigned char seen[64] = {0};
+    for (size_t i = 0; i < 64; i++) {
+        uint32_t value = *(uint32_t*)(a + i * 128);
+        assert(value >= 1 && value <= 64 && !seen[value - 1]);
+        seen[value - 1] = 1;
+    }
+    free_secure_arena(arena);
+
+    // Key material from every owner shares one arena, and freed blocks are
+    // wiped and reused
+    unsigned char* key = secure_key_alloc(2400);
+    unsigned char* secret = secure_key_alloc(32);
+    assert(key && secret && ((uintptr_t)key % 64) == 0 && ((uintptr_t)secret % 64) == 0);
+    assert(key[0] == 0 && key[2399] == 0 && secret[31] == 0);
+    assert((size_t)(key > secret ? key - secret : secret - key) < 64 * 1024);
+    memset(key, 0xcc, 2400);
+    unsigned char* freed = key;
+    secure_key_free((void**)&key, 2400);
+    assert(key == NULL);
+    key = secure_key_alloc(3000);
+    assert(key == freed && key[0] == 0 && key[2399] == 0);
+    secure_key_free((void**)&key, 3000);
+    secure_key_free((void**)&secret, 32);
+    unsigned char* large = secure_key_alloc(SECURE_KEY_MAX_BLOCK + 1);
+    assert(large != NULL);
+    secure_key_free((void**)&large, SECURE_KEY_MAX_BLOCK + 1);
+    assert(large == NULL);
+
+    // load_model() decrypts into an arena
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+    Model* model = create_model();
+    assert(add_layer(model, weights, 2, 3) == 0);
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+    Model* loaded = load_model(TEST_MODEL_FILE, secret_key, secret_key_len);
+    assert(loaded != NULL && loaded->arena != NULL);
+    assert(loaded->slab != NULL && loaded->layers[0].in_slab);
+    assert(compare_float_arrays(loaded->layers[0].weights, weights, 6, EPSILON));
+    free_model(loaded);
+
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void emit_trace_range(void* arg, size_t begin, size_t end) {
+    (void)arg;
+    for (size_t i = begin; i < end; i++) {
+        TRACE_INFO(TRACE_CAT_POOL, "item %zu", i);
+    }
+}
+
+static void test_trace(void) {
+    enum { EMITTED = 3000 };
+    TraceRecord* records = malloc(TRACE_RING_CAPACITY * sizeof(TraceRecord));
+    assert(records != NULL);
+    trace_ring_clear();
+    trace_set_sink(TRACE_SINK_RING);
+    trace_set_level(TRACE_LEVEL_DEBUG);
+    trace_set_categories(TRACE_CAT_MODEL);
+
+    // Only the enabled category is recorded
+    Model* model = create_model();
+    TRACE_DEBUG(TRACE_CAT_CRYPTO, "filtered out");
+    free_model(model);
+    size_t n = trace_ring_read(records, TRACE_RING_CAPACITY);
+#if QRME_TRACE_LEVEL >= 4
+    assert(n >= 2 && strstr(records[0].message, "Created model") != NULL);
+    for (size_t i = 0; i < n; i++) {
+        assert(records[i].category == TRACE_CAT_MODEL && records[i].level == TRACE_LEVEL_DEBUG);
+        assert(i == 0 || (records[i].sequence == records[i - 1].sequence + 1 &&
+                          records[i].timestamp_ns >= records[i - 1].timestamp_ns));
+    }
+#else
+    assert(n == 0);
+#endif
+
+    // Less severe levels are dropped
+    trace_ring_clear();
+    trace_set_level(TRACE_LEVEL_WARN);
+    free_model(create_model());
+    assert(trace_ring_read(records, TRACE_RING_CAPACITY) == 0);
+
+    // Concurrent writers; the ring keeps the newest records
+    trace_set_level(TRACE_LEVEL_INFO);
+    trace_set_categories(TRACE_CAT_ALL);
+    ThreadPool* pool = create_thread_pool(4);
+    thread_pool_parallel_for(pool, EMITTED, 16, emit_trace_range, NULL);
+    free_thread_pool(pool);
+    n = trace_ring_read(records, TRACE_RING_CAPACITY);
+#if QRME_TRACE_LEVEL >= 3
+    assert(n == TRACE_RING_CAPACITY);
+    for (size_t i = 0; i < n; i++) {
+        assert(records[i].sequence == EMITTED - TRACE_RING_CAPACITY + i);
+        assert(records[i].category == TRACE_CAT_POOL && strncmp(records[i].message, "item ", 5) == 0);
+    }
+    assert(trace_ring_read(records, 10) == 10 && records[9].sequence == EMITTED - 1);
+#else
+    assert(n == 0);
+#endif
+
+    trace_ring_clear();
+    trace_set_sink(TRACE_SINK_STDERR);
+    trace_set_level(TRACE_LEVEL_WARN);
+    free(records);
+}
+
+// Each item fails in one of two ways and checks that it reads back its own
+// error, not one recorded meanwhile by another thread
+static void fail_in_parallel(void* arg, size_t begin, size_t end) {
+    int* mismatches = arg;
+    float x = 0.0f;
+    for (size_t i = begin; i < end; i++) {
+        if (i % 2 == 0) {
+            assert(inference(NULL, &x, 1, &x, 1) == -1);
+            if (qrme_last_error() != QRME_ERR_INVALID_ARGUMENT ||
+                strcmp(get_model_error(), "Invalid parameters for inference") != 0) {
+                __atomic_fetch_add(mismatches, 1, __ATOMIC_RELAXED);
+            }
+        } else {
+            assert(load_model("/nonexistent/model.bin", (const uint8_t*)"k", 1) == NULL);
+            if (qrme_last_error() != QRME_ERR_IO ||
+                strcmp(qrme_last_error_message(), "Failed to open file for reading") != 0) {
+                __atomic_fetch_add(mismatches, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+static void test_error_state(void) {
+    qrme_clear_error();
+    assert(qrme_last_error() == QRME_OK && qrme_last_error_message()[0] == '\0');
+
+    // Codes, modules and per-module messages
+    uint8_t* plaintext = NULL;
+    size_t plaintext_len;
+    assert(decrypt(NULL, 0, NULL, 0, &plaintext, &plaintext_len) == -1);
+    QrmeErrorCode code = qrme_last_error();
+    assert(code != QRME_OK && qrme_last_error_module() == QRME_MODULE_ENCRYPTION);
+    assert(strcmp(qrme_last_error_message(), get_error()) == 0);
+    assert(strcmp(qrme_error_name(QRME_ERR_AUTH), "authentication failure") == 0);
+
+    assert(verify_model_file("/nonexistent/model.bin") == -1);
+    assert(qrme_last_error() == QRME_ERR_IO && qrme_last_error_module() == QRME_MODULE_FORMAT);
+    assert(get_error()[0] != '\0' && strcmp(get_error(), get_format_error()) != 0);
+
+    // A model-level failure keeps the code of the format error behind it
+    FILE* file = fopen(TEST_MODEL_FILE, "wb");
+    assert(file != NULL && fwrite("QRME\2\0\0\0", 1, 8, file) == 8);
+    fclose(file);
+    assert(load_model_lazy(TEST_MODEL_FILE, (const uint8_t*)"k", 1, 0) == NULL);
+    assert(qrme_last_error() == QRME_ERR_FORMAT && qrme_last_error_module() == QRME_MODULE_MODEL);
+    assert(strcmp(get_model_error(), get_format_error()) == 0);
+    remove(TEST_MODEL_FILE);
+
+    // Layers that fail authentication report it, whichever loader ran
+    uint8_t *public_key = NULL, *secret_key = NULL, *other_public_key = NULL, *other_secret_key = NULL;
+    size_t public_key_len, secret_key_len, other_public_key_len, other_secret_key_len;
+    float weights[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+    float input[3] = {1.0f, 1.0f, 1.0f}, output[2];
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(generate_keypair(&other_public_key, &other_public_key_len,
+                            &other_secret_key, &other_secret_key_len) == 0);
+    Model* model = create_model();
+    assert(add_layer(model, weights, 2, 3) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+    free_model(model);
+    assert(load_model(TEST_MODEL_FILE, other_secret_key, other_secret_key_len) == NULL);
+    assert(qrme_last_error() == QRME_ERR_AUTH && qrme_last_error_module() == QRME_MODULE_MODEL);
+    assert(load_model_parallel(TEST_MODEL_FILE, other_secret_key, other_secret_key_len, 2, NULL) == NULL);
+    assert(qrme_last_error() == QRME_ERR_AUTH);
+    assert(load_model_mmap(TEST_MODEL_FILE, other_secret_key, other_secret_key_len) == NULL);
+    assert(qrme_last_error() == QRME_ERR_AUTH);
+    model = load_model_lazy(TEST_MODEL_FILE, other_secret_key, other_secret_key_len, 0);
+    assert(model != NULL);
+    assert(inference(model, input, 3, output, 2) == -1);
+    assert(qrme_last_error() == QRME_ERR_AUTH);
+    free_model(model);
+    remove(TEST_MODEL_FILE);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    cleanup((void**)&other_public_key);
+    cleanup((void**)&other_secret_key);
+
+    // Errors stay with the thread that caused them
+    int mismatches = 0;
+    ThreadPool* pool = create_thread_pool(4);
+    thread_pool_parallel_for(pool, 4000, 1, fail_in_parallel, &mismatches);
+    free_thread_pool(pool);
+    assert(mismatches == 0);
+
+    qrme_clear_error();
+    assert(qrme_last_error() == QRME_OK && get_model_error()[0] == '\0');
+}
+
 static void test_create_model(void) {
     Model* model = create_model();
     assert(model != NULL);
@@ -92,6 +591,397 @@ static void test_save_load_model(void) {
     remove(TEST_MODEL_FILE);
 }
 
+// A model whose layers chain keeps its execution plan and results
+static void test_save_load_chained_model(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights1[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+    float weights2[] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 0.9f, 1.0f};
+    float input[] = {1.0f, -1.0f, 0.5f};
+    float expected[5], output[5];
+
+    add_layer(model, weights1, 2, 3);
+    add_layer(model, weights2, 5, 2);
+    assert(inference(model, input, 3, expected, 5) == 0);
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    free_model(model);
+
+    Model* loaded_model = load_model(TEST_MODEL_FILE, secret_key, secret_key_len);
+    assert(loaded_model != NULL);
+    assert(loaded_model->plan.valid);
+    assert(loaded_model->plan.input_size == 3 && loaded_model->plan.output_size == 5);
+    assert(inference(loaded_model, input, 3, output, 5) == 0);
+    assert(compare_float_arrays(output, expected, 5, EPSILON));
+
+    free_model(loaded_model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_save_model_parallel(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights[5][12];
+
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = 0; j < 12; j++) {
+            weights[i][j] = (float)(i * 12 + j) * 0.25f;
+        }
+        assert(add_layer(model, weights[i], 3, 4) == 0);
+    }
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model_parallel(model, TEST_MODEL_FILE, public_key, public_key_len, 4) == 0);
+
+    Model* loaded_model = load_model(TEST_MODEL_FILE, secret_key, secret_key_len);
+    assert(loaded_model != NULL);
+    assert(loaded_model->num_layers == 5);
+    for (size_t i = 0; i < 5; i++) {
+        assert(loaded_model->layers[i].rows == 3 && loaded_model->layers[i].cols == 4);
+        assert(compare_float_arrays(loaded_model->layers[i].weights, weights[i], 12, EPSILON));
+    }
+    assert(loaded_model->public_key_len == public_key_len);
+    assert(memcmp(loaded_model->public_key, public_key, public_key_len) == 0);
+
+    free_model(loaded_model);
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_load_model_parallel(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights[4][20];
+    LoadStats stats;
+
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 20; j++) {
+            weights[i][j] = (float)(i + 1) / (float)(j + 1);
+        }
+        assert(add_layer(model, weights[i], 4, 5) == 0);
+    }
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    Model* loaded_model = load_model_parallel(TEST_MODEL_FILE, secret_key, secret_key_len, 3, &stats);
+    assert(loaded_model != NULL);
+    assert(loaded_model->num_layers == 4);
+    for (size_t i = 0; i < 4; i++) {
+        assert(compare_float_arrays(loaded_model->layers[i].weights, weights[i], 20, EPSILON));
+    }
+    assert(stats.num_threads == 3 && stats.bytes_read > 4 * 20 * sizeof(float));
+    assert(stats.total_seconds >= stats.io_seconds);
+    printf("Load stats: io %.6fs, decrypt %.6fs, total %.6fs\n",
+           stats.io_seconds, stats.decrypt_seconds, stats.total_seconds);
+    free_model(loaded_model);
+
+    // The wrong key must fail cleanly
+    secret_key[0] ^= 0xff;
+    assert(load_model_parallel(TEST_MODEL_FILE, secret_key, secret_key_len, 3, NULL) == NULL);
+
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_load_model_mmap(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights1[] = {1.0f, -2.0f, 3.0f, -4.0f, 5.0f, -6.0f};
+    float weights2[] = {0.5f, 0.25f};
+
+    add_layer(model, weights1, 2, 3);
+    add_layer(model, weights2, 1, 2);
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    Model* loaded_model = load_model_mmap(TEST_MODEL_FILE, secret_key, secret_key_len);
+    assert(loaded_model != NULL);
+    assert(loaded_model->num_layers == 2);
+    assert(((uintptr_t)loaded_model->layers[0].weights % 64) == 0);
+    assert(compare_float_arrays(loaded_model->layers[0].weights, weights1, 6, EPSILON));
+    assert(compare_float_arrays(loaded_model->layers[1].weights, weights2, 2, EPSILON));
+    assert(memcmp(loaded_model->public_key, public_key, public_key_len) == 0);
+    free_model(loaded_model);
+
+    // A truncated file must be rejected rather than read past the mapping
+    FILE* file = fopen(TEST_MODEL_FILE, "r+b");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    assert(truncate(TEST_MODEL_FILE, size - 100) == 0);
+    assert(load_model_mmap(TEST_MODEL_FILE, secret_key, secret_key_len) == NULL);
+
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+// Write a model in the original, unversioned layout
+static void write_v1_model(const char* filename, const float* weights, size_t rows, size_t cols,
+                           const uint8_t* public_key, size_t public_key_len) {
+    uint8_t* encrypted = NULL;
+    size_t encrypted_len, num_layers = 1;
+    FILE* file = fopen(filename, "wb");
+
+    assert(file != NULL);
+    assert(encrypt(public_key, public_key_len, (const uint8_t*)weights, rows * cols * sizeof(float),
+                   &encrypted, &encrypted_len) == 0);
+    fwrite(&num_layers, sizeof(size_t), 1, file);
+    fwrite(&rows, sizeof(size_t), 1, file);
+    fwrite(&cols, sizeof(size_t), 1, file);
+    fwrite(&encrypted_len, sizeof(size_t), 1, file);
+    fwrite(encrypted, 1, encrypted_len, file);
+    fwrite(&public_key_len, sizeof(size_t), 1, file);
+    fwrite(public_key, 1, public_key_len, file);
+    fclose(file);
+    cleanup((void**)&encrypted);
+}
+
+static void test_model_format(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights1[] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+    float weights2[] = {0.5f, 0.25f};
+    uint8_t header[MODEL_HEADER_SIZE];
+    ModelIndex index;
+
+    add_layer(model, weights1, 2, 3);
+    add_layer(model, weights2, 1, 2);
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    // The header is little-endian and the index is readable without a key
+    FILE* file = fopen(TEST_MODEL_FILE, "r+b");
+    assert(file != NULL);
+    assert(fread(header, 1, MODEL_HEADER_SIZE, file) == MODEL_HEADER_SIZE);
+    assert(memcmp(header, MODEL_FORMAT_MAGIC, 4) == 0);
+    assert(header[4] == MODEL_FORMAT_VERSION && header[5] == 0 && header[16] == 2);
+    assert(read_model_index(file, &index) == 0);
+    assert(index.version == MODEL_FORMAT_VERSION && index.num_layers == 2);
+    assert(index.layers[1].rows == 1 && index.layers[1].cols == 2);
+    assert(index.public_key_len == public_key_len);
+    assert(verify_model_file(TEST_MODEL_FILE) == 0);
+
+    // Corrupting a layer blob is caught by its checksum without decrypting
+    uint8_t byte;
+    fseek(file, (long)index.layers[1].offset + 5, SEEK_SET);
+    assert(fread(&byte, 1, 1, file) == 1);
+    byte ^= 0x80;
+    fseek(file, (long)index.layers[1].offset + 5, SEEK_SET);
+    fwrite(&byte, 1, 1, file);
+    fclose(file);
+    free_model_index(&index);
+    assert(verify_model_file(TEST_MODEL_FILE) != 0);
+
+    // Files in the original layout still load
+    write_v1_model(TEST_MODEL_FILE, weights1, 2, 3, public_key, public_key_len);
+    Model* loaded_model = load_model(TEST_MODEL_FILE, secret_key, secret_key_len);
+    assert(loaded_model != NULL && loaded_model->num_layers == 1);
+    assert(compare_float_arrays(loaded_model->layers[0].weights, weights1, 6, EPSILON));
+    assert(memcmp(loaded_model->public_key, public_key, public_key_len) == 0);
+    free_model(loaded_model);
+
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_load_model_lazy(void) {
+    Model* model = create_model();
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    const size_t layer_bytes = 9 * sizeof(float);
+    float weights[3][9];
+    float input[] = {1.0f, 0.5f, -0.25f};
+    float expected[3], output[3];
+
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 9; j++) {
+            weights[i][j] = (float)((i + j) % 4) * 0.5f - 0.5f;
+        }
+        assert(add_layer(model, weights[i], 3, 3) == 0);
+    }
+    assert(inference(model, input, 3, expected, 3) == 0);
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    // Nothing is decrypted until a layer is used
+    Model* lazy_model = load_model_lazy(TEST_MODEL_FILE, secret_key, secret_key_len, 2 * layer_bytes);
+    assert(lazy_model != NULL && lazy_model->num_layers == 3);
+    assert(get_model_resident_bytes(lazy_model) == 0);
+    assert(memcmp(lazy_model->public_key, public_key, public_key_len) == 0);
+
+    assert(inference(lazy_model, input, 3, output, 3) == 0);
+    assert(compare_float_arrays(output, expected, 3, EPSILON));
+    assert(get_model_resident_bytes(lazy_model) <= 2 * layer_bytes);
+
+    // Evicted layers are decrypted again transparently, into the model's
+    // arena rather than onto the heap
+    SecureAllocStats before, after;
+    get_secure_alloc_stats(&before);
+    const float* first = acquire_layer_weights(lazy_model, 0);
+    assert(first != NULL && compare_float_arrays(first, weights[0], 9, EPSILON));
+    get_secure_alloc_stats(&after);
+    assert(after.bytes_in_use == before.bytes_in_use);
+    release_layer_weights(lazy_model, 0);
+    assert(inference(lazy_model, input, 3, output, 3) == 0);
+    assert(compare_float_arrays(output, expected, 3, EPSILON));
+
+    free_model(lazy_model);
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_gemv_kernels(void) {
+    static const size_t shapes[][2] = {
+        {1, 1}, {1, 7}, {3, 5}, {4, 8}, {5, 17}, {7, 33}, {16, 64},
+        {9, 100}, {33, 257}, {64, 1000}, {13, 4099}
+    };
+    static const KernelIsa isas[] = {
+        KERNEL_ISA_SCALAR, KERNEL_ISA_AVX2, KERNEL_ISA_AVX512, KERNEL_ISA_NEON
+    };
+    KernelIsa original = get_kernel_isa();
+    printf("Default kernel ISA: %s\n", kernel_isa_name(original));
+
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        size_t rows = shapes[s][0], cols = shapes[s][1];
+        float* weights = malloc(rows * cols * sizeof(float));
+        float* x = malloc(cols * sizeof(float));
+        float* expected = malloc(rows * sizeof(float));
+        float* y = malloc(rows * sizeof(float));
+        assert(weights && x && expected && y);
+
+        for (size_t i = 0; i < rows * cols; i++) {
+            weights[i] = (float)rand() / RAND_MAX - 0.5f;
+        }
+        for (size_t k = 0; k < cols; k++) {
+            x[k] = (float)rand() / RAND_MAX - 0.5f;
+        }
+        for (size_t r = 0; r < rows; r++) {
+            double sum = 0;
+            for (size_t k = 0; k < cols; k++) {
+                sum += (double)weights[r * cols + k] * x[k];
+            }
+            expected[r] = (float)sum;
+        }
+
+        for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+            if (set_kernel_isa(isas[i]) != 0) {
+                assert(!kernel_isa_supported(isas[i]));
+                continue;
+            }
+            gemv_f32(weights, rows, cols, x, y);
+            for (size_t r = 0; r < rows; r++) {
+                assert(fabsf(y[r] - expected[r]) < 1e-4f * (1.0f + sqrtf((float)cols)));
+            }
+
+            // Fused epilogue: bias of 0.25 per row, then leaky ReLU
+            float* bias = malloc(rows * sizeof(float));
+            assert(bias);
+            for (size_t r = 0; r < rows; r++) {
+                bias[r] = 0.25f;
+            }
+            gemv_f32_fused(weights, rows, cols, x, bias, ACTIVATION_LEAKY_RELU, y);
+            for (size_t r = 0; r < rows; r++) {
+                float v = expected[r] + 0.25f;
+                v = v > 0 ? v : 0.01f * v;
+                assert(fabsf(y[r] - v) < 1e-4f * (1.0f + sqrtf((float)cols)));
+            }
+            free(bias);
+        }
+
+        free(weights);
+        free(x);
+        free(expected);
+        free(y);
+    }
+
+    assert(set_kernel_isa(original) == 0);
+}
+
+static void test_gemm_half_kernels(void) {
+    enum { ROWS = 130, COLS = 600, BATCH = 3 };
+    static const KernelIsa isas[] = {
+        KERNEL_ISA_SCALAR, KERNEL_ISA_AVX2, KERNEL_ISA_AVX512, KERNEL_ISA_NEON
+    };
+    float* weights = malloc(ROWS * COLS * sizeof(float));
+    uint16_t* halves = malloc(ROWS * COLS * sizeof(uint16_t));
+    float x[BATCH * COLS], bias[ROWS], y[BATCH * ROWS], expected[ROWS];
+    assert(weights && halves);
+
+    for (size_t i = 0; i < ROWS * COLS; i++) {
+        weights[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < BATCH * COLS; i++) {
+        x[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t r = 0; r < ROWS; r++) {
+        bias[r] = 0.01f * (float)r - 0.5f;
+    }
+
+    // Every panel, tail included, must match the GEMV path for each input
+    KernelIsa original = get_kernel_isa();
+    for (int bf16 = 0; bf16 < 2; bf16++) {
+        if (bf16) {
+            f32_to_bf16(weights, halves, ROWS * COLS);
+        } else {
+            f32_to_f16(weights, halves, ROWS * COLS);
+        }
+        for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+            if (set_kernel_isa(isas[i]) != 0) {
+                continue;
+            }
+            if (bf16) {
+                gemm_bf16_fused(halves, ROWS, COLS, x, BATCH, bias, ACTIVATION_TANH, y);
+            } else {
+                gemm_f16_fused(halves, ROWS, COLS, x, BATCH, bias, ACTIVATION_TANH, y);
+            }
+            for (size_t b = 0; b < BATCH; b++) {
+                if (bf16) {
+                    gemv_bf16_fused(halves, ROWS, COLS, x + b * COLS, bias, ACTIVATION_TANH,
+                                    expected);
+                } else {
+                    gemv_f16_fused(halves, ROWS, COLS, x + b * COLS, bias, ACTIVATION_TANH,
+                                   expected);
+                }
+                assert(compare_float_arrays(y + b * ROWS, expected, ROWS, 1e-4f));
+            }
+        }
+    }
+    assert(set_kernel_isa(original) == 0);
+
+    // Softmax is finished per output row
+    gemm_f16_fused(halves, ROWS, COLS, x, BATCH, NULL, ACTIVATION_SOFTMAX, y);
+    for (size_t b = 0; b < BATCH; b++) {
+        gemv_f16_fused(halves, ROWS, COLS, x + b * COLS, NULL, ACTIVATION_SOFTMAX, expected);
+        assert(compare_float_arrays(y + b * ROWS, expected, ROWS, 1e-5f));
+    }
+
+    free(weights);
+    free(halves);
+}
+
 static void test_inference(void) {
     Model* model = create_model();
     float weights1[] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f};
@@ -109,6 +999,858 @@ static void test_inference(void) {
     free_model(model);
 }
 
+static void test_inference_batch(void) {
+    enum { BATCH = 7, IN = 37, HIDDEN = 70, OUT = 5 };
+    Model* model = create_model();
+    float* w1 = malloc(HIDDEN * IN * sizeof(float));
+    float* w2 = malloc(OUT * HIDDEN * sizeof(float));
+    float inputs[BATCH * IN];
+    float outputs[BATCH * OUT];
+    float single[OUT];
+    assert(model && w1 && w2);
+
+    for (size_t i = 0; i < HIDDEN * IN; i++) {
+        w1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < OUT * HIDDEN; i++) {
+        w2[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < BATCH * IN; i++) {
+        inputs[i] = (float)rand() / RAND_MAX;
+    }
+
+    assert(add_layer(model, w1, HIDDEN, IN) == 0);
+    assert(add_layer(model, w2, OUT, HIDDEN) == 0);
+
+    assert(inference_batch(model, inputs, BATCH, IN, outputs, OUT) == 0);
+    for (size_t b = 0; b < BATCH; b++) {
+        assert(inference(model, inputs + b * IN, IN, single, OUT) == 0);
+        assert(compare_float_arrays(outputs + b * OUT, single, OUT, EPSILON));
+    }
+
+    assert(inference_batch(model, inputs, BATCH, IN + 1, outputs, OUT) == -1);
+    assert(inference_batch(model, inputs, 0, IN, outputs, OUT) == -1);
+
+    free(w1);
+    free(w2);
+    free_model(model);
+}
+
+static void mark_range(void* arg, size_t begin, size_t end) {
+    unsigned char* marks = arg;
+    for (size_t i = begin; i < end; i++) {
+        marks[i]++;
+    }
+}
+
+static void test_inference_parallel(void) {
+    enum { IN = 784, HIDDEN = 512, OUT = 10 };
+    int cpus[] = {0};
+    ThreadPool* pool = create_thread_pool_ex(3, cpus, 1);
+    assert(pool && thread_pool_size(pool) == 3);
+
+    // Every index is visited exactly once, across repeated calls
+    unsigned char marks[1000] = {0};
+    for (int round = 0; round < 50; round++) {
+        thread_pool_parallel_for(pool, sizeof(marks), 7, mark_range, marks);
+    }
+    for (size_t i = 0; i < sizeof(marks); i++) {
+        assert(marks[i] == 50);
+    }
+
+    Model* model = create_model();
+    float* w1 = malloc(HIDDEN * IN * sizeof(float));
+    float* w2 = malloc(OUT * HIDDEN * sizeof(float));
+    float input[IN];
+    float expected[OUT];
+    float output[OUT];
+    assert(model && w1 && w2);
+
+    for (size_t i = 0; i < HIDDEN * IN; i++) {
+        w1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < OUT * HIDDEN; i++) {
+        w2[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < IN; i++) {
+        input[i] = (float)rand() / RAND_MAX;
+    }
+    assert(add_layer(model, w1, HIDDEN, IN) == 0);
+    assert(add_layer(model, w2, OUT, HIDDEN) == 0);
+
+    assert(inference(model, input, IN, expected, OUT) == 0);
+    for (int round = 0; round < 10; round++) {
+        assert(inference_parallel(model, pool, input, IN, output, OUT) == 0);
+        assert(compare_float_arrays(output, expected, OUT, EPSILON));
+    }
+    assert(inference_parallel(model, NULL, input, IN, output, OUT) == 0);
+    assert(compare_float_arrays(output, expected, OUT, EPSILON));
+    assert(inference_parallel(model, pool, input, IN - 1, output, OUT) == -1);
+
+    free(w1);
+    free(w2);
+    free_model(model);
+    free_thread_pool(pool);
+}
+
+static void test_inference_workspace(void) {
+    Model* model = create_model();
+    float weights1[] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f};
+    float weights2[] = {0.7f, 0.8f};
+    float input[] = {1.0f, 2.0f, 3.0f};
+    float output[1];
+    float expected_output = 3.54f;
+
+    add_layer(model, weights1, 2, 3);
+    add_layer(model, weights2, 1, 2);
+
+    InferenceWorkspace* ws = create_inference_workspace(model);
+    assert(ws != NULL);
+    for (int i = 0; i < 100; i++) {
+        output[0] = 0;
+        assert(inference_ws(model, ws, input, 3, output, 1) == 0);
+        assert(fabs(output[0] - expected_output) < EPSILON);
+    }
+    assert(inference_ws(model, NULL, input, 3, output, 1) == -1);
+
+    // The threaded path reuses the workspace too
+    ThreadPool* pool = create_thread_pool(2);
+    assert(pool != NULL);
+    for (int i = 0; i < 10; i++) {
+        output[0] = 0;
+        assert(inference_parallel_ws(model, pool, ws, input, 3, output, 1) == 0);
+        assert(fabs(output[0] - expected_output) < EPSILON);
+    }
+    assert(inference_parallel_ws(model, pool, NULL, input, 3, output, 1) == -1);
+    free_thread_pool(pool);
+
+    // A workspace planned for a narrower model is rejected
+    float wide[4 * 2] = {0};
+    float narrow[4] = {0};
+    Model* wider = create_model();
+    add_layer(wider, weights1, 2, 3);
+    add_layer(wider, wide, 4, 2);
+    add_layer(wider, narrow, 1, 4);
+    assert(inference_ws(wider, ws, input, 3, output, 1) == -1);
+    assert(inference_parallel_ws(wider, NULL, ws, input, 3, output, 1) == -1);
+
+    free_inference_workspace(ws);
+    free_model(wider);
+    free_model(model);
+}
+
+static void test_execution_plan(void) {
+    enum { IN = 784, HIDDEN = 4096, OUT = 10 };
+    Model* model = create_model();
+    float* w1 = malloc((size_t)HIDDEN * IN * sizeof(float));
+    float* w2 = malloc((size_t)OUT * HIDDEN * sizeof(float));
+    float* hidden = malloc(HIDDEN * sizeof(float));
+    float input[IN];
+    float expected[OUT];
+    float output[OUT];
+    assert(model && w1 && w2 && hidden);
+
+    for (size_t i = 0; i < (size_t)HIDDEN * IN; i++) {
+        w1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < (size_t)OUT * HIDDEN; i++) {
+        w2[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < IN; i++) {
+        input[i] = (float)rand() / RAND_MAX;
+    }
+
+    // Hidden layer wider than both the input and the output
+    assert(add_layer(model, w1, HIDDEN, IN) == 0);
+    assert(add_layer(model, w2, OUT, HIDDEN) == 0);
+    assert(model->plan.valid);
+    assert(model->plan.input_size == IN);
+    assert(model->plan.output_size == OUT);
+    assert(model->plan.max_hidden_width == HIDDEN);
+
+    for (size_t r = 0; r < HIDDEN; r++) {
+        double sum = 0;
+        for (size_t k = 0; k < IN; k++) {
+            sum += (double)w1[r * IN + k] * input[k];
+        }
+        hidden[r] = sum > 0 ? (float)sum : 0;
+    }
+    for (size_t r = 0; r < OUT; r++) {
+        double sum = 0;
+        for (size_t k = 0; k < HIDDEN; k++) {
+            sum += (double)w2[r * HIDDEN + k] * hidden[k];
+        }
+        expected[r] = sum > 0 ? (float)sum : 0;
+    }
+
+    assert(inference(model, input, IN, output, OUT) == 0);
+    assert(compare_float_arrays(output, expected, OUT, 1e-2f));
+
+    // A layer that does not chain invalidates the plan
+    float stray[3 * 7] = {0};
+    assert(add_layer(model, stray, 3, 7) == 0);
+    assert(!model->plan.valid);
+    assert(inference(model, input, IN, output, 3) == -1);
+
+    free(w1);
+    free(w2);
+    free(hidden);
+    free_model(model);
+}
+
+static void test_layer_activations(void) {
+    static const Activation activations[] = {
+        ACTIVATION_NONE, ACTIVATION_SIGMOID, ACTIVATION_TANH, ACTIVATION_LEAKY_RELU, ACTIVATION_SOFTMAX
+    };
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights1[] = {0.5f, -1.0f, 0.25f, 1.0f, 0.5f, -0.75f};
+    float bias1[] = {0.1f, -2.0f};
+    float weights2[] = {1.0f, -1.0f, 0.5f, 2.0f, -0.5f, 0.25f};
+    float bias2[] = {0.0f, 0.5f, -0.5f};
+    float input[] = {1.0f, 2.0f, -1.0f};
+    float output[3];
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+
+    for (size_t a = 0; a < sizeof(activations) / sizeof(activations[0]); a++) {
+        Activation act = activations[a];
+        Model* model = create_model();
+        assert(add_layer_ex(model, weights1, bias1, 2, 3, ACTIVATION_TANH) == 0);
+        assert(add_layer_ex(model, weights2, bias2, 3, 2, act) == 0);
+        assert(model->layers[0].bias != NULL && model->layers[0].bias[1] == -2.0f);
+
+        // Reference: tanh(W1 x + b1), then act(W2 h + b2)
+        float hidden[2], expected[3];
+        for (size_t r = 0; r < 2; r++) {
+            float sum = bias1[r];
+            for (size_t k = 0; k < 3; k++) {
+                sum += weights1[r * 3 + k] * input[k];
+            }
+            hidden[r] = tanhf(sum);
+        }
+        float total = 0;
+        for (size_t r = 0; r < 3; r++) {
+            float v = bias2[r] + weights2[r * 2] * hidden[0] + weights2[r * 2 + 1] * hidden[1];
+            switch (act) {
+            case ACTIVATION_SIGMOID:    v = 1.0f / (1.0f + expf(-v)); break;
+            case ACTIVATION_TANH:       v = tanhf(v); break;
+            case ACTIVATION_LEAKY_RELU: v = v > 0 ? v : 0.01f * v; break;
+            case ACTIVATION_SOFTMAX:    v = expf(v); total += v; break;
+            default:                    break;
+            }
+            expected[r] = v;
+        }
+        if (act == ACTIVATION_SOFTMAX) {
+            for (size_t r = 0; r < 3; r++) {
+                expected[r] /= total;
+            }
+        }
+
+        assert(inference(model, input, 3, output, 3) == 0);
+        assert(compare_float_arrays(output, expected, 3, EPSILON));
+        assert(inference_batch(model, input, 1, 3, output, 3) == 0);
+        assert(compare_float_arrays(output, expected, 3, EPSILON));
+
+        // Bias and activation survive a round trip through every loader
+        assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+        Model* loaded[] = {
+            load_model(TEST_MODEL_FILE, secret_key, secret_key_len),
+            load_model_parallel(TEST_MODEL_FILE, secret_key, secret_key_len, 2, NULL),
+            load_model_mmap(TEST_MODEL_FILE, secret_key, secret_key_len),
+            load_model_lazy(TEST_MODEL_FILE, secret_key, secret_key_len, 0)
+        };
+        for (size_t i = 0; i < sizeof(loaded) / sizeof(loaded[0]); i++) {
+            assert(loaded[i] != NULL);
+            assert(loaded[i]->layers[1].activation == act);
+            assert(loaded[i]->layers[1].has_bias);
+            assert(inference(loaded[i], input, 3, output, 3) == 0);
+            assert(compare_float_arrays(output, expected, 3, EPSILON));
+            free_model(loaded[i]);
+        }
+
+        free_model(model);
+    }
+
+    Model* model = create_model();
+    assert(add_layer_ex(model, weights1, NULL, 2, 3, ACTIVATION_COUNT) == -1);
+    free_model(model);
+
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static float relative_error(const float* a, const float* b, size_t len) {
+    double diff = 0, norm = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff += (double)(a[i] - b[i]) * (a[i] - b[i]);
+        norm += (double)b[i] * b[i];
+    }
+    return (float)sqrt(diff / (norm > 0 ? norm : 1));
+}
+
+static long file_length(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+// A layer storage type and the bounds its conversion must stay within
+typedef struct {
+    LayerDType dtype;
+    float max_error;            // relative error of the output against float32
+    size_t size_num, size_den;  // file size must be below num/den of float32
+    float weight_relative;      // per-weight round-trip error bound,
+    float weight_absolute;      // relative plus absolute
+} ConvertedLayerCase;
+
+// Convert a two-layer model to c->dtype and check it against the float32
+// model: across ISAs, batched, saved and reloaded, and converted back
+static void check_converted_layers(const ConvertedLayerCase* c) {
+    enum { IN = 300, HIDDEN = 129, OUT = 10, BATCH = 5 };
+    static const KernelIsa isas[] = {
+        KERNEL_ISA_SCALAR, KERNEL_ISA_AVX2, KERNEL_ISA_AVX512, KERNEL_ISA_NEON
+    };
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float* w1 = malloc(HIDDEN * IN * sizeof(float));
+    float* w2 = malloc(OUT * HIDDEN * sizeof(float));
+    float b1[HIDDEN], b2[OUT];
+    float input[IN], expected[OUT], output[OUT], reference[OUT];
+    float batch_inputs[BATCH * IN], batch_outputs[BATCH * OUT];
+    assert(w1 && w2);
+
+    // Fixed data keeps the error bounds from depending on the clock
+    srand(15);
+    for (size_t i = 0; i < HIDDEN * IN; i++) {
+        w1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < OUT * HIDDEN; i++) {
+        w2[i] = ((float)rand() / RAND_MAX - 0.5f) * 0.2f;
+    }
+    for (size_t i = 0; i < HIDDEN; i++) {
+        b1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < OUT; i++) {
+        b2[i] = 0.1f * (float)i;
+    }
+    for (size_t i = 0; i < IN; i++) {
+        input[i] = 2.0f * (float)rand() / RAND_MAX - 1.0f;
+    }
+    for (size_t i = 0; i < BATCH * IN; i++) {
+        batch_inputs[i] = 2.0f * (float)rand() / RAND_MAX - 1.0f;
+    }
+
+    Model* model = create_model();
+    assert(add_layer_ex(model, w1, b1, HIDDEN, IN, ACTIVATION_RELU) == 0);
+    assert(add_layer_ex(model, w2, b2, OUT, HIDDEN, ACTIVATION_NONE) == 0);
+    assert(inference(model, input, IN, expected, OUT) == 0);
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+    long f32_size = file_length(TEST_MODEL_FILE);
+
+    assert(convert_layer(model, 0, c->dtype) == 0);
+    assert(convert_layer(model, 1, c->dtype) == 0);
+    assert(model->layers[0].dtype == c->dtype && model->layers[0].weights == NULL);
+    assert(acquire_layer_weights(model, 0) == NULL);
+
+    // ISAs differ at most in float summation order
+    KernelIsa original = get_kernel_isa();
+    assert(set_kernel_isa(KERNEL_ISA_SCALAR) == 0);
+    assert(inference(model, input, IN, reference, OUT) == 0);
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+        if (set_kernel_isa(isas[i]) != 0) {
+            continue;
+        }
+        assert(inference(model, input, IN, output, OUT) == 0);
+        assert(relative_error(output, reference, OUT) < 1e-5f);
+    }
+    assert(set_kernel_isa(original) == 0);
+    assert(relative_error(reference, expected, OUT) < c->max_error);
+
+    // The batched kernels give each input the same answer as running it alone
+    assert(inference(model, input, IN, reference, OUT) == 0);
+    assert(inference_batch(model, input, 1, IN, output, OUT) == 0);
+    assert(compare_float_arrays(output, reference, OUT, EPSILON));
+    assert(inference_batch(model, batch_inputs, BATCH, IN, batch_outputs, OUT) == 0);
+    for (size_t b = 0; b < BATCH; b++) {
+        assert(inference(model, batch_inputs + b * IN, IN, output, OUT) == 0);
+        assert(compare_float_arrays(batch_outputs + b * OUT, output, OUT, EPSILON));
+    }
+
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+    assert(file_length(TEST_MODEL_FILE) * (long)c->size_den < f32_size * (long)c->size_num);
+
+    Model* loaded[] = {
+        load_model(TEST_MODEL_FILE, secret_key, secret_key_len),
+        load_model_mmap(TEST_MODEL_FILE, secret_key, secret_key_len),
+        load_model_lazy(TEST_MODEL_FILE, secret_key, secret_key_len, 0)
+    };
+    for (size_t i = 0; i < sizeof(loaded) / sizeof(loaded[0]); i++) {
+        assert(loaded[i] != NULL);
+        assert(loaded[i]->layers[1].dtype == c->dtype);
+        assert(inference(loaded[i], input, IN, output, OUT) == 0);
+        assert(compare_float_arrays(output, reference, OUT, EPSILON));
+        free_model(loaded[i]);
+    }
+
+    assert(convert_layer(model, 1, LAYER_DTYPE_F32) == 0);
+    const float* restored = acquire_layer_weights(model, 1);
+    assert(restored != NULL);
+    for (size_t i = 0; i < OUT * HIDDEN; i++) {
+        assert(fabsf(restored[i] - w2[i]) <= fabsf(w2[i]) * c->weight_relative + c->weight_absolute);
+    }
+    release_layer_weights(model, 1);
+
+    // Half layers convert straight to INT8
+    if (c->dtype != LAYER_DTYPE_INT8) {
+        assert(convert_layer(model, 0, LAYER_DTYPE_INT8) == 0);
+        assert(inference(model, input, IN, output, OUT) == 0);
+        assert(relative_error(output, expected, OUT) < 0.03f);
+    }
+
+    free(w1);
+    free(w2);
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+static void test_int8_layers(void) {
+    // Weights take about a quarter of the space on disk, and dequantize to
+    // within half a quantization step
+    static const ConvertedLayerCase int8 = {LAYER_DTYPE_INT8, 0.03f, 1, 3, 0, 0.2f / 255.0f};
+    check_converted_layers(&int8);
+}
+
+static void test_half_precision_layers(void) {
+    // Weights take about half the space on disk, and widen back to within
+    // half an ulp, or half the smallest F16 subnormal for tiny weights
+    static const ConvertedLayerCase cases[] = {
+        {LAYER_DTYPE_F16, 0.002f, 6, 10, 1.0f / 2048, 3e-8f},
+        {LAYER_DTYPE_BF16, 0.01f, 6, 10, 1.0f / 256, 3e-8f}
+    };
+
+    // Conversions round to nearest even and keep special values
+    float special[] = {1.0f, -2.5f, 0.0f, 65504.0f, 1e6f, INFINITY, NAN, 5.9604645e-8f};
+    uint16_t halves[8];
+    float back[8];
+    f32_to_f16(special, halves, 8);
+    assert(halves[0] == 0x3c00 && halves[1] == 0xc100 && halves[2] == 0);
+    assert(halves[3] == 0x7bff && halves[4] == 0x7c00 && halves[5] == 0x7c00);
+    assert(halves[7] == 0x0001);
+    f16_to_f32(halves, back, 8);
+    assert(back[0] == 1.0f && back[1] == -2.5f && back[3] == 65504.0f);
+    assert(isinf(back[4]) && isnan(back[6]) && back[7] == special[7]);
+    f32_to_bf16(special, halves, 8);
+    assert(halves[0] == 0x3f80 && halves[1] == 0xc020 && halves[5] == 0x7f80);
+    bf16_to_f32(halves, back, 8);
+    assert(back[0] == 1.0f && back[1] == -2.5f && isnan(back[6]));
+    assert(fabsf(back[4] - 1e6f) < 1e6f / 128);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check_converted_layers(&cases[i]);
+    }
+}
+
+static void test_deep_model(void) {
+    enum { DEPTH = 40, WIDTH = 16 };
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float weights[WIDTH * WIDTH], bias[WIDTH];
+    float input[WIDTH], expected[WIDTH], output[WIDTH];
+
+    // Deeper than the old fixed table of ten layers
+    Model* model = create_model();
+    for (size_t l = 0; l < DEPTH; l++) {
+        for (size_t i = 0; i < WIDTH * WIDTH; i++) {
+            weights[i] = (i % (WIDTH + 1) == 0 ? 1.0f : 0.0f) + 0.05f * ((float)rand() / RAND_MAX - 0.5f);
+        }
+        for (size_t i = 0; i < WIDTH; i++) {
+            bias[i] = 0.01f * (float)i;
+        }
+        assert(add_layer_ex(model, weights, bias, WIDTH, WIDTH, ACTIVATION_TANH) == 0);
+    }
+    assert(model->num_layers == DEPTH && model->layer_capacity >= DEPTH);
+    for (size_t i = 0; i < WIDTH; i++) {
+        input[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    assert(inference(model, input, WIDTH, expected, WIDTH) == 0);
+
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    assert(save_model(model, TEST_MODEL_FILE, public_key, public_key_len) == 0);
+
+    Model* loaded[] = {
+        load_model(TEST_MODEL_FILE, secret_key, secret_key_len),
+        load_model_parallel(TEST_MODEL_FILE, secret_key, secret_key_len, 4, NULL),
+        load_model_mmap(TEST_MODEL_FILE, secret_key, secret_key_len),
+        load_model_lazy(TEST_MODEL_FILE, secret_key, secret_key_len, 0)
+    };
+    for (size_t i = 0; i < sizeof(loaded) / sizeof(loaded[0]); i++) {
+        assert(loaded[i] != NULL && loaded[i]->num_layers == DEPTH);
+        assert(inference(loaded[i], input, WIDTH, output, WIDTH) == 0);
+        assert(compare_float_arrays(output, expected, WIDTH, EPSILON));
+        if (loaded[i]->lazy) {
+            assert(loaded[i]->slab == NULL);
+        } else {
+            // Eagerly loaded layers sit in one slab, in order, on cache lines
+            const uint8_t* slab = loaded[i]->slab;
+            assert(slab != NULL);
+            for (size_t l = 0; l < DEPTH; l++) {
+                const uint8_t* data = loaded[i]->layers[l].data;
+                assert(loaded[i]->layers[l].in_slab);
+                assert(((uintptr_t)data % 64) == 0);
+                assert(data >= slab && data < slab + loaded[i]->slab_bytes);
+                assert(l == 0 || data > (const uint8_t*)loaded[i]->layers[l - 1].data);
+            }
+
+            // A converted layer moves out of the slab
+            assert(convert_layer(loaded[i], 3, LAYER_DTYPE_BF16) == 0);
+            assert(!loaded[i]->layers[3].in_slab);
+            assert(inference(loaded[i], input, WIDTH, output, WIDTH) == 0);
+        }
+        free_model(loaded[i]);
+    }
+
+    free_model(model);
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+    remove(TEST_MODEL_FILE);
+}
+
+#define TEST_SOCKET_PATH "test_server.sock"
+
+// The model served by the server and pipeline tests
+enum { SERVING_IN = 16, SERVING_HIDDEN = 24, SERVING_OUT = 8 };
+
+typedef struct {
+    Model* model;
+    uint8_t* public_key;
+    size_t public_key_len;
+    uint8_t* secret_key;
+    size_t secret_key_len;
+} ServingFixture;
+
+// Build a random ReLU -> softmax model, fill `count` random inputs with
+// their expected outputs and generate the model's keypair
+static void create_serving_fixture(ServingFixture* fixture, size_t count,
+                                   float* inputs, float* expected) {
+    float w1[SERVING_HIDDEN * SERVING_IN], w2[SERVING_OUT * SERVING_HIDDEN];
+
+    for (size_t i = 0; i < SERVING_HIDDEN * SERVING_IN; i++) {
+        w1[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < SERVING_OUT * SERVING_HIDDEN; i++) {
+        w2[i] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    for (size_t i = 0; i < count * SERVING_IN; i++) {
+        inputs[i] = (float)rand() / RAND_MAX;
+    }
+    fixture->model = create_model();
+    assert(add_layer_ex(fixture->model, w1, NULL, SERVING_HIDDEN, SERVING_IN, ACTIVATION_RELU) == 0);
+    assert(add_layer_ex(fixture->model, w2, NULL, SERVING_OUT, SERVING_HIDDEN, ACTIVATION_SOFTMAX) == 0);
+    assert(inference_batch(fixture->model, inputs, count, SERVING_IN, expected, SERVING_OUT) == 0);
+    assert(generate_keypair(&fixture->public_key, &fixture->public_key_len,
+                            &fixture->secret_key, &fixture->secret_key_len) == 0);
+}
+
+static void free_serving_fixture(ServingFixture* fixture) {
+    free_model(fixture->model);
+    cleanup((void**)&fixture->public_key);
+    cleanup((void**)&fixture->secret_key);
+}
+
+typedef struct {
+    const Model* model;
+    const uint8_t* public_key;
+    size_t public_key_len;
+    int failures;
+} ServerClients;
+
+static void run_server_task(void* arg) {
+    assert(server_run(arg) == 0);
+}
+
+// Each item is a client that checks a few responses against local inference
+static void server_client_range(void* arg, size_t begin, size_t end) {
+    ServerClients* clients = arg;
+    size_t in_size = clients->model->plan.input_size, out_size = clients->model->plan.output_size;
+    float input[SERVING_IN], expected[SERVING_OUT], output[SERVING_OUT];
+    for (size_t c = begin; c < end; c++) {
+        QrmeClient* client = client_connect(TEST_SOCKET_PATH, clients->public_key, clients->public_key_len);
+        for (size_t r = 0; client && r < 10; r++) {
+            for (size_t i = 0; i < in_size; i++) {
+                input[i] = (float)((c * 31 + r * 7 + i) % 17) / 17.0f;
+            }
+            if (client_infer(client, input, in_size, output, out_size) != 0 ||
+                inference(clients->model, input, in_size, expected, out_size) != 0 ||
+                !compare_float_arrays(output, expected, out_size, EPSILON)) {
+                __atomic_fetch_add(&clients->failures, 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (!client) {
+            __atomic_fetch_add(&clients->failures, 1, __ATOMIC_RELAXED);
+        }
+        client_close(client);
+    }
+}
+
+static void test_server(void) {
+    enum { IN = SERVING_IN, OUT = SERVING_OUT, PIPELINED = 8 };
+    uint8_t *other_public_key = NULL, *other_secret_key = NULL;
+    size_t other_public_key_len, other_secret_key_len;
+    float inputs[PIPELINED * IN], expected[PIPELINED * OUT], output[OUT];
+    ServingFixture fixture;
+    create_serving_fixture(&fixture, PIPELINED, inputs, expected);
+    Model* model = fixture.model;
+    const uint8_t* public_key = fixture.public_key;
+    const uint8_t* secret_key = fixture.secret_key;
+    size_t public_key_len = fixture.public_key_len, secret_key_len = fixture.secret_key_len;
+
+    // A long wait, so the pipelined requests below batch by size alone
+    ServerConfig config;
+    server_default_config(&config, TEST_SOCKET_PATH);
+    config.max_batch_size = SIZE_MAX / 8;
+    assert(create_server(&config, model, secret_key, secret_key_len) == NULL);
+    assert(qrme_last_error() == QRME_ERR_INVALID_ARGUMENT);
+    config.max_batch_size = 4;
+    config.max_wait_us = 200000;
+    QrmeServer* server = create_server(&config, model, secret_key, secret_key_len);
+    assert(server != NULL);
+    ThreadPool* loop = create_thread_pool(1);
+    assert(thread_pool_submit(loop, run_server_task, server) == 0);
+
+    QrmeClient* client = client_connect(TEST_SOCKET_PATH, public_key, public_key_len);
+    size_t in_size, out_size;
+    assert(client != NULL);
+    client_model_sizes(client, &in_size, &out_size);
+    assert(in_size == IN && out_size == OUT);
+
+    // One request on its own is sent once its batch times out
+    assert(client_infer(client, inputs, IN, output, OUT) == 0);
+    assert(compare_float_arrays(output, expected, OUT, EPSILON));
+
+    // Pipelined requests are batched and answered in order
+    for (size_t r = 0; r < PIPELINED; r++) {
+        assert(client_submit(client, inputs + r * IN, IN) == 0);
+    }
+    for (size_t r = 0; r < PIPELINED; r++) {
+        assert(client_receive(client, output, OUT) == 0);
+        assert(compare_float_arrays(output, expected + r * OUT, OUT, EPSILON));
+    }
+    ServerStats stats;
+    get_server_stats(server, &stats);
+    assert(stats.requests == 1 + PIPELINED && stats.largest_batch == 4 && stats.batches == 3);
+    assert(stats.connections == 1 && stats.errors == 0);
+    assert(client_submit(client, inputs, IN + 1) == -1);
+    client_close(client);
+
+    // A client holding the wrong public key cannot get a request through
+    assert(generate_keypair(&other_public_key, &other_public_key_len,
+                            &other_secret_key, &other_secret_key_len) == 0);
+    client = client_connect(TEST_SOCKET_PATH, other_public_key, other_public_key_len);
+    assert(client != NULL);
+    assert(client_infer(client, inputs, IN, output, OUT) == -1);
+    assert(qrme_last_error() == QRME_ERR_AUTH);
+    client_close(client);
+
+    // Many clients at once
+    ServerClients clients = {model, public_key, public_key_len, 0};
+    ThreadPool* pool = create_thread_pool(4);
+    thread_pool_parallel_for(pool, 8, 1, server_client_range, &clients);
+    free_thread_pool(pool);
+    assert(clients.failures == 0);
+    get_server_stats(server, &stats);
+    assert(stats.requests == 1 + PIPELINED + 80 && stats.errors == 1);
+
+    server_stop(server);
+    thread_pool_wait(loop);
+    free_thread_pool(loop);
+    free_server(server);
+    assert(access(TEST_SOCKET_PATH, F_OK) != 0);
+    assert(client_connect(TEST_SOCKET_PATH, public_key, public_key_len) == NULL);
+
+    // Zero-width layers give a valid plan, which must not divide by zero
+    Model* empty = create_model();
+    assert(add_layer(empty, inputs, 0, 0) == 0);
+    server = create_server(&config, empty, secret_key, secret_key_len);
+    assert(server != NULL);
+    free_server(server);
+    free_model(empty);
+
+    free_serving_fixture(&fixture);
+    cleanup((void**)&other_public_key);
+    cleanup((void**)&other_secret_key);
+}
+
+static void test_float_encoding(void) {
+    uint8_t *public_key = NULL, *secret_key = NULL;
+    size_t public_key_len, secret_key_len;
+    float values[4] = {1.0f, -2.5f, 0.0f, 3.14159f};
+    float encoded[4];
+
+    // The encoding is little-endian whatever the host
+    memcpy(encoded, values, sizeof(values));
+    float_array_to_le(encoded, 4);
+    const uint8_t* bytes = (const uint8_t*)encoded;
+    assert(bytes[0] == 0x00 && bytes[1] == 0x00 && bytes[2] == 0x80 && bytes[3] == 0x3f);
+    float_array_from_le(encoded, 4);
+    assert(memcmp(encoded, values, sizeof(values)) == 0);
+
+    uint8_t* byte_array;
+    size_t byte_array_len;
+    float* float_array;
+    size_t float_array_len;
+    assert(float_to_byte_array(values, 4, &byte_array, &byte_array_len) == 0);
+    assert(byte_array_len == sizeof(values) && byte_array[2] == 0x80 && byte_array[3] == 0x3f);
+    assert(byte_to_float_array(byte_array, byte_array_len, &float_array, &float_array_len) == 0);
+    assert(float_array_len == 4 && memcmp(float_array, values, sizeof(values)) == 0);
+    secure_free((void**)&byte_array);
+    secure_free((void**)&float_array);
+
+    // Encrypted vectors decrypt straight into the caller's buffer
+    assert(generate_keypair(&public_key, &public_key_len, &secret_key, &secret_key_len) == 0);
+    uint8_t* ciphertext;
+    size_t ciphertext_len, count;
+    float decrypted[4];
+    assert(encrypt_floats(public_key, public_key_len, values, 4, &ciphertext, &ciphertext_len) == 0);
+    assert(decrypt_floats_into(secret_key, secret_key_len, ciphertext, ciphertext_len,
+                               decrypted, 4, &count) == 0);
+    assert(count == 4 && memcmp(decrypted, values, sizeof(values)) == 0);
+    assert(decrypt_floats_into(secret_key, secret_key_len, ciphertext, ciphertext_len,
+                               decrypted, 3, &count) == -1);
+    assert(qrme_last_error() == QRME_ERR_INVALID_ARGUMENT);
+    secure_free((void**)&ciphertext);
+
+    // A plaintext that is not whole floats is rejected and wiped
+    assert(encrypt(public_key, public_key_len, (const uint8_t*)values, 7, &ciphertext, &ciphertext_len) == 0);
+    memset(decrypted, 0x55, sizeof(decrypted));
+    assert(decrypt_floats_into(secret_key, secret_key_len, ciphertext, ciphertext_len,
+                               decrypted, 4, &count) == -1);
+    assert(qrme_last_error() == QRME_ERR_FORMAT);
+    bytes = (const uint8_t*)decrypted;
+    for (size_t i = 0; i < 7; i++) {
+        assert(bytes[i] == 0);
+    }
+    secure_free((void**)&ciphertext);
+    assert(encrypt_floats(public_key, public_key_len, NULL, 4, &ciphertext, &ciphertext_len) == -1);
+
+    cleanup((void**)&public_key);
+    cleanup((void**)&secret_key);
+}
+
+typedef struct {
+    QrmePipeline* pipeline;
+    uint8_t** requests;
+    size_t* request_lens;
+    size_t count;
+} PipelineSubmitter;
+
+static void submit_pipeline_requests(void* arg) {
+    PipelineSubmitter* submitter = arg;
+    for (size_t r = 0; r < submitter->count; r++) {
+        assert(pipeline_submit(submitter->pipeline, submitter->requests[r], submitter->request_lens[r],
+                               (void*)(uintptr_t)r, NULL) == 0);
+    }
+    pipeline_close(submitter->pipeline);
+}
+
+static void test_pipeline(void) {
+    enum { IN = SERVING_IN, OUT = SERVING_OUT, REQUESTS = 40 };
+    float inputs[REQUESTS * IN], expected[REQUESTS * OUT];
+    uint8_t* requests[REQUESTS + 1];
+    size_t request_lens[REQUESTS + 1];
+    int seen[REQUESTS + 1] = {0};
+    ServingFixture fixture;
+    create_serving_fixture(&fixture, REQUESTS, inputs, expected);
+    Model* model = fixture.model;
+    const uint8_t* public_key = fixture.public_key;
+    const uint8_t* secret_key = fixture.secret_key;
+    size_t public_key_len = fixture.public_key_len, secret_key_len = fixture.secret_key_len;
+    for (size_t r = 0; r < REQUESTS; r++) {
+        assert(encrypt_floats(public_key, public_key_len, inputs + r * IN, IN,
+                              &requests[r], &request_lens[r]) == 0);
+    }
+    // The last request decrypts to the wrong number of floats
+    assert(encrypt_floats(public_key, public_key_len, inputs, IN - 1,
+                          &requests[REQUESTS], &request_lens[REQUESTS]) == 0);
+
+    // Few items in flight, so submission keeps running into backpressure
+    PipelineConfig config;
+    pipeline_default_config(&config);
+    config.max_in_flight = 4;
+    QrmePipeline* pipeline = create_pipeline(&config, model, secret_key, secret_key_len,
+                                             public_key, public_key_len);
+    assert(pipeline != NULL);
+    ThreadPool* pool = create_thread_pool(1);
+    PipelineSubmitter submitter = {pipeline, requests, request_lens, REQUESTS + 1};
+    assert(thread_pool_submit(pool, submit_pipeline_requests, &submitter) == 0);
+
+    // Results may arrive out of order; each one names its request
+    PipelineResult result;
+    size_t received = 0;
+    while (pipeline_receive(pipeline, &result) == 0) {
+        size_t r = (size_t)(uintptr_t)result.user_data;
+        assert(r <= REQUESTS && !seen[r] && result.sequence == r);
+        seen[r] = 1;
+        received++;
+        if (r == REQUESTS) {
+            assert(result.status == QRME_ERR_FORMAT && result.response == NULL);
+            assert(qrme_last_error_module() == QRME_MODULE_PIPELINE);
+            continue;
+        }
+        assert(result.status == QRME_OK);
+        float output[OUT];
+        size_t output_count;
+        assert(decrypt_floats_into(secret_key, secret_key_len, result.response, result.response_len,
+                                   output, OUT, &output_count) == 0);
+        assert(output_count == OUT);
+        assert(compare_float_arrays(output, expected + r * OUT, OUT, EPSILON));
+        secure_free((void**)&result.response);
+    }
+    assert(received == REQUESTS + 1);
+    thread_pool_wait(pool);
+    free_thread_pool(pool);
+    assert(pipeline_submit(pipeline, requests[0], request_lens[0], NULL, NULL) == -1);
+
+    PipelineStats stats;
+    get_pipeline_stats(pipeline, &stats);
+    assert(stats.submitted == REQUESTS + 1 && stats.received == REQUESTS + 1);
+    assert(stats.stages[PIPELINE_STAGE_DECRYPT].processed == REQUESTS);
+    assert(stats.stages[PIPELINE_STAGE_DECRYPT].failed == 1);
+    assert(stats.stages[PIPELINE_STAGE_INFER].processed == REQUESTS);
+    assert(stats.stages[PIPELINE_STAGE_ENCRYPT].processed == REQUESTS);
+    for (int s = 0; s < PIPELINE_STAGE_COUNT; s++) {
+        assert(stats.stages[s].queue_depth == 0);
+        assert(stats.stages[s].peak_queue_depth >= 1 && stats.stages[s].peak_queue_depth <= 4);
+        assert(stats.stages[s].total_service_ns >= stats.stages[s].max_service_ns);
+    }
+    free_pipeline(pipeline);
+
+    // Freeing a pipeline with requests still in flight abandons them
+    pipeline = create_pipeline(&config, model, secret_key, secret_key_len, public_key, public_key_len);
+    assert(pipeline != NULL);
+    for (size_t r = 0; r < 4; r++) {
+        assert(pipeline_submit(pipeline, requests[r], request_lens[r], NULL, NULL) == 0);
+    }
+    free_pipeline(pipeline);
+
+    config.infer_threads = 0;
+    assert(create_pipeline(&config, model, secret_key, secret_key_len, public_key, public_key_len) == NULL);
+    assert(qrme_last_error() == QRME_ERR_INVALID_ARGUMENT);
+
+    for (size_t r = 0; r <= REQUESTS; r++) {
+        secure_free((void**)&requests[r]);
+    }
+    free_serving_fixture(&fixture);
+}
+
 // Test runner
 static void run_test(const char* test_name, TestFunction test_func) {
     printf("Testing %s...\n", test_name);
@@ -125,19 +1867,71 @@ int main(void) {
     TestFunction tests[] = {
         test_key_generation,
         test_encryption_decryption,
+        test_crypto_ctx_reuse,
+        test_session,
+        test_stream,
+        test_secure_alloc,
+        test_secure_arena,
+        test_trace,
+        test_error_state,
         test_create_model,
         test_add_layer,
         test_save_load_model,
-        test_inference
+        test_save_load_chained_model,
+        test_save_model_parallel,
+        test_load_model_parallel,
+        test_load_model_mmap,
+        test_model_format,
+        test_load_model_lazy,
+        test_gemv_kernels,
+        test_gemm_half_kernels,
+        test_inference,
+        test_inference_batch,
+        test_inference_parallel,
+        test_inference_workspace,
+        test_execution_plan,
+        test_layer_activations,
+        test_int8_layers,
+        test_half_precision_layers,
+        test_deep_model,
+        test_server,
+        test_pipeline,
+        test_float_encoding
     };
 
     const char* test_names[] = {
         "key generation",
         "encryption and decryption",
+        "crypto context reuse",
+        "session encryption",
+        "streaming encryption",
+        "secure allocator",
+        "secure arena",
+        "tracing",
+        "thread-local error state",
         "model creation",
         "add layer",
         "save and load model",
-        "model inference"
+        "save and load chained model",
+        "parallel model save",
+        "parallel model load",
+        "memory-mapped model load",
+        "model file format",
+        "lazy model load",
+        "GEMV kernels",
+        "batched half-precision kernels",
+        "model inference",
+        "batched inference",
+        "parallel inference",
+        "inference workspace",
+        "execution plan",
+        "layer bias and activations",
+        "INT8 quantized layers",
+        "FP16 and BF16 layers",
+        "deep model",
+        "inference server",
+        "request pipeline",
+        "float encoding"
     };
 
     for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {